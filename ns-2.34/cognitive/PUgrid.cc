@@ -0,0 +1,141 @@
+#include "PUgrid.h"
+/* ==========================================================================================*/
+ /* PU grid class : Uniform-grid index of the PU transmitting/receiving ranges */
+/*===========================================================================================*/
+
+/* ==========================================================================================*/
+// PUGrid Initializer
+/* ==========================================================================================*/
+PUGrid::PUGrid() {
+	x_min_ = 0.0;
+	y_min_ = 0.0;
+	cell_size_ = 1.0;
+	nx_ = 0;
+	ny_ = 0;
+	nchannels_ = 1;
+	bucket_start_ = NULL;
+	entries_ = NULL;
+}
+
+PUGrid::~PUGrid() {
+	clear();
+}
+
+/* ==========================================================================================*/
+// clear: Release the index
+/* ==========================================================================================*/
+void PUGrid::clear() {
+	delete [] bucket_start_;
+	delete [] entries_;
+	bucket_start_ = NULL;
+	entries_ = NULL;
+	nx_ = 0;
+	ny_ = 0;
+}
+
+/* ==========================================================================================*/
+// cell_range: Get the range of cells covered by the bounding box of a disk, clipped to the grid
+/* ==========================================================================================*/
+void PUGrid::cell_range(double x, double y, double r, int *cx1, int *cy1, int *cx2, int *cy2) {
+	*cx1 = (int)((x - r - x_min_) / cell_size_);
+	*cy1 = (int)((y - r - y_min_) / cell_size_);
+	*cx2 = (int)((x + r - x_min_) / cell_size_);
+	*cy2 = (int)((y + r - y_min_) / cell_size_);
+	if (*cx1 < 0) *cx1 = 0;
+	if (*cy1 < 0) *cy1 = 0;
+	if (*cx2 >= nx_) *cx2 = nx_ - 1;
+	if (*cy2 >= ny_) *cy2 = ny_ - 1;
+}
+
+/* ==========================================================================================*/
+// build: Insert each PU in all the cells covered by its range. 
+// The cell side is the average PU radius, so that a PU is typically stored in a few cells 
+// and a lookup only has to test the PUs of the cell containing the CR
+/* ==========================================================================================*/
+void PUGrid::build(int n, const double *x, const double *y, const double *radius, const int *channel) {
+	clear();
+	if (n <= 0)
+		return;
+
+	double x_max, y_max, sum_radius = 0.0;
+	x_min_ = x[0] - radius[0];
+	y_min_ = y[0] - radius[0];
+	x_max = x[0] + radius[0];
+	y_max = y[0] + radius[0];
+	nchannels_ = 1;
+	for (int i=0; i<n; i++) {
+		if (x[i] - radius[i] < x_min_) x_min_ = x[i] - radius[i];
+		if (y[i] - radius[i] < y_min_) y_min_ = y[i] - radius[i];
+		if (x[i] + radius[i] > x_max) x_max = x[i] + radius[i];
+		if (y[i] + radius[i] > y_max) y_max = y[i] + radius[i];
+		sum_radius += radius[i];
+		if (channel && channel[i] + 1 > nchannels_)
+			nchannels_ = channel[i] + 1;
+	}
+	
+	cell_size_ = sum_radius / n;
+	if (cell_size_ <= 0.0)
+		cell_size_ = 1.0;
+	// Coarsen the grid if the area would need too many cells
+	while (((x_max - x_min_) / cell_size_ + 1) * ((y_max - y_min_) / cell_size_ + 1) > MAX_PU_GRID_CELLS)
+		cell_size_ *= 2;
+	nx_ = (int)((x_max - x_min_) / cell_size_) + 1;
+	ny_ = (int)((y_max - y_min_) / cell_size_) + 1;
+
+	// First pass: count the entries of each bucket
+	int nbuckets = nx_ * ny_ * nchannels_;
+	bucket_start_ = new int[nbuckets + 1];
+	for (int b=0; b<=nbuckets; b++)
+		bucket_start_[b] = 0;
+	for (int i=0; i<n; i++) {
+		int cx1, cy1, cx2, cy2;
+		int ch = (channel && channel[i] >= 0) ? channel[i] : 0;
+		cell_range(x[i], y[i], radius[i], &cx1, &cy1, &cx2, &cy2);
+		for (int cx=cx1; cx<=cx2; cx++)
+			for (int cy=cy1; cy<=cy2; cy++)
+				bucket_start_[(cy*nx_ + cx)*nchannels_ + ch + 1]++;
+	}
+	for (int b=0; b<nbuckets; b++)
+		bucket_start_[b+1] += bucket_start_[b];
+
+	// Second pass: fill the buckets, keeping the PU ids in increasing order
+	int *fill = new int[nbuckets];
+	for (int b=0; b<nbuckets; b++)
+		fill[b] = bucket_start_[b];
+	entries_ = new int[bucket_start_[nbuckets]];
+	for (int i=0; i<n; i++) {
+		int cx1, cy1, cx2, cy2;
+		int ch = (channel && channel[i] >= 0) ? channel[i] : 0;
+		cell_range(x[i], y[i], radius[i], &cx1, &cy1, &cx2, &cy2);
+		for (int cx=cx1; cx<=cx2; cx++)
+			for (int cy=cy1; cy<=cy2; cy++)
+				entries_[fill[(cy*nx_ + cx)*nchannels_ + ch]++] = i;
+	}
+	delete [] fill;
+}
+
+/* ==========================================================================================*/
+// candidates: Return the PUs stored in the cell containing (x,y) 
+/* ==========================================================================================*/
+int PUGrid::candidates(double x, double y, int channel, const int **list) {
+	*list = NULL;
+	if (nx_ == 0 || x < x_min_ || y < y_min_)
+		return 0;
+	int cx = (int)((x - x_min_) / cell_size_);
+	int cy = (int)((y - y_min_) / cell_size_);
+	if (cx >= nx_ || cy >= ny_)
+		return 0;
+	int first, last;
+	int cell = cy*nx_ + cx;
+	if (channel < 0) {
+		first = bucket_start_[cell*nchannels_];
+		last = bucket_start_[(cell+1)*nchannels_];
+	} else {
+		if (channel >= nchannels_)
+			return 0;
+		first = bucket_start_[cell*nchannels_ + channel];
+		last = bucket_start_[cell*nchannels_ + channel + 1];
+	}
+	*list = &entries_[first];
+	return last - first;
+}
@@ -0,0 +1,42 @@
+// PUgrid.h
+
+// Uniform-grid spatial index of PU transmitters/receivers, used to restrict
+// the PU distance checks to the PUs whose range covers a given CR location
+
+#ifndef NS_PU_GRID_H
+#define NS_PU_GRID_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Max number of cells in the grid: larger areas get coarser cells
+# define MAX_PU_GRID_CELLS	65536
+
+class PUGrid {
+	public:
+		PUGrid();
+		~PUGrid();
+		// Build the index over n PU ranges, i.e. disks of the given center and radius.
+		// If channel is not NULL, the entries of each cell are bucketed by channel.
+		void build(int n, const double *x, const double *y, const double *radius, const int *channel);
+		// Release the index
+		void clear();
+		// Return the number of PUs whose range may cover (x,y), and their ids in list.
+		// The ids are in increasing order when the grid is not bucketed by channel.
+		// channel selects a single bucket, -1 returns the PUs of all the channels.
+		int candidates(double x, double y, int channel, const int **list);
+	private:
+		double x_min_;			// grid origin
+		double y_min_;			// grid origin
+		double cell_size_;		// cell side
+		int nx_;			// number of cells along x
+		int ny_;			// number of cells along y
+		int nchannels_;			// number of channel buckets per cell
+		int *bucket_start_;		// bucket_start_[c*nchannels_+ch]: first entry of the bucket, CSR layout
+		int *entries_;			// PU ids, grouped by cell and channel
+		
+		// Get the range of cells covered by the disk [x-r, x+r] x [y-r, y+r]
+		void cell_range(double x, double y, double r, int *cx1, int *cy1, int *cx2, int *cy2);
+};
+
+#endif
@@ -0,0 +1,46 @@
+// PUmapfile.h
+
+// Binary PU map format, loaded by PUmodel through a memory mapping.
+// Produced from the text PU map by indep-utils/pumap-conv.
+//
+// Layout (host byte order, all offsets from the start of the file):
+//   pu_map_header
+//   pu_map_record[number_pu]
+//   for each PU, at record.offset:
+//     double arrival[number_data]	(sorted in increasing order)
+//     double departure[number_data]
+
+#ifndef NS_PU_MAP_FILE_H
+#define NS_PU_MAP_FILE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#define PU_MAP_MAGIC		"PUMAPBIN"
+#define PU_MAP_MAGIC_LEN	8
+#define PU_MAP_VERSION		1
+// Written in the header to detect a file produced on a host with a different byte order
+#define PU_MAP_BYTE_ORDER	0x01020304
+
+struct pu_map_header {
+	char magic[PU_MAP_MAGIC_LEN];	// PU_MAP_MAGIC, without the trailing '\0'
+	uint32_t version;		// PU_MAP_VERSION
+	uint32_t byte_order;		// PU_MAP_BYTE_ORDER
+	uint64_t number_pu;		// number of records following the header
+};
+
+struct pu_map_record {
+	int32_t main_channel;		// channel used for tx
+	int32_t reserved;		// padding, set to 0
+	double x_loc;			// PU transmitter location
+	double y_loc;
+	double x_loc_receiver;		// PU receiver location
+	double y_loc_receiver;
+	double alpha;			// PU <alpha-beta> activity description
+	double beta;
+	double radius;			// PU transmitting range
+	uint64_t number_data;		// number of arrival/departure entries
+	uint64_t offset;		// file offset of the arrival times
+};
+
+#endif
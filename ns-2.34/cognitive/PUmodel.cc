@@ -1,5 +1,13 @@
 
 #include "PUmodel.h"
+#include "SpectrumManager.h"
+#include <limits.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 /* ==========================================================================================*/
  /* PU model class : Implementation of the model of PU activity for CRAHNs */
 /*===========================================================================================*/
@@ -18,11 +26,35 @@ public:
 /* ==========================================================================================*/
 // PUmodel Initializer
 /* ==========================================================================================*/
-PUmodel::PUmodel() {
+PUmodel::PUmodel() : event_handler_(this) {
 	number_pu_ = 0;
+	pu_data = NULL;
+	map_base_ = NULL;
+	map_size_ = 0;
+	event_driven_ = false;
+	events_started_ = false;
+	event_lookahead_ = 0.0;
+	pu_events_ = NULL;
 	// Initialize Interference Statistics
 	interference_events_ = 0;
 	interference_power_ = 0.0;
+	interference_log_ = NULL;
+	interference_log_buf_ = NULL;
+	managers_ = NULL;
+	number_managers_ = 0;
+	max_managers_ = 0;
+	node_pus_ = NULL;
+	number_node_pus_ = NULL;
+	max_node_id_ = 0;
+}
+
+/* ==========================================================================================*/
+// PUmodel Destructor
+/* ==========================================================================================*/
+PUmodel::~PUmodel() {
+	free_data();
+	close_interference_log();
+	delete [] managers_;
 }
 
 
@@ -36,36 +68,55 @@ void PUmodel::setRepository(Repository* rep) {
 /* ==========================================================================================*/
 void PUmodel::read_data(char* dir) {
 	FILE* fd;	
-	fd=fopen(dir,"rt");	
+	char magic[PU_MAP_MAGIC_LEN];
+	fd=fopen(dir,"rb");	
 	if (IO_DEBUG) 
 		printf("Reading PU Data from File: %s \n", dir);
 	if (fd==NULL) {
 		printf(" ERROR. Can't open file %s \n",dir);
 		exit(0);
 	}
+	// Discard the data of a previously loaded map
+	free_data();
+	// Binary files start with PU_MAP_MAGIC, text files with the number of PUs
+	if (fread(magic, 1, PU_MAP_MAGIC_LEN, fd) == PU_MAP_MAGIC_LEN && 
+	    memcmp(magic, PU_MAP_MAGIC, PU_MAP_MAGIC_LEN) == 0) {
+		fclose(fd);
+		read_binary_data(dir);
+	} else {
+		rewind(fd);
+		read_text_data(fd, dir);
+		fclose(fd);
+	}
+	build_grids();
+}
+
+/* ==========================================================================================*/
+// read_text_data: Parse a text PU file
+/* ==========================================================================================*/
+void PUmodel::read_text_data(FILE *fd, char* dir) {
 	// The first line contains the following entry:
 	// <# number_of_PU>
-	fscanf(fd,"%d",&number_pu_);
-	if (ferror(fd)) {
+	if (fscanf(fd,"%d",&number_pu_) != 1) {
 		printf(" ERROR. Can't read PU number Information from file %s \n", dir);		
 		exit(0);
 	}
 	if (IO_DEBUG)
 		printf("[READING MAP FILE] #PU users: %d \n",number_pu_); 
-	if (number_pu_>	 MAX_PU_USERS) {
-		printf(" ERROR. Too many PU in the file. Max allowed is %d \n", MAX_PU_USERS);
+	if (number_pu_ < 0) {
+		printf(" ERROR. Invalid number of PU in the file %s \n", dir);
                 exit(0);
 	}
+	pu_data = new pu_activity[number_pu_];
 	
 	// The second section contains the following entry:
 	// <PU_id, x_loc, y_loc, x_loc_receiver, y_loc_receiver, alpha, beta, tx_range>
 	for (int i=0; i< number_pu_; i++) {
 		int channel;
-		float x,y,x2,y2;
-		float alpha, beta;
-		float range;		
-		fscanf(fd,"%d %f %f %f %f %e %e %f",&channel,&x,&y,&x2,&y2,&alpha,&beta,&range);
-		if (ferror(fd)) {
+		double x,y,x2,y2;
+		double alpha, beta;
+		double range;		
+		if (fscanf(fd,"%d %lf %lf %lf %lf %le %le %lf",&channel,&x,&y,&x2,&y2,&alpha,&beta,&range) != 8) {
 			printf(" ERROR. Can't read PU number Information from file %s \n", dir);		
 			exit(0);
 		}
@@ -80,6 +131,22 @@ void PUmodel::read_data(char* dir) {
 		pu_data[i].beta=beta;
 		pu_data[i].radius=range;
 		pu_data[i].interference=0.0;
+		pu_data[i].interference_events=0;
+		pu_data[i].interference_max=0.0;
+		pu_data[i].number_data=0;
+		pu_data[i].arrival_time=NULL;
+		pu_data[i].departure_time=NULL;
+		pu_data[i].detected=NULL;
+		pu_data[i].indexed=false;
+		pu_data[i].number_busy=0;
+		pu_data[i].busy_start=NULL;
+		pu_data[i].busy_end=NULL;
+		pu_data[i].busy_entry=NULL;
+		pu_data[i].cr_nodes=NULL;
+		pu_data[i].number_cr_nodes=0;
+		pu_data[i].max_cr_nodes=0;
+		pu_data[i].event_active=false;
+		pu_data[i].event_period=0;
 	}
 
 	// The third section contains the following entry:
@@ -87,43 +154,269 @@ void PUmodel::read_data(char* dir) {
 	// <departure_PU_0, ..,departure_PU_n>
 	
 	for (int j=0; j< number_pu_; j++) {
-		int arrivals=0;
-		int departures=0;
 		int number=0;
 		if (IO_DEBUG)
 			 printf("\n [READING MAP FILE] For PU User %d \n",(j+1));
-		fscanf(fd,"%d",&number);
-		if (ferror(fd)) {
+		if (fscanf(fd,"%d",&number) != 1) {
 			printf(" ERROR. Can't read PU number DATA Information from file %s \n", dir);		
 			exit(0);
 		}
 		if (IO_DEBUG)
 			printf("[READING MAP FILE] #PU data are %d \n",number); 
-		if (number>MAX_PU_DATA_ENTRY) {
-			printf(" ERROR. Too many PU DATA in the file. Max allowed is %d %d\n", MAX_PU_DATA_ENTRY,number);
+		if (number<0) {
+			printf(" ERROR. Invalid number of PU DATA in the file %s \n", dir);
                 	exit(0);
 		}
 		
 		pu_data[j].number_data=number;
+		pu_data[j].arrival_time=new double[number];
+		pu_data[j].departure_time=new double[number];
+
+		for (int i=0; i< number; i++) {
+			// Reading the arrival and departure times
+			if (fscanf(fd,"%lf %lf",&pu_data[j].arrival_time[i],&pu_data[j].departure_time[i]) != 2) {
+				printf(" ERROR. Can't read PU DATA Information from file %s \n", dir);		
+				exit(0);
+			}
+			if (IO_DEBUG)
+				printf("[READING MAP FILE] #PU arrival: %f departure: %f \n",pu_data[j].arrival_time[i],pu_data[j].departure_time[i]); 
+		}
+	}
+}
+
+/* ==========================================================================================*/
+// read_binary_data: Map a binary PU file. The arrival/departure entries are not copied, and the 
+// activity index of a PU is only built when the PU is first checked
+/* ==========================================================================================*/
+void PUmodel::read_binary_data(char* dir) {
+#ifndef WIN32
+	int fd = open(dir, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		printf(" ERROR. Can't open file %s \n",dir);
+		exit(0);
+	}
+	map_size_ = st.st_size;
+	// Private mapping: the pages touched by build_activity_index are copied on write
+	void *base = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		printf(" ERROR. Can't map file %s \n",dir);
+		exit(0);
+	}
+	map_base_ = (char *) base;
+#else
+	FILE *fd = fopen(dir, "rb");
+	if (fd == NULL) {
+		printf(" ERROR. Can't open file %s \n",dir);
+		exit(0);
+	}
+	fseek(fd, 0, SEEK_END);
+	map_size_ = ftell(fd);
+	rewind(fd);
+	map_base_ = new char[map_size_];
+	if (fread(map_base_, 1, map_size_, fd) != map_size_) {
+		printf(" ERROR. Can't read file %s \n",dir);
+		exit(0);
+	}
+	fclose(fd);
+#endif
+	pu_map_header *header = (pu_map_header *) map_base_;
+	if (map_size_ < sizeof(pu_map_header) || header->version != PU_MAP_VERSION || 
+	    header->byte_order != PU_MAP_BYTE_ORDER) {
+		printf(" ERROR. Unsupported PU map version or byte order in file %s \n", dir);
+		exit(0);
+	}
+	if (header->number_pu > (map_size_ - sizeof(pu_map_header)) / sizeof(pu_map_record)) {
+		printf(" ERROR. Can't read PU number Information from file %s \n", dir);		
+		exit(0);
+	}
+	number_pu_ = header->number_pu;
+	if (IO_DEBUG)
+		printf("[READING MAP FILE] #PU users: %d \n",number_pu_); 
+	pu_data = new pu_activity[number_pu_];
+
+	pu_map_record *record = (pu_map_record *) (map_base_ + sizeof(pu_map_header));
+	for (int i=0; i< number_pu_; i++, record++) {
+		uint64_t number = record->number_data;
+		if (number > INT_MAX || record->offset % sizeof(double) != 0 || record->offset > map_size_ ||
+		    number > (map_size_ - record->offset) / (2 * sizeof(double))) {
+			printf(" ERROR. Can't read PU DATA Information from file %s \n", dir);		
+			exit(0);
+		}
+		pu_data[i].main_channel=record->main_channel;
+		pu_data[i].x_loc=record->x_loc;
+		pu_data[i].y_loc=record->y_loc;
+		pu_data[i].x_loc_receiver=record->x_loc_receiver;
+		pu_data[i].y_loc_receiver=record->y_loc_receiver;
+		pu_data[i].alpha=record->alpha;
+		pu_data[i].beta=record->beta;
+		pu_data[i].radius=record->radius;
+		pu_data[i].interference=0.0;
+		pu_data[i].interference_events=0;
+		pu_data[i].interference_max=0.0;
+		pu_data[i].number_data=number;
+		pu_data[i].arrival_time=(double *) (map_base_ + record->offset);
+		pu_data[i].departure_time=pu_data[i].arrival_time + number;
+		pu_data[i].detected=NULL;
+		pu_data[i].indexed=false;
+		pu_data[i].number_busy=0;
+		pu_data[i].busy_start=NULL;
+		pu_data[i].busy_end=NULL;
+		pu_data[i].busy_entry=NULL;
+		pu_data[i].cr_nodes=NULL;
+		pu_data[i].number_cr_nodes=0;
+		pu_data[i].max_cr_nodes=0;
+		pu_data[i].event_active=false;
+		pu_data[i].event_period=0;
+		if (IO_DEBUG)
+			printf("[READING MAP FILE] PU Channel: %d #PU Location: %f %f #PU Receiver: %f %f TX RANGE: %f #PU data are %d\n",
+			       pu_data[i].main_channel,pu_data[i].x_loc,pu_data[i].y_loc,pu_data[i].x_loc_receiver,pu_data[i].y_loc_receiver,pu_data[i].radius,pu_data[i].number_data); 
+	}
+}
+
+/* ==========================================================================================*/
+// build_grids: Build the spatial indexes of the PU transmitting and receiving ranges
+/* ==========================================================================================*/
+void PUmodel::build_grids() {
+	double *x = new double[number_pu_];
+	double *y = new double[number_pu_];
+	double *radius = new double[number_pu_];
+	int *channel = new int[number_pu_];
+	
+	for (int i=0; i< number_pu_; i++) {
+		x[i]=pu_data[i].x_loc;
+		y[i]=pu_data[i].y_loc;
+		radius[i]=pu_data[i].radius;
+		channel[i]=pu_data[i].main_channel;
+	}
+	// Sensing checks the PUs of all the channels, in PU order
+	tx_grid_.build(number_pu_, x, y, radius, NULL);
+	
+	for (int i=0; i< number_pu_; i++) {
+		x[i]=pu_data[i].x_loc_receiver;
+		y[i]=pu_data[i].y_loc_receiver;
+	}
+	// Interference is only checked on the PU receivers of the CR channel
+	rx_grid_.build(number_pu_, x, y, radius, channel);
+	
+	delete [] x;
+	delete [] y;
+	delete [] radius;
+	delete [] channel;
+}
+
+/* ==========================================================================================*/
+// build_activity_index: Sort the arrival/departure entries of a PU, and coalesce the 
+// overlapping ones into disjoint busy periods, so that check_active does not scan the entries
+/* ==========================================================================================*/
+static int compare_pu_entry(const void *a, const void *b) {
+	const double *e1 = (const double *) a;
+	const double *e2 = (const double *) b;
+	if (e1[0] < e2[0])
+		return -1;
+	if (e1[0] > e2[0])
+		return 1;
+	return 0;
+}
+
+void PUmodel::build_activity_index(int pu_no) {
+	pu_activity *pu = &pu_data[pu_no];
+	int number = pu->number_data;
+	bool sorted = true;
+
+	pu->detected=new bool[number];
+	for (int i=0; i<number; i++) {
+		pu->detected[i]=false;
+		if (i>0 && pu->arrival_time[i] < pu->arrival_time[i-1])
+			sorted = false;
+	}
+	// Entries are normally listed in time order, sort them otherwise
+	if (!sorted) {
+		double *entries = new double[2*number];
+		for (int i=0; i<number; i++) {
+			entries[2*i]=pu->arrival_time[i];
+			entries[2*i+1]=pu->departure_time[i];
+		}
+		qsort(entries, number, 2*sizeof(double), compare_pu_entry);
+		for (int i=0; i<number; i++) {
+			pu->arrival_time[i]=entries[2*i];
+			pu->departure_time[i]=entries[2*i+1];
+		}
+		delete [] entries;
+	}
+
+	pu->busy_start=new double[number];
+	pu->busy_end=new double[number];
+	pu->busy_entry=new int[number];
+	pu->number_busy=0;
+	for (int i=0; i<number; i++) {
+		// Skip malformed entries, they can never overlap a time interval
+		if (pu->departure_time[i] < pu->arrival_time[i])
+			continue;
+		int k = pu->number_busy-1;
+		if (k>=0 && pu->arrival_time[i] <= pu->busy_end[k]) {
+			// The entry overlaps the last busy period: extend it
+			if (pu->departure_time[i] > pu->busy_end[k])
+				pu->busy_end[k]=pu->departure_time[i];
+		} else {
+			k = pu->number_busy++;
+			pu->busy_start[k]=pu->arrival_time[i];
+			pu->busy_end[k]=pu->departure_time[i];
+			pu->busy_entry[k]=i;
+		}
+	}
+	pu->cursor=0;
+	pu->cursor_time=0.0;
+	pu->indexed=true;
+	if (IO_DEBUG)
+		printf("[READING MAP FILE] PU %d: %d entries, %d busy periods \n",pu_no,number,pu->number_busy);
+}
 
-		for (int i=0; i< (2*number); i++) {
-			float time;
-			fscanf(fd," %f ",&time);
-			if (i%2==0) {		
-				// Reading the arrival time			
-				pu_data[j].arrival_time[arrivals]=time;
-				arrivals++;
-				if (IO_DEBUG)
-					printf("[READING MAP FILE] #PU arrival: %f \n",time); 
-			} else {
-				// Reading the departure time
-				pu_data[j].departure_time[departures]=time;
-				departures++;
-				if (IO_DEBUG)
-					printf("[READING MAP FILE] #PU departure: %f \n",time); 
-			}			
-			pu_data[j].detected[arrivals]=false;
+/* ==========================================================================================*/
+// free_data: Release the arrival/departure entries and the activity index of all PUs
+/* ==========================================================================================*/
+void PUmodel::free_data() {
+	if (pu_events_ != NULL) {
+		for (int i=0; i< number_pu_; i++)
+			if (pu_events_[i].uid_ > 0)
+				Scheduler::instance().cancel(&pu_events_[i]);
+		delete [] pu_events_;
+		pu_events_ = NULL;
+	}
+	events_started_ = false;
+	for (int n=0; n< max_node_id_; n++)
+		delete [] node_pus_[n];
+	delete [] node_pus_;
+	delete [] number_node_pus_;
+	node_pus_ = NULL;
+	number_node_pus_ = NULL;
+	max_node_id_ = 0;
+	for (int i=0; i< number_pu_; i++) {
+		delete [] pu_data[i].cr_nodes;
+		// Entries of a binary file belong to the mapping
+		if (map_base_ == NULL) {
+			delete [] pu_data[i].arrival_time;
+			delete [] pu_data[i].departure_time;
 		}
+		delete [] pu_data[i].detected;
+		delete [] pu_data[i].busy_start;
+		delete [] pu_data[i].busy_end;
+		delete [] pu_data[i].busy_entry;
+	}
+	delete [] pu_data;
+	pu_data = NULL;
+	number_pu_ = 0;
+	tx_grid_.clear();
+	rx_grid_.clear();
+	if (map_base_ != NULL) {
+#ifndef WIN32
+		munmap(map_base_, map_size_);
+#else
+		delete [] map_base_;
+#endif
+		map_base_ = NULL;
+		map_size_ = 0;
 	}
 }
 
@@ -144,58 +437,226 @@ void PUmodel::read_data(char* dir) {
 }
 */
 
+/* ==========================================================================================*/
+/* Event-driven PU activity */
+/* ==========================================================================================*/
+PUEventHandler::PUEventHandler(PUmodel *m) {
+	model=m;
+}
+
+void PUEventHandler::handle(Event *e) {
+	model->handle_pu_event(((PUEvent *) e)->pu_no);
+}
+
+/* ==========================================================================================*/
+// register_node: Add a sensing CR node to the nodes of the PUs in range
+/* ==========================================================================================*/
+void PUmodel::register_node(int node_id) {
+	if (!event_driven_)
+		return;
+	if (!events_started_)
+		start_events();
+	if (node_id >= max_node_id_) {
+		int max = (node_id >= 2 * max_node_id_) ? node_id + 1 : 2 * max_node_id_;
+		int **pus = new int*[max];
+		int *number_pus = new int[max];
+		for (int n=0; n< max; n++) {
+			pus[n] = (n < max_node_id_) ? node_pus_[n] : NULL;
+			number_pus[n] = (n < max_node_id_) ? number_node_pus_[n] : -1;
+		}
+		delete [] node_pus_;
+		delete [] number_node_pus_;
+		node_pus_ = pus;
+		number_node_pus_ = number_pus;
+		max_node_id_ = max;
+	}
+	// Already registered
+	if (number_node_pus_[node_id] >= 0)
+		return;
+	MobileNode *pnode = (MobileNode*)Node::get_node_by_address(node_id);
+	double x = pnode->X();
+	double y = pnode->Y();
+	const int *candidates;
+	int number = tx_grid_.candidates(x, y, -1, &candidates);
+	node_pus_[node_id] = new int[number > 0 ? number : 1];
+	number_node_pus_[node_id] = 0;
+	for (int k=0; k< number; k++) {
+		int i = candidates[k];
+		pu_activity *pu = &pu_data[i];
+		if (distance_sq(x,y,i) > pu->radius * pu->radius)
+			continue;
+		node_pus_[node_id][number_node_pus_[node_id]++] = i;
+		if (pu->number_cr_nodes == pu->max_cr_nodes) {
+			pu->max_cr_nodes = (pu->max_cr_nodes == 0) ? 8 : 2 * pu->max_cr_nodes;
+			int *nodes = new int[pu->max_cr_nodes];
+			for (int j=0; j< pu->number_cr_nodes; j++)
+				nodes[j] = pu->cr_nodes[j];
+			delete [] pu->cr_nodes;
+			pu->cr_nodes = nodes;
+		}
+		pu->cr_nodes[pu->number_cr_nodes++] = node_id;
+		if (pu->event_active)
+			repository_->add_pu_activity(node_id, pu->main_channel);
+	}
+}
+
+/* ==========================================================================================*/
+// start_events: Schedule the first arrival of each PU after the current time
+/* ==========================================================================================*/
+void PUmodel::start_events() {
+	Scheduler &s = Scheduler::instance();
+	double now = s.clock();
+	pu_events_ = new PUEvent[number_pu_];
+	for (int i=0; i< number_pu_; i++) {
+		pu_activity *pu = &pu_data[i];
+		int k = find_busy_period(i, now);
+		pu->event_active = false;
+		pu->event_period = k;
+		pu_events_[i].pu_no = i;
+		if (k < pu->number_busy) {
+			double start = pu->busy_start[k] - event_lookahead_;
+			s.schedule(&event_handler_, &pu_events_[i], (start > now) ? start - now : 0.0);
+		}
+	}
+	events_started_ = true;
+}
+
+/* ==========================================================================================*/
+// handle_pu_event: Update the channel state of the CR nodes in range, and schedule the next event
+/* ==========================================================================================*/
+void PUmodel::handle_pu_event(int pu_no) {
+	Scheduler &s = Scheduler::instance();
+	double now = s.clock();
+	pu_activity *pu = &pu_data[pu_no];
+	int k = pu->event_period;
+
+	if (!pu->event_active) {
+		// Arrival: the PU stays active until the end of the busy period, and of the following busy 
+		// periods which become active within the lookahead
+		pu->event_active = true;
+		for (int j=0; j< pu->number_cr_nodes; j++)
+			repository_->add_pu_activity(pu->cr_nodes[j], pu->main_channel);
+		while (k+1 < pu->number_busy && pu->busy_start[k+1] - event_lookahead_ <= pu->busy_end[k])
+			k++;
+		pu->event_period = k;
+		s.schedule(&event_handler_, &pu_events_[pu_no], (pu->busy_end[k] > now) ? pu->busy_end[k] - now : 0.0);
+	} else {
+		// Departure
+		pu->event_active = false;
+		for (int j=0; j< pu->number_cr_nodes; j++)
+			repository_->remove_pu_activity(pu->cr_nodes[j], pu->main_channel);
+		pu->event_period = ++k;
+		if (k < pu->number_busy) {
+			double start = pu->busy_start[k] - event_lookahead_;
+			s.schedule(&event_handler_, &pu_events_[pu_no], (start > now) ? start - now : 0.0);
+		}
+	}
+}
+
 /* //scan_PU_activity: Check if a PU is active in the time interval [timeNow, timeNow + ts] on channel given 
  * and also set update the channels free or busy for the node in repository */
-bool PUmodel::scan_PU_activity(double timeNow, double ts, int node_id, int channel, double prob_misdetect_) {
+bool PUmodel::scan_PU_activity(double timeNow, double ts, int node_id, int channel, double prob_misdetect_, bool *missed) {
+	bool suppressed = false;
+	if (event_driven_) {
+		// The PU activity is kept up to date by the PU events: the sensing interval is only checked
+		// against the PUs in range for the detection statistics, as in polling mode
+		if (node_id < max_node_id_)
+			for (int k=0; k< number_node_pus_[node_id]; k++)
+				check_active(timeNow,ts,node_pus_[node_id][k]);
+		bool active = repository_->is_pu_active(node_id, channel);
+		// Apply the probability of false negative detection: the channel is then seen free until the
+		// next sensing
+		if (active && Random::uniform() < prob_misdetect_) {
+			active = false;
+			suppressed = true;
+			repository_->set_channel_free(node_id, channel);
+		} else if (active && repository_->is_channel_free(node_id, channel))
+			repository_->set_channel_busy(node_id, channel);
+		if (missed)
+			*missed = suppressed;
+		return active;
+	}
 	MobileNode *pnode = (MobileNode*)Node::get_node_by_address(node_id);
 	double x = pnode->X();
 	double y = pnode->Y();	
-  	bool active = false;
-	for (int j = 0; j < MAX_CHANNELS; j++) {
-		repository_->set_channel_free(node_id, j);
-	}
-	for (int i=0; i< number_pu_; i++) {
-		if ((distance(x,y,i) <= pu_data[i].radius)) {
-			active = check_active(timeNow,ts,i);
+	const int *candidates;
+	repository_->set_all_channels_free(node_id);
+	// Only the PUs whose range covers the grid cell of the CR can be within range
+	int number = tx_grid_.candidates(x, y, -1, &candidates);
+	for (int k=0; k< number; k++) {
+		int i = candidates[k];
+		if (distance_sq(x,y,i) <= pu_data[i].radius * pu_data[i].radius) {
+			bool active = check_active(timeNow,ts,i);
 			// Apply the probability of false negative detection
 			double randomValue = Random::uniform();
-			if ((randomValue < prob_misdetect_) && active)
+			if ((randomValue < prob_misdetect_) && active) {
 				active = false;
-		}
-		if (active) {
-			repository_->set_channel_busy(node_id, pu_data[i].main_channel);
+				if (pu_data[i].main_channel == channel)
+					suppressed = true;
+			}
+			if (active) {
+				repository_->set_channel_busy(node_id, pu_data[i].main_channel);
+			}
 		}
 	}
-	return !(repository_->is_channel_free(node_id, channel));
+	bool busy = !(repository_->is_channel_free(node_id, channel));
+	if (missed)
+		*missed = suppressed && !busy;
+	return busy;
 }
 
 
+/* ==========================================================================================*/
+// find_busy_period: Return the first busy period of a PU ending at or after time (number_busy if none)
+/* ==========================================================================================*/
+int PUmodel::find_busy_period(int pu_no, double time) {
+	pu_activity *pu = &pu_data[pu_no];
+	if (!pu->indexed)
+		build_activity_index(pu_no);
+	int k = pu->cursor;
+	if (time >= pu->cursor_time) {
+		// Simulation time only moves forward: advance the cursor from the last lookup
+		while (k < pu->number_busy && pu->busy_end[k] < time)
+			k++;
+	} else {
+		// Lookup in the past: binary search on the busy period end times
+		int low = 0;
+		int high = pu->number_busy;
+		while (low < high) {
+			int mid = (low + high) / 2;
+			if (pu->busy_end[mid] < time)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		k = low;
+	}
+	pu->cursor = k;
+	pu->cursor_time = time;
+	return k;
+}
+
 /* ==========================================================================================*/
 // check:active: Check if a PU is transmitting in the intervale [timeNow, timeNow + ts]
 /* ==========================================================================================*/
 bool PUmodel::check_active(double timeNow, double ts, int pu_no) {
+	pu_activity *pu = &pu_data[pu_no];
 	double endTime=timeNow+ts;
-	int number=pu_data[pu_no].number_data;
-	double active=false;
+	int k = find_busy_period(pu_no, timeNow);
 
-	for (int i=0; i<number; i++) {
-		// Check if there is an overlapping with the current PU activity	
-		if( (pu_data[pu_no].arrival_time[i] >= timeNow && 
-		  pu_data[pu_no].departure_time[i] >= endTime && 
-		  pu_data[pu_no].arrival_time[i] <= endTime)   
-		  || (pu_data[pu_no].arrival_time[i]<=timeNow && 
-		  pu_data[pu_no].departure_time[i] >= endTime) 
-		  || (pu_data[pu_no].arrival_time[i]<=timeNow && 
-		  pu_data[pu_no].departure_time[i]>=timeNow && 
-		  pu_data[pu_no].departure_time[i]<=endTime)) {
-			active=true;
-			pu_data[pu_no].detected[i]=true;
+	// Check if there is an overlapping with the current PU activity	
+	if (k == pu->number_busy || pu->busy_start[k] > endTime)
+		return false;
+
+	// Mark the first arrival/departure entry of the busy period overlapping the interval as detected
+	int last = (k+1 < pu->number_busy) ? pu->busy_entry[k+1] : pu->number_data;
+	for (int i=pu->busy_entry[k]; i<last; i++) {
+		if (pu->arrival_time[i] <= endTime && pu->departure_time[i] >= timeNow) {
+			pu->detected[i]=true;
+			break;
 		}
-		// If there is on overlapping, then jump out from the cycle
-		if (active || pu_data[pu_no].arrival_time[i]>endTime)
-        	              i=number; 
 	}
-	return(active);
+	return true;
 }
 
 /**********************************************************/
@@ -212,6 +673,15 @@ double PUmodel::distance(double x, double y, int pu_no) {
 	return dist;
 }
 
+/* ==========================================================================================*/
+//distance_sq: Return the squared distance from the PU transmitter, to compare against squared ranges
+/* ==========================================================================================*/
+double PUmodel::distance_sq(double x, double y, int pu_no) {
+	double dx=x-pu_data[pu_no].x_loc;
+	double dy=y-pu_data[pu_no].y_loc;
+	return dx*dx+dy*dy;
+}
+
 /* ==========================================================================================*/
 //distance_receiver: Return the current distance from the PU receiver on a given channel 
 /* ==========================================================================================*/
@@ -222,6 +692,15 @@ double PUmodel::distance_receiver(double x, double y, int puNode) {
 	return dist;
 }
 
+/* ==========================================================================================*/
+//distance_receiver_sq: Return the squared distance from the PU receiver
+/* ==========================================================================================*/
+double PUmodel::distance_receiver_sq(double x, double y, int pu_no) {
+	double dx=x-pu_data[pu_no].x_loc_receiver;
+	double dy=y-pu_data[pu_no].y_loc_receiver;
+	return dx*dx+dy*dy;
+}
+
 /* ==========================================================================================*/
 // recv method: Receive a pkt (EMPTY METHOD)
 /* ==========================================================================================*/
@@ -234,18 +713,20 @@ void PUmodel::recv(Packet*, Handler*) {
 void PUmodel::update_stat_pu_receiver(int id, double timeNow, double txtime, double x, double y, int channel, double TX_POWER) {
 	double active=false;
 	double d, lambda, M, power;
-	FILE *fd;
+	const int *candidates;
 	// Power injected by CR nodes 
 	//double TX_POWER=0.2818;
-	// Check all the PU receivers
-	for (int i=0; i < number_pu_; i++) {
-		d = distance_receiver(x,y,i);
-		// Check if the CR is in the channel and range of a PU receiver		
-		if ((pu_data[i].main_channel==channel) && (d < pu_data[i].radius) ) {
+	// Check the PU receivers of the channel whose range covers the grid cell of the CR
+	int number = rx_grid_.candidates(x, y, channel, &candidates);
+	for (int k=0; k < number; k++) {
+		int i = candidates[k];
+		// Check if the CR is in the range of a PU receiver		
+		if ((pu_data[i].main_channel==channel) && (distance_receiver_sq(x,y,i) < pu_data[i].radius * pu_data[i].radius)) {
 			// Check if PU is transmitting at that time
 			active=check_active(timeNow, txtime, i);	
 			// If the PU is transmitting, compute the amount of interference injected by the CR
 			if (active) {
+				d = distance_receiver(x,y,i);
 				// Compute the Interference Power * Interference Time received by the destination
 		 		//interference_power_+=((TX_POWER * pow(1.5,4))/(pow(d,4))) * txtime;
 				//interference_events_++;
@@ -267,10 +748,14 @@ void PUmodel::update_stat_pu_receiver(int id, double timeNow, double txtime, dou
 				power = (TX_POWER * 1 * 1 * (M * M)) / 1 ;
 				if (power > 3.652e-10) { //3.652e-10 is the RxThreashold
 					interference_events_++;
-					fd=fopen("interference_pu","a");	
-					//fprintf(fd,"Time \t CRUser \t Event# \t RecvPower\n");
-					fprintf(fd,"%6.2f \t %d \t %d \t %e\n",timeNow, id, interference_events_, power);
-					fclose(fd);
+					interference_power_ += power * txtime;
+					pu_data[i].interference += power * txtime;
+					pu_data[i].interference_events++;
+					if (power > pu_data[i].interference_max)
+						pu_data[i].interference_max = power;
+					// Time \t CRUser \t Event# \t RecvPower \t PU
+					if (interference_log_)
+						fprintf(interference_log_,"%6.2f \t %d \t %d \t %e \t %d\n",timeNow, id, interference_events_, power, i);
 				}
 				//Added by Deepti -- End
 			}
@@ -285,36 +770,206 @@ void PUmodel::write_stat(int param) {
 	double power=0;	
 	FILE *fd;
 	FILE *fd2;
-	// Statistics 1: Compute the avg. Interference perceived by each PU receiver
-	if (interference_events_>0)
-		power=interference_power_ * 1000 / (100*27);
+	// Statistics 1: Compute the avg. Interference perceived by each PU receiver (mW), over the simulated time
+	double timeNow = Scheduler::instance().clock();
+	if (interference_events_>0 && number_pu_>0 && timeNow>0)
+		power=interference_power_ * 1000 / (timeNow*number_pu_);
 		//power=interference_power_/interference_events_;
 	fd=fopen("interference_pu","w");	
 	fprintf(fd,"%d %e\n",param,power);
 	fclose(fd);
 
 	// Statistics 2: Compute the avg probability of PU detection
-	int  number_PU_events=0;
-	int  number_PU_sense_detected=0;
-	// Compute the number of time a PU was transmitting and a CR detected its transmission
+	int  number_PU_events;
+	int  number_PU_sense_detected;
+	count_detected(&number_PU_events, &number_PU_sense_detected);
+	fd2=fopen("sensing","w");	
+	fprintf(fd2,"%d %f\n",param,((double)number_PU_sense_detected)/number_PU_events);
+	fclose(fd2);
+}
+
+/* ==========================================================================================*/
+// open_interference_log: Write the interference events on a file, through a buffer of bufsize bytes
+/* ==========================================================================================*/
+int PUmodel::open_interference_log(const char *file, int bufsize) {
+	close_interference_log();
+	interference_log_ = fopen(file, "w");
+	if (interference_log_ == NULL)
+		return -1;
+	if (bufsize > 0) {
+		interference_log_buf_ = new char[bufsize];
+		setvbuf(interference_log_, interference_log_buf_, _IOFBF, bufsize);
+	}
+	return 0;
+}
+
+/* ==========================================================================================*/
+// close_interference_log: Flush and close the interference event stream
+/* ==========================================================================================*/
+void PUmodel::close_interference_log() {
+	if (interference_log_ != NULL)
+		fclose(interference_log_);
+	interference_log_ = NULL;
+	delete [] interference_log_buf_;
+	interference_log_buf_ = NULL;
+}
+
+/* ==========================================================================================*/
+// write_interference_stat: Write one line per PU receiver with its interference accumulator:
+// PU, channel, events, interference power * time, avg. interference power (mW) over the simulated time, 
+// max interference power
+/* ==========================================================================================*/
+int PUmodel::write_interference_stat(const char *file) {
+	FILE *fd;
+	if (strcmp(file, "-") == 0)
+		fd = stdout;
+	else if ((fd = fopen(file, "w")) == NULL)
+		return -1;
+	double timeNow = Scheduler::instance().clock();
+	for (int i=0; i< number_pu_; i++) {
+		double avg = (timeNow > 0) ? pu_data[i].interference * 1000 / timeNow : 0.0;
+		fprintf(fd, "%d %d %d %e %e %e\n", i, pu_data[i].main_channel, pu_data[i].interference_events,
+			pu_data[i].interference, avg, pu_data[i].interference_max);
+	}
+	if (fd == stdout)
+		fflush(fd);
+	else
+		fclose(fd);
+	return 0;
+}
+
+/* ==========================================================================================*/
+// count_detected: Compute the number of time a PU was transmitting and a CR detected its transmission
+/* ==========================================================================================*/
+void PUmodel::count_detected(int *events, int *detected) {
+	*events = 0;
+	*detected = 0;
 	for (int i=0; (i< number_pu_); i++) {
 		int number_activities=pu_data[i].number_data;
-		number_PU_events+=number_activities;
+		*events+=number_activities;
+		// A PU never checked has no detected entries
+		if (!pu_data[i].indexed)
+			continue;
 
 		for (int j=0; j<number_activities; j++) 
 			if (pu_data[i].detected[j])  
-				number_PU_sense_detected++;					
+				(*detected)++;					
 	}
-	fd2=fopen("sensing","w");	
-	fprintf(fd2,"%d %f\n",param,((double)number_PU_sense_detected)/number_PU_events);
-	fclose(fd2);
+}
+
+/* ==========================================================================================*/
+// register_manager: Add the Spectrum Manager of a CR node to the telemetry
+/* ==========================================================================================*/
+void PUmodel::register_manager(SpectrumManager *sm) {
+	for (int i=0; i< number_managers_; i++)
+		if (managers_[i] == sm)
+			return;
+	if (number_managers_ == max_managers_) {
+		max_managers_ = (max_managers_ == 0) ? 16 : 2 * max_managers_;
+		SpectrumManager **managers = new SpectrumManager*[max_managers_];
+		for (int i=0; i< number_managers_; i++)
+			managers[i] = managers_[i];
+		delete [] managers_;
+		managers_ = managers;
+	}
+	managers_[number_managers_++] = sm;
+}
+
+/* ==========================================================================================*/
+// write_telemetry: Write a snapshot of the telemetry counters of the CR nodes, and of the PU 
+// detection and interference statistics, on a file ("-" for the standard output)
+/* ==========================================================================================*/
+int PUmodel::write_telemetry(const char *file, int format) {
+	FILE *fd;
+	if (strcmp(file, "-") == 0)
+		fd = stdout;
+	else if ((fd = fopen(file, "w")) == NULL)
+		return -1;
+	
+	int channels = (repository_ != NULL) ? repository_->get_number_channels() : MAX_CHANNELS;
+	int number_PU_events;
+	int number_PU_sense_detected;
+	count_detected(&number_PU_events, &number_PU_sense_detected);
+	
+	if (format == SM_STATS_CSV) {
+		SpectrumManager::write_stats_header(fd, channels);
+		for (int i=0; i< number_managers_; i++)
+			managers_[i]->write_stats(fd, format, channels);
+	} else {
+		fprintf(fd, "{\"time\": %f,\n\"pu\": {\"number_pu\": %d, \"activity_entries\": %d, "
+			"\"detected_entries\": %d, \"interference_events\": %d, \"interference_energy\": %e},\n\"nodes\": [\n",
+			Scheduler::instance().clock(), number_pu_, number_PU_events,
+			number_PU_sense_detected, interference_events_, interference_power_);
+		for (int i=0; i< number_managers_; i++) {
+			managers_[i]->write_stats(fd, format, channels);
+			fprintf(fd, "%s\n", (i+1 < number_managers_) ? "," : "");
+		}
+		fprintf(fd, "]}\n");
+	}
+	
+	if (fd == stdout)
+		fflush(fd);
+	else
+		fclose(fd);
+	return 0;
 }
 
 /* ==========================================================================================*/
 // Command method
 /* ==========================================================================================*/
 int PUmodel::command(int argc, const char*const* argv) {
+	if(argc == 2) {
+		// Switch to the event-driven PU model, before the CRs start sensing
+		if(strcmp(argv[1], "event_driven") == 0) {
+		    event_driven_ = true;
+   		    return TCL_OK;
+		}
+		// Flush and close the interference event stream
+		if(strcmp(argv[1], "interference-log-close") == 0) {
+		    close_interference_log();
+   		    return TCL_OK;
+		}
+		// Clear the telemetry counters of the CR nodes
+		if(strcmp(argv[1], "telemetry-reset") == 0) {
+		    for (int i=0; i< number_managers_; i++)
+			managers_[i]->reset_stats();
+   		    return TCL_OK;
+		}
+	} 
+	if(argc == 4) {
+		// Write the interference events on a file, with a buffer of <bufsize> bytes
+		if(strcmp(argv[1], "interference-log") == 0) {
+		    if (open_interference_log(argv[2], atoi(argv[3])) < 0) {
+			Tcl::instance().resultf("PUMap: can't open %s", argv[2]);
+			return TCL_ERROR;
+		    }
+   		    return TCL_OK;
+		}
+		// Write a snapshot of the telemetry counters: telemetry json|csv <file>
+		if(strcmp(argv[1], "telemetry") == 0) {
+		    int format;
+		    if (strcmp(argv[2], "json") == 0)
+			format = SM_STATS_JSON;
+		    else if (strcmp(argv[2], "csv") == 0)
+			format = SM_STATS_CSV;
+		    else {
+			Tcl::instance().resultf("PUMap: unknown telemetry format %s", argv[2]);
+			return TCL_ERROR;
+		    }
+		    if (write_telemetry(argv[3], format) < 0) {
+			Tcl::instance().resultf("PUMap: can't open %s", argv[3]);
+			return TCL_ERROR;
+		    }
+   		    return TCL_OK;
+		}
+	} 
 	if(argc == 3) {
+		// Switch to the event-driven PU model, a PU is detected <lookahead> seconds before its arrival
+		if(strcmp(argv[1], "event_driven") == 0) {
+		    event_driven_ = true;
+		    event_lookahead_ = atof(argv[2]);
+   		    return TCL_OK;
+		}
 		// Read the current PU activity file
 		if(strcmp(argv[1], "set_input_map") == 0) {
   		    read_data((char*)argv[2]);
@@ -325,6 +980,22 @@ int PUmodel::command(int argc, const char*const* argv) {
 		    write_stat(atoi(argv[2]));
    		    return TCL_OK;
 		}
+		// Write the interference events on a file (buffered)
+		else if(strcmp(argv[1], "interference-log") == 0) {
+		    if (open_interference_log(argv[2], INTERFERENCE_LOG_BUFSIZE) < 0) {
+			Tcl::instance().resultf("PUMap: can't open %s", argv[2]);
+			return TCL_ERROR;
+		    }
+   		    return TCL_OK;
+		}
+		// Write the interference accumulators of the PU receivers on a file
+		else if(strcmp(argv[1], "interference-stat") == 0) {
+		    if (write_interference_stat(argv[2]) < 0) {
+			Tcl::instance().resultf("PUMap: can't open %s", argv[2]);
+			return TCL_ERROR;
+		    }
+   		    return TCL_OK;
+		}
 	} 
 	return TCL_OK;
 }
\ No newline at end of file
@@ -12,68 +12,169 @@
 #include "object.h"
 
 #include "repository.h"
+#include "PUgrid.h"
+#include "PUmapfile.h"
 #include <common/mobilenode.h>
 
 // Constant value for the PU Mapping file
-# define MAX_PU_USERS 		60	// Max number of PUs 
 //# define MAX_CHANNEL 		11	// Max number of PU channel spectrum
-# define MAX_PU_DATA_ENTRY  	700	// Max number of PU-data entry
 # define IO_DEBUG		0	// Debug variable: enable verbose mode
 
 # define PEI		3.1415926535897
+# define INTERFERENCE_LOG_BUFSIZE	(1024 * 1024)	// Default buffer of the interference event stream
 //PU information
 struct pu_activity {
 	int main_channel;				// channel used for tx
 	int number_data; 				// number of arrival/departure entries
 	double x_loc;					// current location
 	double y_loc;					// current location
-	double arrival_time[MAX_PU_DATA_ENTRY];	// arrival time
-	double departure_time[MAX_PU_DATA_ENTRY];	// departure time
-	bool detected[MAX_PU_DATA_ENTRY];
+	double *arrival_time;				// arrival time, sorted
+	double *departure_time;				// departure time
+	bool *detected;					// entry detected by at least one CR
+	// Activity index: arrival/departure entries coalesced into disjoint busy periods, sorted by start time.
+	// It is built on the first lookup of the PU.
+	bool indexed;					// activity index and detected[] are built
+	int number_busy;				// number of busy periods
+	double *busy_start;				// busy period start
+	double *busy_end;				// busy period end
+	int *busy_entry;				// first arrival/departure entry covered by the busy period
+	int cursor;					// busy period returned by the last lookup
+	double cursor_time;				// time of the last lookup
 	double x_loc_receiver;				// PU receiver location
 	double y_loc_receiver;				// PU receiver location
 	double alpha;					// PU <alpha-beta> activity description
 	double beta;					// PU <alpha-beta> activity description
 	double radius;					// PU transmitting range
-	double interference;				// Avg. interference caused by CR on the PU receiver
+	// Interference accumulator of the PU receiver
+	double interference;				// Interference power * time injected by CRs
+	int interference_events;			// CR transmissions received above the RX threshold
+	double interference_max;			// Highest interference power received
+	// Event-driven mode
+	int *cr_nodes;					// CR nodes registered within the PU range
+	int number_cr_nodes;
+	int max_cr_nodes;
+	bool event_active;				// the PU is active for the registered CR nodes
+	int event_period;				// busy period of the next arrival/departure event
+};
+
+class PUmodel;
+class SpectrumManager;
+
+// Scheduler event for the arrival/departure of a PU
+class PUEvent : public Event {
+	public:
+		int pu_no;
+};
+
+class PUEventHandler : public Handler {
+	public:
+		PUEventHandler(PUmodel *m);
+		void handle(Event *e);
+	private:
+		PUmodel *model;
 };
 
 class PUmodel : public NsObject {
+	friend class PUEventHandler;
 	public:	
 		// PUmodel creator
 		PUmodel();
+		~PUmodel();
 		// Method for receiving command from OTCL
 		int command(int argc, const char*const* argv);
 		// Receiving packet method (NOT used)
 		void recv(Packet*, Handler*); 	
 		// Return true if a PU is transmitting in the same spectrum of the CR
 		bool is_PU_active(double timeNow, double ts, double x, double y, int channel);
-		bool scan_PU_activity(double timeNow, double ts, int node_id, int channel,double prob_misdetect_) ;
+		// missed, if given, is set to true if PU activity on the channel was not detected (false negative)
+		bool scan_PU_activity(double timeNow, double ts, int node_id, int channel,double prob_misdetect_, bool *missed = NULL) ;
 		// Write the statistics about interference on PU receivers
 		void write_stat(int param);
 		// Check if the tranmission of a CR may cause interference to a PU receiver
 		void update_stat_pu_receiver(int id, double timeNow, double txtime, double x, double y, int channel, double TX_POWER);
 		
 		void setRepository(Repository* rep);
+		// Register a sensing CR node. In event-driven mode, the node channel state is then kept up to date 
+		// in the repository by the PU arrival/departure events
+		void register_node(int node_id);
+		// Register the Spectrum Manager of a CR node, whose telemetry counters are dumped by write_telemetry
+		void register_manager(SpectrumManager *sm);
 	private:
 		// Number of PUs in the current scenario
 		int number_pu_;
 		// Data structures with information of PUs
-		pu_activity pu_data[MAX_PU_USERS];
+		pu_activity *pu_data;
+		// Spatial indexes of the PU transmitting ranges, and of the PU receiving ranges bucketed by channel
+		PUGrid tx_grid_;
+		PUGrid rx_grid_;
 		// Method to read data from PU file and save them in the pu_activity data structure 
 		void read_data(char * dir);
+		// Method to read data from a text PU file
+		void read_text_data(FILE *fd, char * dir);
+		// Method to map a binary PU file (see PUmapfile.h), arrival/departure entries are used in place
+		void read_binary_data(char * dir);
+		// Method to sort the arrival/departure entries of a PU and build its activity index
+		void build_activity_index(int pu_no);
+		// Method to build the spatial indexes of the PU transmitters and receivers
+		void build_grids();
+		// Method to release the arrival/departure entries and the activity index of all PUs
+		void free_data();
+		// Method to get the first busy period of a PU that ends at or after a given time
+		int find_busy_period(int pu_no, double time);
 		// Method to get the distance from the PU transmitter
 		double distance(double x, double y, int channel);
 		// Method to get the distance from the PU receiver
 		double distance_receiver(double x, double y, int channel);
+		// Method to get the squared distance from the PU transmitter
+		double distance_sq(double x, double y, int pu_no);
+		// Method to get the squared distance from the PU receiver
+		double distance_receiver_sq(double x, double y, int pu_no);
 		// Method to check if a PU is transmitting on a given spectrum at a given time
 		bool check_active(double timeNow, double ts, int channel);
 		// PU-Receiver interference statistics
 		int interference_events_;
 		double interference_power_;
+		// Optional stream of the interference events, fully buffered
+		FILE		*interference_log_;
+		char		*interference_log_buf_;
+		// Open the interference event stream on a file, with a buffer of bufsize bytes
+		int open_interference_log(const char *file, int bufsize);
+		void close_interference_log();
+		// Write the interference accumulators of the PU receivers on a file
+		int write_interference_stat(const char *file);
+		// Count the PU arrival/departure entries, and the ones detected by at least one CR
+		void count_detected(int *events, int *detected);
+		
+		// Telemetry: Spectrum Managers of the CR nodes
+		SpectrumManager	**managers_;
+		int		number_managers_;
+		int		max_managers_;
+		// Write the telemetry counters of the CR nodes and the PU statistics, in format SM_STATS_*
+		int write_telemetry(const char *file, int format);
 		
 		Repository 	*repository_;		// Cross-layer repository 
 		
+		// Event-driven mode: one scheduler event per PU arrival/departure replaces the polling of the PU 
+		// activity on each sensing. CR nodes are assumed not to move out of/into PU ranges.
+		bool		event_driven_;
+		bool		events_started_;
+		double		event_lookahead_;	// A PU is active for the CRs event_lookahead_ before its arrival
+		PUEvent		*pu_events_;
+		PUEventHandler	event_handler_;
+		// Schedule the first arrival event of each PU
+		void start_events();
+		// Handle the arrival/departure of a PU
+		void handle_pu_event(int pu_no);
+		// PUs in range of each registered CR node, whose activity is checked on each sensing of the
+		// node for the detection statistics, as in polling mode
+		int		**node_pus_;
+		int		*number_node_pus_;
+		int		max_node_id_;		// size of node_pus_
+		
+		// Binary PU file mapped in memory, NULL when the map was read from a text file
+		char		*map_base_;
+		size_t		map_size_;
+		
 };
 
 #endif
\ No newline at end of file
@@ -23,6 +23,14 @@ SpectrumManager::SpectrumManager(Mac802_11 *mac, int id): sstarttimer_(this), ss
 	transmit_time_ = DEFAULT_TRANSMITTING_INTERVAL;
 	
 	ChDecisionMAC_ = true;
+	
+	// Telemetry Initialization
+	state_ = SM_STATE_IDLE;
+	state_channel_ = 0;
+	stats_.channel_time = NULL;
+	stats_.channel_detections = NULL;
+	stats_channels_ = 0;
+	reset_stats();
 }
 
 
@@ -44,6 +52,14 @@ sstarttimer_(this), sstoptimer_(this), htimer_(this) {
 	
 	ChDecisionMAC_ = ChDecisionMAC;
 	
+	// Telemetry Initialization
+	state_ = SM_STATE_IDLE;
+	state_channel_ = 0;
+	stats_.channel_time = NULL;
+	stats_.channel_detections = NULL;
+	stats_channels_ = 0;
+	reset_stats();
+	
 	/*if(ChDecisionMAC_) 
 		 printf("ChDecisionMAC_ set to true\n");
 	else
@@ -105,9 +121,15 @@ void SpectrumManager::setPUmodel(double prob, PUmodel *p) {
 	prob_misdetect_ = prob;
 }
 
+SpectrumManager::~SpectrumManager() {
+	delete [] stats_.channel_time;
+	delete [] stats_.channel_detections;
+}
+
 //setRepository: set the current cross-layer repository
 void SpectrumManager::setRepository(Repository* rep) {
 	repository_=rep;
+	size_stats(repository_->get_number_channels());
 }
 
 /*//setSpectrumData: set the current Spectrum Loader module
@@ -120,8 +142,12 @@ void  SpectrumManager::setSpectrumData(SpectrumData *sd) {
 void SpectrumManager::start() {
 	
 	pumodel_->setRepository(repository_);
+	pumodel_->register_node(nodeId_);
+	
+	pumodel_->register_manager(this);
 	
-	// Start sensing on the current channel for a sense_time_ interval
+	// First check after a sense_time_ interval; nothing is sensed in it,
+	// so the CR stays idle and no sensing cycle is counted
 	sstarttimer_.start(sense_time_);
 }
 
@@ -165,6 +191,11 @@ void SpectrumManager::senseHandler() {
 		// Ask the Spectrum Decision if channel switching is needed
 		need_to_switch = decideSwitch();
 		if (need_to_switch) { 		// CR needs to vacate the channel
+			if (!handoff_pending_) {
+				handoff_pending_ = true;
+				handoff_start_ = Scheduler::instance().clock();
+			}
+			stats_.handoffs++;
 			performHandoff(); // Starts handoff timer
 			if(ChDecisionMAC_) { // Channel allocation is decided at MAC Layer
 				// Choose next channel and store the information in the shared repository
@@ -190,9 +221,7 @@ void SpectrumManager::senseHandler() {
 		} 
 		else  {
 			// CR does not vacate the spectrum and keeps sensing and waits for the channel to be free 	
-			pu_on_= sense(nodeId_,sense_time_,transmit_time_, current_channel);
-			sensing_ = true; // Set the sensing ON
-			sstarttimer_.start(sense_time_); // Start the sensing interval
+			start_sensing(current_channel);
 		 }
 	}
 	else {
@@ -203,6 +232,11 @@ void SpectrumManager::senseHandler() {
 			sensing_ = false;
 			switching_ = false;
 			// No channel switching, the CR can start transmitting on the current channel
+			enter_state(SM_STATE_TRANSMITTING, current_channel);
+			if (handoff_pending_) {
+				handoff_pending_ = false;
+				record_handoff_latency(Scheduler::instance().clock() - handoff_start_);
+			}
 			sstoptimer_.start(transmit_time_);
 			#ifdef SENSING_VERBOSE_MODE
 				//printf("[SENSING-DBG] Node %d starts transmitting on channel %d at time %f \n",nodeId_,current_channel,Scheduler::instance().clock()); 
@@ -215,9 +249,7 @@ void SpectrumManager::senseHandler() {
 //stopTransmitting: the CR stops transmitting, and starts sensing for PU detection
 void  SpectrumManager::stopTransmitting() {
 	int current_channel = repository_->get_recv_channel(nodeId_);
-	pu_on_= sense(nodeId_,sense_time_,transmit_time_, current_channel);
-	sensing_ = true; // Set the sensing ON
-	sstarttimer_.start(sense_time_); // Start the sensing interval
+	start_sensing(current_channel);
 	#ifdef SENSING_VERBOSE_MODE
 		printf("[SENSING-DBG-DS] Sensing Starts %f %d %d --\n",Scheduler::instance().clock(),nodeId_,current_channel); // Added by Deepti Singhal
 	#endif
@@ -227,6 +259,7 @@ void  SpectrumManager::stopTransmitting() {
 // performHandoff: start handoff timer, during which a CR can not transmit data               
 void SpectrumManager::performHandoff() {
 	switching_ = true;
+	enter_state(SM_STATE_SWITCHING, state_channel_);
 	htimer_.start(SWITCHING_DELAY);
 }
 
@@ -235,15 +268,33 @@ void SpectrumManager::performHandoff() {
 void  SpectrumManager::endHandoff() {
 	switching_ = false;
 	int current_channel = repository_->get_recv_channel(nodeId_);
-	pu_on_= sense(nodeId_,sense_time_,transmit_time_, current_channel);
-	sensing_ = true; // Set the sensing ON
-	sstarttimer_.start(sense_time_); // Start the sensing interval
+	start_sensing(current_channel);
 	#ifdef SENSING_VERBOSE_MODE
 		printf("[SENSING-DBG-DS] Handoff End %f %d %d --\n",Scheduler::instance().clock(),nodeId_,current_channel); // Added by Deepti Singhal
 		printf("[SENSING-DBG-DS] Sensing Starts %f %d %d --\n",Scheduler::instance().clock(),nodeId_,current_channel); // Added by Deepti Singhal
 	#endif
 }
 
+//start_sensing: start a sensing interval on the current channel, PU activity is checked for the whole interval
+void SpectrumManager::start_sensing(int channel) {
+	bool missed;
+	enter_state(SM_STATE_SENSING, channel);
+	pu_on_= sense(nodeId_,sense_time_,transmit_time_, channel, &missed);
+	sensing_ = true; // Set the sensing ON
+	sstarttimer_.start(sense_time_); // Start the sensing interval
+	
+	stats_.sense_cycles++;
+	if (pu_on_) {
+		stats_.pu_detections++;
+		if (channel >= 0) {
+			size_stats(channel + 1);
+			stats_.channel_detections[channel]++;
+		}
+	}
+	if (missed)
+		stats_.false_negatives++;
+}
+
 // decideSwitch: decide wether to stay or leave the current channel, when a PU is detected       
 bool SpectrumManager::decideSwitch() {
 	double randomValue;
@@ -271,16 +322,17 @@ bool SpectrumManager::decideSwitch() {
 // decideSpectrum: get the next spectrum to be used, based on the allocation policy
 int SpectrumManager::decideSpectrum(int current_channel) {
 	int next_channel;
+	int channels = repository_->get_number_channels();
 	switch(spectrum_policy_){ 
-		// Policy RANDOM_SWITCH: next_channel -> random(1..MAX_CHANNELS)
+		// Policy RANDOM_SWITCH: next_channel -> random(1..channels)
 		case RANDOM_SWITCH:
-			next_channel = ((int)(Random::uniform()*MAX_CHANNELS))+1;		
-			if (next_channel >= MAX_CHANNELS)
-				next_channel = MAX_CHANNELS - 1;
+			next_channel = ((int)(Random::uniform()*channels))+1;		
+			if (next_channel >= channels)
+				next_channel = channels - 1;
 			break;
-		// Policy ROUND_ROBIN_SWITCH: next channel -> ( next_channel + 1 ) % MAX_CHANNELS
+		// Policy ROUND_ROBIN_SWITCH: next channel -> ( next_channel + 1 ) % channels
 		case ROUND_ROBIN_SWITCH:
-			next_channel = (current_channel+1) % MAX_CHANNELS;
+			next_channel = (current_channel+1) % channels;
 			if (next_channel == 0)
 				next_channel++;
 			break;
@@ -316,13 +368,16 @@ bool SpectrumManager::sense(int id, double sense_time, double transmit_time, int
 }*/
 
 // sense: return true if PU activity is detected in the time interval [current_time:current_time + sense_time]
-bool SpectrumManager::sense(int id, double sense_time, double transmit_time, int channel) {
+// missed, if given, is set to true if PU activity on the channel was not detected (false negative)
+bool SpectrumManager::sense(int id, double sense_time, double transmit_time, int channel, bool *missed) {
 	#ifdef SENSING_VERBOSE_MODE
 		printf("[DS] %d SenseTimeStart %f \n", nodeId_, Scheduler::instance().clock());
 	#endif
 	bool cr_on = false;
+	if (missed)
+		*missed = false;
 	if (pumodel_) {
-		cr_on = pumodel_->scan_PU_activity(Scheduler::instance().clock(),sense_time, id,channel, prob_misdetect_) ;
+		cr_on = pumodel_->scan_PU_activity(Scheduler::instance().clock(),sense_time, id,channel, prob_misdetect_, missed) ;
 	}
 	#ifdef SENSING_VERBOSE_MODE
 		printf("[DS] %d SenseTimeEnd %f \n", nodeId_, Scheduler::instance().clock());
@@ -340,5 +395,125 @@ bool SpectrumManager::update_pu_interference(int nodeid, double txpwr, double ti
 }
 // Added by Deepti -- End */
 
+/*===========================================================================================*/
+ // TELEMETRY
+/*===========================================================================================*/
+//enter_state: account the time spent in the current state and channel, and enter a new state
+void SpectrumManager::enter_state(int state, int channel) {
+	double now = Scheduler::instance().clock();
+	stats_.state_time[state_] += now - state_since_;
+	if (state_ == SM_STATE_TRANSMITTING && state_channel_ >= 0) {
+		size_stats(state_channel_ + 1);
+		stats_.channel_time[state_channel_] += now - state_since_;
+	}
+	state_ = state;
+	state_channel_ = channel;
+	state_since_ = now;
+}
+
+//record_handoff_latency: add a completed handoff to the latency statistics
+void SpectrumManager::record_handoff_latency(double latency) {
+	int bin = 0;
+	double ms = latency * 1000;
+	while (bin < SM_LATENCY_BINS - 1 && ms >= (double)(1 << bin))
+		bin++;
+	stats_.handoff_latency_bins[bin]++;
+	stats_.handoff_completed++;
+	stats_.handoff_latency_sum += latency;
+	if (latency > stats_.handoff_latency_max)
+		stats_.handoff_latency_max = latency;
+}
+
+//size_stats: grow the per channel counters to at least channels entries, keeping their values
+void SpectrumManager::size_stats(int channels) {
+	if (channels <= stats_channels_)
+		return;
+	double *channel_time = new double[channels];
+	int *channel_detections = new int[channels];
+	for (int c=0; c<channels; c++) {
+		channel_time[c] = (c < stats_channels_) ? stats_.channel_time[c] : 0.0;
+		channel_detections[c] = (c < stats_channels_) ? stats_.channel_detections[c] : 0;
+	}
+	delete [] stats_.channel_time;
+	delete [] stats_.channel_detections;
+	stats_.channel_time = channel_time;
+	stats_.channel_detections = channel_detections;
+	stats_channels_ = channels;
+}
+
+//reset_stats: clear the counters, the current state is accounted from now on
+void SpectrumManager::reset_stats() {
+	double *channel_time = stats_.channel_time;
+	int *channel_detections = stats_.channel_detections;
+	memset(&stats_, 0, sizeof(stats_));
+	stats_.channel_time = channel_time;
+	stats_.channel_detections = channel_detections;
+	for (int c=0; c<stats_channels_; c++) {
+		stats_.channel_time[c] = 0.0;
+		stats_.channel_detections[c] = 0;
+	}
+	state_since_ = Scheduler::instance().clock();
+	handoff_pending_ = false;
+	handoff_start_ = 0.0;
+}
+
+//write_stats_header: write the column names of the SM_STATS_CSV format
+void SpectrumManager::write_stats_header(FILE *fd, int channels) {
+	fprintf(fd, "time,node,sense_cycles,pu_detections,false_negatives,handoffs,handoff_completed,"
+		"handoff_latency_mean,handoff_latency_max,time_idle,time_sensing,time_switching,time_transmitting");
+	for (int i=0; i<SM_LATENCY_BINS; i++)
+		fprintf(fd, ",latency_bin_%d", i);
+	for (int c=0; c<channels; c++)
+		fprintf(fd, ",ch%d_time,ch%d_detections", c, c);
+	fprintf(fd, "\n");
+}
+
+//write_stats: write the counters of the node, the time spent in the current state is accounted up to now
+void SpectrumManager::write_stats(FILE *fd, int format, int channels) {
+	double now = Scheduler::instance().clock();
+	double state_time[SM_NUMBER_STATES];
+	// time transmitting on state_channel_ not accounted yet
+	double open_time = (state_ == SM_STATE_TRANSMITTING) ? now - state_since_ : 0.0;
+	
+	size_stats(channels);
+	for (int i=0; i<SM_NUMBER_STATES; i++)
+		state_time[i] = stats_.state_time[i];
+	state_time[state_] += now - state_since_;
+	double latency_mean = (stats_.handoff_completed > 0) ? 
+		stats_.handoff_latency_sum / stats_.handoff_completed : 0.0;
+	
+	if (format == SM_STATS_CSV) {
+		fprintf(fd, "%f,%d,%d,%d,%d,%d,%d,%f,%f,%f,%f,%f,%f", now, nodeId_,
+			stats_.sense_cycles, stats_.pu_detections, stats_.false_negatives,
+			stats_.handoffs, stats_.handoff_completed, latency_mean, stats_.handoff_latency_max,
+			state_time[SM_STATE_IDLE], state_time[SM_STATE_SENSING],
+			state_time[SM_STATE_SWITCHING], state_time[SM_STATE_TRANSMITTING]);
+		for (int i=0; i<SM_LATENCY_BINS; i++)
+			fprintf(fd, ",%d", stats_.handoff_latency_bins[i]);
+		for (int c=0; c<channels; c++)
+			fprintf(fd, ",%f,%d", stats_.channel_time[c] + ((c == state_channel_) ? open_time : 0.0),
+				stats_.channel_detections[c]);
+		fprintf(fd, "\n");
+		return;
+	}
+	
+	fprintf(fd, "{\"node\": %d, \"sense_cycles\": %d, \"pu_detections\": %d, \"false_negatives\": %d, "
+		"\"handoffs\": %d, ", nodeId_, stats_.sense_cycles, stats_.pu_detections,
+		stats_.false_negatives, stats_.handoffs);
+	fprintf(fd, "\"handoff_latency\": {\"count\": %d, \"mean\": %f, \"max\": %f, \"bins_ms\": [",
+		stats_.handoff_completed, latency_mean, stats_.handoff_latency_max);
+	for (int i=0; i<SM_LATENCY_BINS; i++)
+		fprintf(fd, "%s%d", (i > 0) ? ", " : "", stats_.handoff_latency_bins[i]);
+	fprintf(fd, "]}, \"time\": {\"idle\": %f, \"sensing\": %f, \"switching\": %f, \"transmitting\": %f}, ",
+		state_time[SM_STATE_IDLE], state_time[SM_STATE_SENSING],
+		state_time[SM_STATE_SWITCHING], state_time[SM_STATE_TRANSMITTING]);
+	fprintf(fd, "\"channels\": [");
+	for (int c=0; c<channels; c++)
+		fprintf(fd, "%s{\"channel\": %d, \"time\": %f, \"detections\": %d}", (c > 0) ? ", " : "",
+			c, stats_.channel_time[c] + ((c == state_channel_) ? open_time : 0.0),
+			stats_.channel_detections[c]);
+	fprintf(fd, "]}");
+}
+
 // CRAHNs Model END
 // @author:  Marco Di Felice
\ No newline at end of file
@@ -50,10 +50,42 @@
 #define RANDOM_SWITCH		1
 
 
+// Spectrum Manager states, for the time accounting of the telemetry counters
+#define SM_STATE_IDLE		0	// Sensing not started yet
+#define SM_STATE_SENSING	1
+#define SM_STATE_SWITCHING	2
+#define SM_STATE_TRANSMITTING	3
+#define SM_NUMBER_STATES	4
+
+// Handoff latency histogram: bin 0 counts latencies below 1 ms, bin k latencies in [2^(k-1), 2^k) ms,
+// the last bin all the longer ones
+#define SM_LATENCY_BINS		16
+
+// Telemetry output formats
+#define SM_STATS_JSON		0
+#define SM_STATS_CSV		1
+
 // Other classes
 class Mac802_11;
 class SpectrumManager;
 
+// Telemetry counters of a CR node, always updated and dumped through the PUMap "telemetry" command
+struct spectrum_stats {
+	int sense_cycles;			// sensing intervals started
+	int pu_detections;			// sensing intervals with PU activity detected on the current channel
+	int false_negatives;			// sensing intervals with PU activity missed on the current channel
+	int handoffs;				// spectrum handoffs started
+	// Handoff latency: from the decision to vacate a channel to the first transmitting interval on a new one
+	int handoff_completed;
+	double handoff_latency_sum;
+	double handoff_latency_max;
+	int handoff_latency_bins[SM_LATENCY_BINS];
+	double state_time[SM_NUMBER_STATES];	// time spent in each SM_STATE_*
+	// Per channel, stats_channels_ entries sized from the repository
+	double *channel_time;			// time spent transmitting on each channel
+	int *channel_detections;		// sensing intervals with PU activity detected on each channel
+};
+
 /* ======================================================================================*/
 /* Timers */
 
@@ -99,6 +131,7 @@ class SpectrumManager  {
 		SpectrumManager(Mac802_11 *mac, int id);
 		// Initialize a new Spectrum Manager
 		SpectrumManager(Mac802_11 *mac, int id, double sense_time, double transmit_time, bool ChDecisionMAC);
+		~SpectrumManager();
 		
 		// Start method: CR agent starts sensing activity on the current channel
 		void start();
@@ -120,6 +153,13 @@ class SpectrumManager  {
 		
 		bool update_pu_interference(int nodeid, double txpwr, double time_tx); //Added by Deepti
 		
+		// Telemetry: write the counters of the node in format SM_STATS_*, up to the current time
+		void write_stats(FILE *fd, int format, int channels);
+		// Telemetry: write the header line of the SM_STATS_CSV format
+		static void write_stats_header(FILE *fd, int channels);
+		// Telemetry: clear the counters
+		void reset_stats();
+		
 	private:
 		// Spectrum Cycle Timers and Variables
 		SenseStartTimer 	sstarttimer_;	// Sensing Timer
@@ -148,6 +188,24 @@ class SpectrumManager  {
 		Repository 	*repository_;		// Cross-layer repository 
 		//SpectrumData	*dataMod_;		// Spectrum Data Loader Module
 		
+		// Telemetry
+		spectrum_stats	stats_;
+		int		stats_channels_;	// Channels in the per channel counters
+		int		state_;			// SM_STATE_* 
+		int		state_channel_;		// Channel used in the current state
+		double		state_since_;		// Time the current state was entered
+		bool		handoff_pending_;	// A handoff was started and the CR did not transmit since
+		double		handoff_start_;
+		// Account the time spent in the current state, and enter a new one
+		void enter_state(int state, int channel);
+		// Account a completed handoff
+		void record_handoff_latency(double latency);
+		// Grow the per channel counters to at least the given number of channels
+		void size_stats(int channels);
+		
+		// Start a sensing interval on the current channel
+		void start_sensing(int channel);
+		
 		// Timer Handlers
 		// Handler for sensing timer
 		void senseHandler();
@@ -164,7 +222,7 @@ class SpectrumManager  {
 		int decideSpectrum(int current_channel);	
 		
 		// Perform sensing and return true if PU activity is detected on the current channel
-		bool sense(int id, double sense_time, double transmit_time, int channel);		
+		bool sense(int id, double sense_time, double transmit_time, int channel, bool *missed = NULL);		
 };
 
 #endif
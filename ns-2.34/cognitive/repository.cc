@@ -5,6 +5,7 @@
 // Cross-Layer Repository to enable channel information sharing between MAC and routing protocols
 
 #include "repository.h"
+#include <mac/phy.h>
 
 /* ==========================================================================================*/
 /* TCL Hooks */
@@ -23,33 +24,138 @@ public:
 // Initializer
 /* ==========================================================================================*/
 Repository::Repository() {
-	// Set randomly the receiver channel for each node	
-	for (int i=0; i < MAX_NODES; i++) {
-		int channel = get_random_channel();
-		set_recv_channel(i, channel);
-		printf("[Repo] Node: %d Channel: %d\n", i, channel);
-		//repository_table[i].recv_channel = channel;
-	}
-	// Initialize each sending channel as NOT active for each node
-	for (int node = 0; node < MAX_NODES; node++)  {
-		for (int channel = 0; channel < MAX_CHANNELS; channel++) {
-			repository_table_sender[node][channel].active=false;
-			set_channel_free(node, channel);
+	recv_channel_ = NULL;
+	recv_if_ = NULL;
+	sender_active_ = NULL;
+	sender_time_ = NULL;
+	channel_free_ = NULL;
+	channel_time_ = NULL;
+	channel_reset_time_ = NULL;
+	pu_active_ = NULL;
+	repository_table_spectrum_data = NULL;
+	nnodes_ = 0;
+	nchannels_ = 0;
+	nwords_ = 0;
+	init_tables(MAX_NODES, MAX_CHANNELS);
+}
+
+Repository::~Repository() {
+	free_tables();
+}
+
+/* ==========================================================================================*/
+// init_tables: Allocate the tables for the given number of nodes and channels.
+// On a resize the entries of the nodes and channels kept are copied, with the
+// receiver channels and the registered radios.  The receiver channel of a
+// node is drawn at its first use (see recv_channel), so resizing does not
+// consume random numbers.
+/* ==========================================================================================*/
+void Repository::init_tables(int nodes, int channels) {
+	int words = (channels + CHANNEL_WORD_BITS - 1) / CHANNEL_WORD_BITS;
+	int keep_nodes = (nodes < nnodes_) ? nodes : nnodes_;
+	int keep_channels = (channels < nchannels_) ? channels : nchannels_;
+	
+	int *rchannel = new int[nodes];
+	Phy **recv_if = new Phy*[nodes];
+	channel_word *sender_active = new channel_word[nodes * words];
+	double *sender_time = new double[nodes * channels];
+	channel_word *channel_free = new channel_word[nodes * words];
+	double *channel_time = new double[nodes * channels];
+	double *channel_reset_time = new double[nodes];
+	unsigned int *pu_active = new unsigned int[nodes * channels];
+	repository_spectrum_data *spectrum_data = new repository_spectrum_data[channels];
+	
+	for (int node = 0; node < nodes; node++) {
+		bool kept = node < keep_nodes;
+		// Not drawn yet, or drawn among channels that are gone
+		rchannel[node] = -1;
+		if (kept && recv_channel_[node] < channels)
+			rchannel[node] = recv_channel_[node];
+		recv_if[node] = kept ? recv_if_[node] : NULL;
+		channel_reset_time[node] = kept ? channel_reset_time_[node] : 0.0;
+		for (int w = 0; w < words; w++) {
+			sender_active[node*words + w] = 0;
+			channel_free[node*words + w] = 0;
+		}
+		for (int channel = 0; channel < channels; channel++) {
+			channel_word bit = (channel_word)1 << (channel%CHANNEL_WORD_BITS);
+			bool free = true;
+			sender_time[node*channels + channel] = 0.0;
+			channel_time[node*channels + channel] = 0.0;
+			pu_active[node*channels + channel] = 0;
+			if (kept && channel < keep_channels) {
+				int old = node*nwords_ + channel/CHANNEL_WORD_BITS;
+				if (sender_active_[old] & bit)
+					sender_active[node*words + channel/CHANNEL_WORD_BITS] |= bit;
+				free = (channel_free_[old] & bit) != 0;
+				sender_time[node*channels + channel] = sender_time_[node*nchannels_ + channel];
+				channel_time[node*channels + channel] = channel_time_[node*nchannels_ + channel];
+				pu_active[node*channels + channel] = pu_active_[node*nchannels_ + channel];
+			}
+			if (free)
+				channel_free[node*words + channel/CHANNEL_WORD_BITS] |= bit;
 		}
 	}
-	for (int channel = 0; channel < MAX_CHANNELS; channel++) {
-		repository_table_spectrum_data[channel].bandwidth = 0.0;
-		repository_table_spectrum_data[channel].frequency = 0.0;
-		repository_table_spectrum_data[channel].per = 0.0;
+	for (int channel = 0; channel < channels; channel++) {
+		if (channel < keep_channels) {
+			spectrum_data[channel] = repository_table_spectrum_data[channel];
+			continue;
+		}
+		spectrum_data[channel].bandwidth = 0.0;
+		spectrum_data[channel].frequency = 0.0;
+		spectrum_data[channel].per = 0.0;
 	}
+	
+	free_tables();
+	nnodes_ = nodes;
+	nchannels_ = channels;
+	nwords_ = words;
+	recv_channel_ = rchannel;
+	recv_if_ = recv_if;
+	sender_active_ = sender_active;
+	sender_time_ = sender_time;
+	channel_free_ = channel_free;
+	channel_time_ = channel_time;
+	channel_reset_time_ = channel_reset_time;
+	pu_active_ = pu_active;
+	repository_table_spectrum_data = spectrum_data;
+	
+	// Radios left on a channel that is gone get a new one
+	for (int node = 0; node < keep_nodes; node++)
+		if (recv_channel_[node] < 0 && recv_if_[node])
+			recv_if_[node]->tune(recv_channel(node));
+}
+
+/* ==========================================================================================*/
+// free_tables: Release the tables
+/* ==========================================================================================*/
+void Repository::free_tables() {
+	delete [] recv_channel_;
+	delete [] recv_if_;
+	delete [] sender_active_;
+	delete [] sender_time_;
+	delete [] channel_free_;
+	delete [] channel_time_;
+	delete [] channel_reset_time_;
+	delete [] pu_active_;
+	delete [] repository_table_spectrum_data;
+	recv_channel_ = NULL;
+	recv_if_ = NULL;
+	sender_active_ = NULL;
+	sender_time_ = NULL;
+	channel_free_ = NULL;
+	channel_time_ = NULL;
+	channel_reset_time_ = NULL;
+	pu_active_ = NULL;
+	repository_table_spectrum_data = NULL;
 }
 
 /* ==========================================================================================*/
 //get_recv_channel: Return the receiving channel for a node
 /* ==========================================================================================*/
 int Repository::get_recv_channel(int node) {
-	if (node < MAX_NODES) {
-		return repository_table[node].recv_channel;
+	if (node < nnodes_) {
+		return recv_channel(node);
 	}
 	else
 		return -1;
@@ -59,17 +165,41 @@ int Repository::get_recv_channel(int node) {
 //set_recv_channel: Set the receiving channel for a node
 /* ==========================================================================================*/
 void Repository::set_recv_channel(int node, int channel) {
-	if (node < MAX_NODES)
-		repository_table[node].recv_channel=channel;
+	if (node < nnodes_) {
+		recv_channel_[node]=channel;
+		if (recv_if_[node])
+			recv_if_[node]->tune(channel);
+	}
+}
+
+/* ==========================================================================================*/
+//recv_channel: Receiving channel of a node, set randomly at its first use
+/* ==========================================================================================*/
+int Repository::recv_channel(int node) {
+	if (recv_channel_[node] < 0) {
+		recv_channel_[node] = get_random_channel();
+		printf("[Repo] Node: %d Channel: %d\n", node, recv_channel_[node]);
+	}
+	return recv_channel_[node];
+}
+
+/* ==========================================================================================*/
+//set_recv_interface: Register the receiver radio of a node
+/* ==========================================================================================*/
+void Repository::set_recv_interface(int node, Phy *netif) {
+	if (node < nnodes_) {
+		recv_if_[node]=netif;
+		netif->tune(recv_channel(node));
+	}
 }
 
 /* ==========================================================================================*/
 // update_send_channel: Set the sending channel as active, at the current time
 /* ==========================================================================================*/
 void Repository::update_send_channel(int node, int channel, double time) {
-	if (node < MAX_NODES)  {
-		repository_table_sender[node][channel].active=true;
-		repository_table_sender[node][channel].time=time;
+	if (node < nnodes_)  {
+		sender_active_[node*nwords_ + channel/CHANNEL_WORD_BITS] |= (channel_word)1 << (channel%CHANNEL_WORD_BITS);
+		sender_time_[node*nchannels_ + channel]=time;
 	 }
 }
 		 
@@ -77,20 +207,22 @@ void Repository::update_send_channel(int node, int channel, double time) {
 //is_channel_used_for_sending: Check wheter a given sending channel is active for a given node
 /* ==========================================================================================*/
 bool Repository::is_channel_used_for_sending(int node, int channel, double timeNow) {
-	if (repository_table_sender[node][channel].active) {
-		if (timeNow - repository_table_sender[node][channel].time > TIMEOUT_ALIVE)
-			repository_table_sender[node][channel].active=false;
+	channel_word *word = &sender_active_[node*nwords_ + channel/CHANNEL_WORD_BITS];
+	channel_word bit = (channel_word)1 << (channel%CHANNEL_WORD_BITS);
+	if (*word & bit) {
+		if (timeNow - sender_time_[node*nchannels_ + channel] > TIMEOUT_ALIVE)
+			*word &= ~bit;
 	}
-	return repository_table_sender[node][channel].active;
+	return (*word & bit) != 0;
 }
 
 /* ==========================================================================================*/
-//get_random_channel: Return a random channel between 1 and MAX_CHANNELS
+//get_random_channel: Return a random channel between 1 and the number of channels
 /* ==========================================================================================*/
 int Repository::get_random_channel() {
-	int channel=((int)(Random::uniform()*MAX_CHANNELS))+1;		
-	if (channel >= MAX_CHANNELS)
-		channel = MAX_CHANNELS-1;
+	int channel=((int)(Random::uniform()*nchannels_))+1;		
+	if (channel >= nchannels_)
+		channel = nchannels_-1;
 	return channel;
 }
 
@@ -99,10 +231,8 @@ int Repository::get_random_channel() {
 //set_channel_free: Set the channel for a node as free
 /* ==========================================================================================*/
 void Repository::set_channel_free(int node, int channel) {
-	repository_table_channel[node][channel].free = true; // 1: free
-	repository_table_channel[node][channel].time = Scheduler::instance().clock();
-	//printf("[Repo] Node:%d CH:%d T:%f Free:%s %s\n", node, channel, Scheduler::instance().clock(),"set_true",repository_table_channel[node][channel].free?"true":"false");
-					
+	channel_free_[node*nwords_ + channel/CHANNEL_WORD_BITS] |= (channel_word)1 << (channel%CHANNEL_WORD_BITS);
+	channel_time_[node*nchannels_ + channel] = Scheduler::instance().clock();
 }
 /* ==========================================================================================*/
 
@@ -110,40 +240,84 @@ void Repository::set_channel_free(int node, int channel) {
 //set_channel_busy: Set the channel for a node as busy
 /* ==========================================================================================*/
 void Repository::set_channel_busy(int node, int channel) {
-	repository_table_channel[node][channel].free = false; // 0: busy
-	repository_table_channel[node][channel].time = Scheduler::instance().clock();
-	//printf("[Repo] Node:%d CH:%d T:%f Free:%s %s\n", node, channel, Scheduler::instance().clock(),"set_false",repository_table_channel[node][channel].free?"true":"false");
-	
+	channel_free_[node*nwords_ + channel/CHANNEL_WORD_BITS] &= ~((channel_word)1 << (channel%CHANNEL_WORD_BITS));
+	channel_time_[node*nchannels_ + channel] = Scheduler::instance().clock();
 }
 /* ==========================================================================================*/
 
+/* ==========================================================================================*/
+//set_all_channels_free: Set all the channels for a node as free. 
+// With up to CHANNEL_WORD_BITS channels this is a single word write
+/* ==========================================================================================*/
+void Repository::set_all_channels_free(int node) {
+	channel_word *word = &channel_free_[node*nwords_];
+	for (int w = 0; w < nwords_ - 1; w++)
+		word[w] = ~(channel_word)0;
+	int last = nchannels_ - (nwords_ - 1) * CHANNEL_WORD_BITS;
+	word[nwords_ - 1] = (last == CHANNEL_WORD_BITS) ? ~(channel_word)0 : ((channel_word)1 << last) - 1;
+	channel_reset_time_[node] = Scheduler::instance().clock();
+}
+/* ==========================================================================================*/
 
 bool Repository::is_channel_free(int node, int channel) {
-	//printf("Repository::is_channel_free CH: %d \n", channel);
-	/*if ( (repository_table_channel[node][channel].free) && 
-	  (Scheduler::instance().clock() - repository_table_channel[node][channel].time > REPOSITORY_DATA_VALID)) {
-		repository_table_channel[node][channel].free = false;
-	}*/
-	//printf("[Repo] Node:%d CH:%d T:%f Free:%s\n", node, channel, Scheduler::instance().clock(),repository_table_channel[node][channel].free?"true":"false");
-	return repository_table_channel[node][channel].free;
+	return (channel_free_[node*nwords_ + channel/CHANNEL_WORD_BITS] >> (channel%CHANNEL_WORD_BITS)) & 1;
  }
 
+/* ==========================================================================================*/
+//get_channel_time: Return the last time the state of the channel was set for a node
+/* ==========================================================================================*/
+double Repository::get_channel_time(int node, int channel) {
+	double time = channel_time_[node*nchannels_ + channel];
+	if (channel_reset_time_[node] > time)
+		return channel_reset_time_[node];
+	return time;
+}
+
+/* ==========================================================================================*/
+//add_pu_activity: A PU in range of the node became active on the channel
+/* ==========================================================================================*/
+void Repository::add_pu_activity(int node, int channel) {
+	if (node >= nnodes_ || channel < 0 || channel >= nchannels_)
+		return;
+	if (pu_active_[node*nchannels_ + channel]++ == 0)
+		set_channel_busy(node, channel);
+}
+
+/* ==========================================================================================*/
+//remove_pu_activity: A PU in range of the node became inactive on the channel
+/* ==========================================================================================*/
+void Repository::remove_pu_activity(int node, int channel) {
+	if (node >= nnodes_ || channel < 0 || channel >= nchannels_)
+		return;
+	if (--pu_active_[node*nchannels_ + channel] == 0)
+		set_channel_free(node, channel);
+}
+
+/* ==========================================================================================*/
+//is_pu_active: Check whether a PU in range of the node is active on the channel
+/* ==========================================================================================*/
+bool Repository::is_pu_active(int node, int channel) {
+	if (node >= nnodes_ || channel < 0 || channel >= nchannels_)
+		return false;
+	return pu_active_[node*nchannels_ + channel] > 0;
+}
+
 double Repository::get_channel_bandwidth(int channel){
-	if ((channel >= 0 ) && (channel < MAX_CHANNELS))
+	if ((channel >= 0 ) && (channel < nchannels_))
 		  return (repository_table_spectrum_data[channel].bandwidth);
 	else 
 		 return -1;
 }
 
 double Repository::get_channel_frequency(int channel) {
-	if ((channel >= 0 ) && (channel < MAX_CHANNELS))
+	if ((channel >= 0 ) && (channel < nchannels_))
 		return (repository_table_spectrum_data[channel].frequency);
 	else 
 		 return -1;
 }
 
 double Repository::get_channel_per(int channel) {
-	if ((channel >= 0 ) && (channel < MAX_CHANNELS))
+	if ((channel >= 0 ) && (channel < nchannels_))
 		return repository_table_spectrum_data[channel].per;
 	else 
 		 return -1;	
@@ -162,6 +336,21 @@ int Repository::command(int argc, const char*const* argv) {
 		    read_spectrum_file((char*)argv[2]);
    		    return TCL_OK;
 		}
+		// Resize the tables, keeping the entries of the nodes and channels left
+		else if(strcmp(argv[1], "set_nodes") == 0) {
+		    int nodes = atoi(argv[2]);
+		    if (nodes <= 0)
+			return TCL_ERROR;
+		    init_tables(nodes, nchannels_);
+   		    return TCL_OK;
+		}
+		else if(strcmp(argv[1], "set_channels") == 0) {
+		    int channels = atoi(argv[2]);
+		    if (channels <= CONTROL_CHANNEL + 1)
+			return TCL_ERROR;
+		    init_tables(nnodes_, channels);
+   		    return TCL_OK;
+		}
 	} 
 	return TCL_OK;
 }
@@ -179,23 +368,22 @@ void Repository::read_spectrum_file(char *fileName) {
 		printf(" ERROR. Can't open file %s \n",fileName);
 		exit(0);
 	}
-	// For each channel in the range [0: MAX_CHANNELS] the spectrum file contains these entries:
+	// For each channel in the range [0: nchannels_] the spectrum file contains these entries:
 	// bandwidth (b/s) and packet error rate 
-	for (int i=0; i<MAX_CHANNELS; i++)  {
+	for (int i=0; i<nchannels_; i++)  {
 		int channel;
 		float bandwidth;
 		float frequency;
 		float per;
 		// read the next entry
-		fscanf(fd,"%d %f %f %f", &channel, &bandwidth, &frequency, &per);
-		if (ferror(fd)) {
-			printf(" ERROR. Can't read Spectrum Information from file %s \n", fileName);		
+		if (fscanf(fd,"%d %f %f %f", &channel, &bandwidth, &frequency, &per) != 4) {
+			printf(" ERROR. Can't read Spectrum Information for %d channels from file %s \n", nchannels_, fileName);		
 			exit(0);
 		}
 		if (IO_SPECTRUM_DEBUG)
 			printf("[READING SPECTRUM FILE] #CHANNEL: %d #BANDWIDTH: %f FRQ: %f PER: %f\n",channel, bandwidth, frequency, per); 
 		// save the information in the repository_table_spectrum_data
-		if(channel >= 0 && channel < MAX_CHANNELS ) {
+		if(channel >= 0 && channel < nchannels_ ) {
 			repository_table_spectrum_data[channel].bandwidth = bandwidth;
 			repository_table_spectrum_data[channel].frequency = frequency;
 			repository_table_spectrum_data[channel].per = per;
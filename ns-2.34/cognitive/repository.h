@@ -7,12 +7,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <random.h>
 #include "object.h"
 #include <common/mobilenode.h>
 
+class Phy;
 
-// Max number of nodes in the simulation
+
+// Default number of nodes in the simulation (set_nodes from OTcl to change it)
 #define MAX_NODES	200
 
 // Defines the time a node spends on each queue
@@ -33,29 +36,18 @@
 
 // Channe/Radio Information 
 #define MAX_RADIO	3
+// Default number of channels (set_channels from OTcl to change it)
 #define	MAX_CHANNELS 	11
 #define CONTROL_CHANNEL 0
 
+// Channel bitsets: one bit per channel, CHANNEL_WORD_BITS channels per word
+typedef uint64_t channel_word;
+#define CHANNEL_WORD_BITS	64
+
 //#define SENSING_VERBOSE_MODE
 
 #define IO_SPECTRUM_DEBUG 1
 
-// Channel Entry for receiver nodes
-struct repository_entry_recv {
-	int recv_channel;	// receiving channel
-};
-
-// Channel Entry for sender nodes
-struct repository_entry_send {
-	bool active;		//Flag indicating wheter the channel is used for transmitting
-	double time;		//Last time the channel was used
-};
-
-struct repository_channel {
-	bool free; 		//Flag indicating wheter the channel is free or not -- 1:free, 0:busy, others:data not valid
-	double time;		//Last time the channel was used
-};
-
 // Added by Deepti --Start
 // Spectrum Entry Information
 struct repository_spectrum_data  {
@@ -70,18 +62,34 @@ class Repository : public NsObject {
         public:
 		 // Initializer
                  Repository();
+                 ~Repository();
                  int command(int argc, const char*const* argv);
                  void recv(Packet*, Handler*);
 		  
 		 // Set/Get Function for the Receiver Channel Table
 		 int get_recv_channel(int node);
 		 void set_recv_channel(int node, int channel);
+		 // Register the receiver radio of a node, tuned to the receiving channel of the node
+		 void set_recv_interface(int node, Phy *netif);
 		 
 		 // Added by Deepti on 25 Oct 2013 -- start 
 		 void set_channel_busy(int node, int channel);
 		 void set_channel_free(int node, int channel);
 		 bool is_channel_free(int node, int channel);
 		 // Added by Deepti on 25 Oct 2013 -- end
+		 // Set all the channels for a node as free
+		 void set_all_channels_free(int node);
+		 // Last time the channel state of a node was set
+		 double get_channel_time(int node, int channel);
+		 // Count a PU becoming active/inactive in range of a node: the channel is busy while the count is not zero
+		 void add_pu_activity(int node, int channel);
+		 void remove_pu_activity(int node, int channel);
+		 // A PU in range of the node is active on the channel, whatever the node sensed
+		 bool is_pu_active(int node, int channel);
+		 
+		 // Number of nodes and channels of the tables
+		 inline int get_number_nodes() { return nnodes_; }
+		 inline int get_number_channels() { return nchannels_; }
 		 
 		 // Added by Deepti --Start
 		 double get_channel_bandwidth(int channel);
@@ -93,18 +101,40 @@ class Repository : public NsObject {
 		 void update_send_channel(int node, int channel, double time);
 		 bool is_channel_used_for_sending(int node, int channel, double timeNow);
 	private:
-		// Receiver Channel table: repository_table[i] contains the channels used for receiving by node i
-		repository_entry_recv repository_table[MAX_NODES];
-		// Sender Channel table: repository_table_sender[i][j] contains the information (active/time) for sending node i and channel j
-		repository_entry_send repository_table_sender[MAX_NODES][MAX_CHANNELS];
+		int nnodes_;		// Number of nodes in the tables
+		int nchannels_;		// Number of channels in the tables
+		int nwords_;		// Words of a per-node channel bitset
+		
+		// Receiver Channel table: recv_channel_[i] contains the channel used for receiving by node i,
+		// -1 until it is drawn
+		int *recv_channel_;
+		// Receiver radio of node i, retuned when recv_channel_[i] changes
+		Phy **recv_if_;
+		// Sender Channel table: bit j of sender_active_[i] is set if node i is sending on channel j, 
+		// sender_time_[i*nchannels_+j] is the last time node i used channel j
+		channel_word *sender_active_;
+		double *sender_time_;
+		
+		// Channel state table: bit j of channel_free_[i] is set if channel j is free for node i,
+		// channel_time_[i*nchannels_+j] is the last time the state was set.
+		// channel_reset_time_[i] is the last time all the channels of node i were set free
+		channel_word *channel_free_;
+		double *channel_time_;
+		double *channel_reset_time_;
+		// Event-driven PU model: pu_active_[i*nchannels_+j] is the number of active PUs in range of node i on channel j
+		unsigned int *pu_active_;
 		
-		// Added by Deepti on 25 Oct 2013
-		repository_channel repository_table_channel[MAX_NODES][MAX_CHANNELS]; // 0:busy & 1:free & others:data not valid
+		repository_spectrum_data *repository_table_spectrum_data; // Added by Deepti 
 		
-		repository_spectrum_data repository_table_spectrum_data[MAX_CHANNELS]; // Added by Deepti 
+		// Allocate and initialize the tables for the given number of nodes and channels
+		void init_tables(int nodes, int channels);
+		// Release the tables
+		void free_tables();
 		
-		// Returns a random channel between 1 and MAX_CHANNELS
+		// Returns a random channel between 1 and the number of channels
 		int get_random_channel();
+		// Receiving channel of a node, drawn at its first use
+		int recv_channel(int node);
 		
 		// read the current spectrum file, and load the information in the repository_table_spectrum_data
 		void read_spectrum_file(char *fileName);		
@@ -0,0 +1,415 @@
+/* -*-	Mode:C++; c-basic-offset:8; tab-width:8; indent-tabs-mode:t -*- */
+/*
+ * Checkpoint and restore of a running simulation.
+ *
+ * "ns-checkpoint file" keeps a copy of the whole process, as it is at
+ * that point of the run, in a server forked in the background that
+ * listens on the unix socket "file" (only the user may connect: a copy
+ * evaluates any script it is given).  "ns-restore file script ?dir?"
+ * (from any other ns) makes the server fork a copy which takes the
+ * stdin, stdout and stderr of the caller, evaluates script and goes on
+ * with the run from the checkpoint; ns-restore returns its exit status.
+ * "ns-checkpoint-drop file" stops the server.
+ *
+ * The copy writes its own output in the directory dir (restore.<pid of
+ * the caller> by default) of the working directory of the caller: the
+ * trace files open at the checkpoint are replaced there by copies of
+ * what they held (see Scheduler::own_output).
+ *
+ * The copy holds the scheduler queue, packets, nodes, RNG streams and
+ * every other object as they were, so nothing needs to be serialized;
+ * the objects declared non-checkpointable are refused on the Tcl side
+ * (see Simulator instproc checkpoint).
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include "config.h"
+#include "scheduler.h"
+
+#ifndef WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define CHECKPOINT_RESTORE	1
+#define CHECKPOINT_DROP		2
+
+// Descriptors sent with a request: stdin, stdout, stderr and the
+// working directory of the client
+#define CHECKPOINT_NFDS		4
+
+struct checkpoint_request {
+	int32_t op_;
+	int32_t len_;		// of the script that follows
+	int32_t dirlen_;	// of the output directory after it
+};
+
+static int
+checkpoint_address(const char* file, struct sockaddr_un* sa)
+{
+	if (strlen(file) >= sizeof(sa->sun_path)) {
+		Tcl::instance().resultf("%s: name too long for a socket", file);
+		return (-1);
+	}
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	strcpy(sa->sun_path, file);
+	return (0);
+}
+
+static int
+checkpoint_connect(const char* file)
+{
+	struct sockaddr_un sa;
+	if (checkpoint_address(file, &sa) < 0)
+		return (-1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+		Tcl::instance().resultf("%s: no checkpoint (%s)", file,
+					strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+static int
+read_all(int fd, void* buf, int n)
+{
+	char* p = (char*)buf;
+	while (n > 0) {
+		int k = read(fd, p, n);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0)
+			return (-1);
+		p += k;
+		n -= k;
+	}
+	return (0);
+}
+
+static int
+write_all(int fd, const void* buf, int n)
+{
+	const char* p = (const char*)buf;
+	while (n > 0) {
+		int k = write(fd, p, n);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0)
+			return (-1);
+		p += k;
+		n -= k;
+	}
+	return (0);
+}
+
+// Sends r with our stdin, stdout, stderr and working directory
+static int
+send_request(int fd, checkpoint_request* r)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	char cbuf[CMSG_SPACE(CHECKPOINT_NFDS * sizeof(int))];
+	int fds[CHECKPOINT_NFDS] = { 0, 1, 2, -1 };
+
+	if ((fds[3] = open(".", O_RDONLY)) < 0)
+		return (-1);
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (char*)r;
+	iov.iov_len = sizeof(*r);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+	int st = (sendmsg(fd, &msg, 0) == (ssize_t)sizeof(*r) ? 0 : -1);
+	close(fds[3]);
+	return (st);
+}
+
+// Receives a request, and the descriptors of the client in fds
+static int
+recv_request(int fd, checkpoint_request* r, int* fds)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	char cbuf[CMSG_SPACE(CHECKPOINT_NFDS * sizeof(int))];
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (char*)r;
+	iov.iov_len = sizeof(*r);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	if (recvmsg(fd, &msg, 0) != (ssize_t)sizeof(*r))
+		return (-1);
+	for (int k = 0; k < CHECKPOINT_NFDS; k++)
+		fds[k] = -1;
+	struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+	if (cm != 0 && cm->cmsg_level == SOL_SOCKET &&
+	    cm->cmsg_type == SCM_RIGHTS &&
+	    cm->cmsg_len == CMSG_LEN(CHECKPOINT_NFDS * sizeof(int)))
+		memcpy(fds, CMSG_DATA(cm), CHECKPOINT_NFDS * sizeof(int));
+	return (0);
+}
+
+/*
+ * Server of a checkpoint: serves requests until dropped.  Returns only
+ * in a restored copy, with its script in *script.
+ */
+static void
+checkpoint_serve(int lfd, const char* file, char** script)
+{
+	setsid();
+	signal(SIGPIPE, SIG_IGN);
+	// or a pipe to the original ns would stay open
+	int null = open("/dev/null", O_RDWR);
+	if (null >= 0) {
+		dup2(null, 0);
+		dup2(null, 1);
+		dup2(null, 2);
+		close(null);
+	}
+	for (;;) {
+		while (waitpid(-1, 0, WNOHANG) > 0)
+			;
+		int c = accept(lfd, 0, 0);
+		if (c < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		checkpoint_request r;
+		int fds[CHECKPOINT_NFDS], k;
+		if (recv_request(c, &r, fds) < 0) {
+			close(c);
+			continue;
+		}
+		if (r.op_ == CHECKPOINT_DROP) {
+			close(c);
+			break;
+		}
+		char* s = 0;
+		char* dir = 0;
+		if (r.op_ == CHECKPOINT_RESTORE && r.len_ >= 0 &&
+		    r.dirlen_ > 0 && fds[CHECKPOINT_NFDS - 1] >= 0) {
+			s = new char[r.len_ + 1];
+			dir = new char[r.dirlen_ + 1];
+			if (read_all(c, s, r.len_) < 0 ||
+			    read_all(c, dir, r.dirlen_) < 0) {
+				delete [] s;
+				s = 0;
+			} else {
+				s[r.len_] = 0;
+				dir[r.dirlen_] = 0;
+			}
+		}
+		// one waiter per copy reports its exit status to the client
+		if (s != 0 && fork() == 0) {
+			close(lfd);
+			pid_t pid = fork();
+			if (pid == 0) {
+				for (k = 0; k < 3; k++) {
+					dup2(fds[k], k);
+					close(fds[k]);
+				}
+				close(c);
+				signal(SIGPIPE, SIG_DFL);
+				if (fchdir(fds[3]) < 0 ||
+				    Scheduler::own_output(dir) < 0) {
+					perror("ns-restore: output");
+					exit(1);
+				}
+				close(fds[3]);
+				delete [] dir;
+				*script = s;
+				return;
+			}
+			int st, status = -1;
+			while (pid > 0 && waitpid(pid, &st, 0) < 0 &&
+			       errno == EINTR)
+				;
+			if (pid > 0)
+				status = WIFEXITED(st) ? WEXITSTATUS(st) :
+					128 + WTERMSIG(st);
+			int32_t code = status;
+			write_all(c, &code, sizeof(code));
+			_exit(0);
+		}
+		delete [] s;
+		delete [] dir;
+		for (k = 0; k < CHECKPOINT_NFDS; k++)
+			if (fds[k] >= 0)
+				close(fds[k]);
+		close(c);
+	}
+	close(lfd);
+	unlink(file);
+	_exit(0);
+}
+
+class CheckpointCommand : public TclCommand {
+public:
+	CheckpointCommand() : TclCommand("ns-checkpoint") {}
+	virtual int command(int argc, const char*const* argv);
+};
+
+/*
+ * ns-checkpoint file: returns 0 in the original ns, 1 in a restored
+ * copy, once its script is evaluated.
+ */
+int CheckpointCommand::command(int argc, const char*const* argv)
+{
+	Tcl& tcl = Tcl::instance();
+	if (argc != 2) {
+		tcl.add_error("ns-checkpoint requires a file name.");
+		return (TCL_ERROR);
+	}
+	struct sockaddr_un sa;
+	if (checkpoint_address(argv[1], &sa) < 0)
+		return (TCL_ERROR);
+	// a previous checkpoint still served there is left alone
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (struct sockaddr*)&sa, sizeof(sa)) == 0) {
+		close(fd);
+		tcl.resultf("%s: checkpoint already served", argv[1]);
+		return (TCL_ERROR);
+	}
+	if (fd >= 0)
+		close(fd);
+	unlink(argv[1]);
+	int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	// the socket is created with mode 0600
+	mode_t mask = umask(0177);
+	int st = (lfd < 0 ? -1 : bind(lfd, (struct sockaddr*)&sa, sizeof(sa)));
+	umask(mask);
+	if (st < 0 || listen(lfd, 16) < 0) {
+		tcl.resultf("%s: %s", argv[1], strerror(errno));
+		if (lfd >= 0)
+			close(lfd);
+		return (TCL_ERROR);
+	}
+	fflush(NULL);
+	pid_t pid = fork();
+	if (pid < 0) {
+		tcl.resultf("ns-checkpoint: fork: %s", strerror(errno));
+		close(lfd);
+		unlink(argv[1]);
+		return (TCL_ERROR);
+	}
+	if (pid > 0) {
+		close(lfd);
+		tcl.result("0");
+		return (TCL_OK);
+	}
+	char* script = 0;
+	checkpoint_serve(lfd, argv[1], &script);
+	st = tcl.eval(script);
+	delete [] script;
+	if (st != TCL_OK)
+		return (st);
+	tcl.result("1");
+	return (TCL_OK);
+}
+
+class RestoreCommand : public TclCommand {
+public:
+	RestoreCommand() : TclCommand("ns-restore") {}
+	virtual int command(int argc, const char*const* argv);
+};
+
+/*
+ * ns-restore file script ?dir?: runs a copy of the checkpoint served at
+ * file, with its output in dir, returns its exit status.
+ */
+int RestoreCommand::command(int argc, const char*const* argv)
+{
+	Tcl& tcl = Tcl::instance();
+	if (argc != 3 && argc != 4) {
+		tcl.add_error("ns-restore requires a file name, a script and an optional directory.");
+		return (TCL_ERROR);
+	}
+	char dir[32];
+	if (argc == 3)
+		sprintf(dir, "restore.%d", (int)getpid());
+	const char* d = (argc == 4 ? argv[3] : dir);
+	if (*d == 0) {
+		tcl.add_error("ns-restore: empty output directory.");
+		return (TCL_ERROR);
+	}
+	int fd = checkpoint_connect(argv[1]);
+	if (fd < 0)
+		return (TCL_ERROR);
+	checkpoint_request r;
+	r.op_ = CHECKPOINT_RESTORE;
+	r.len_ = strlen(argv[2]);
+	r.dirlen_ = strlen(d);
+	fflush(NULL);
+	int32_t code;
+	if (send_request(fd, &r) < 0 || write_all(fd, argv[2], r.len_) < 0 ||
+	    write_all(fd, d, r.dirlen_) < 0 ||
+	    read_all(fd, &code, sizeof(code)) < 0) {
+		close(fd);
+		tcl.resultf("%s: checkpoint server failed", argv[1]);
+		return (TCL_ERROR);
+	}
+	close(fd);
+	tcl.resultf("%d", code);
+	return (TCL_OK);
+}
+
+class CheckpointDropCommand : public TclCommand {
+public:
+	CheckpointDropCommand() : TclCommand("ns-checkpoint-drop") {}
+	virtual int command(int argc, const char*const* argv);
+};
+
+int CheckpointDropCommand::command(int argc, const char*const* argv)
+{
+	Tcl& tcl = Tcl::instance();
+	if (argc != 2) {
+		tcl.add_error("ns-checkpoint-drop requires a file name.");
+		return (TCL_ERROR);
+	}
+	int fd = checkpoint_connect(argv[1]);
+	if (fd < 0)
+		return (TCL_ERROR);
+	checkpoint_request r;
+	r.op_ = CHECKPOINT_DROP;
+	r.len_ = 0;
+	r.dirlen_ = 0;
+	int st = send_request(fd, &r);
+	close(fd);
+	if (st < 0) {
+		tcl.resultf("%s: checkpoint server failed", argv[1]);
+		return (TCL_ERROR);
+	}
+	return (TCL_OK);
+}
+
+void init_checkpoint(void)
+{
+	(void)new CheckpointCommand;
+	(void)new RestoreCommand;
+	(void)new CheckpointDropCommand;
+}
+#else
+void init_checkpoint(void)
+{
+}
+#endif
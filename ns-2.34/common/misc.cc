@@ -225,6 +225,8 @@ public:
 	}
 };
 
+extern void init_checkpoint(void);
+
 void init_misc(void)
 {
 	(void)new VersionCommand;
@@ -232,6 +234,7 @@ void init_misc(void)
 	(void)new TimeAtofCommand;
 	(void)new HasInt64Command;
 	(void)new HasSTLCommand;
+	init_checkpoint();
 #if defined(HAVE_INT64)
 	(void)new Add64Command;
 	(void)new Mult64Command;
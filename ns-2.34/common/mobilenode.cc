@@ -129,6 +129,10 @@ MobileNode::MobileNode(void) :
 	log_target_ = 0;
 	next_ = 0;
 	radius_ = 0;
+	nextCell_ = prevCell_ = 0;
+	cell_ = -1;
+	topoIndex_ = -1;
+	channels_ = 0;
 
 	position_update_interval_ = MN_POSITION_UPDATE_INTERVAL;
 	position_update_time_ = 0.0;
@@ -262,6 +266,7 @@ MobileNode::command(int argc, const char*const* argv)
 			T_ = (Topography*) TclObject::lookup(argv[2]);
 			if (T_ == 0)
 				return TCL_ERROR;
+			T_->addNode(this);
 			return TCL_OK;
 		} else if(strcmp(argv[1], "log-target") == 0) {
 			log_target_ = (Trace*) TclObject::lookup(argv[2]);
@@ -426,6 +431,7 @@ MobileNode::set_destination(double x, double y, double s)
 	destX_ = x;
 	destY_ = y;
 	speed_ = s;
+	T_->updateSpeed(s);
 	
 	dX_ = destX_ - X_;
 	dY_ = destY_ - Y_;
@@ -478,7 +484,7 @@ MobileNode::update_position()
 	double now = Scheduler::instance().clock();
 	double interval = now - position_update_time_;
 	double oldX = X_;
-	//double oldY = Y_;
+	double oldY = Y_;
 
 	if ((interval == 0.0)&&(position_update_time_!=0))
 		return;         // ^^^ for list-based imprvmnt 
@@ -494,8 +500,8 @@ MobileNode::update_position()
 	  Y_ = destY_;		// correct overshoot (slow? XXX)
 	
 	/* list based improvement */
-	if(oldX != X_)// || oldY != Y_)
-		T_->updateNodesList(this, oldX);//, oldY);
+	if(oldX != X_ || oldY != Y_)
+		T_->updateNodesList(this);
 	// COMMENTED BY -VAL- // bound_position();
 
 	// COMMENTED BY -VAL- // Z_ = T_->height(X_, Y_);
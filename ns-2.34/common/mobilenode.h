@@ -130,6 +130,7 @@ private:
 class MobileNode : public Node 
 {
 	friend class PositionHandler;
+	friend class MobilityLoader;	// replays the legs of a scenario file
 public:
 	MobileNode();
 	virtual int command(int argc, const char*const* argv);
@@ -169,11 +170,14 @@ public:
 	//void logrttime(double);
 	virtual void idle_energy_patch(float, float);
 
-	/* For list-keeper */
-	//MobileNode* nextX_;
-	//MobileNode* prevX_;
-	MobileNode* nextX_[MAX_CHANNELS];
-	MobileNode* prevX_[MAX_CHANNELS];
+	inline Topography* topography() { return T_; }
+
+	/* For list-keeper: grid cell of the node in the Topography */
+	MobileNode* nextCell_;
+	MobileNode* prevCell_;
+	int cell_;
+	int topoIndex_;		// in the nodes of the Topography, -1 if none
+	uint64_t channels_;	// bit i: listening to channel of index i
 	//repository_spectrum_data repository_table_spectrum_data[MAX_CHANNELS]; // Added by Deepti 	
 	
 protected:
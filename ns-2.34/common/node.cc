@@ -96,6 +96,8 @@ public:
 } class_node;
 
 struct node_head Node::nodehead_ = { 0 }; // replaces LIST_INIT macro
+Tcl_HashTable Node::addrtable_;
+int Node::addrtable_init_ = 0;
 
 char Node::nwrk_[NODE_NAMLOG_BUFSZ];
 
@@ -133,6 +135,7 @@ Node::Node() :
 Node::~Node()
 {
 	LIST_REMOVE(this, entry);
+	unindex_address();
 }
 
 int
@@ -175,7 +178,7 @@ Node::command(int argc, const char*const* argv)
 			return(TCL_OK);
 		}
 		if (strcmp(argv[1], "addr") == 0) {
-			address_ = Address::instance().str2addr(argv[2]);
+			index_address(Address::instance().str2addr(argv[2]));
 #ifdef HAVE_STL
 			if (nixnode_) {
 				nixnode_->Id(address_);
@@ -311,14 +314,48 @@ NsObject* Node::intf_to_target(int32_t label)
 	return NULL;
 }
 
-// A class static method. Return the node instance from the static node list
+// A class static method. Return the node instance from the static node list,
+// looked up in the address index
 Node* Node::get_node_by_address (nsaddr_t id)
 {
-	Node * tnode = nodehead_.lh_first;
-	for (; tnode; tnode = tnode->nextnode()) {
-		if (tnode->address_ == id ) {
-			return (tnode);
+	if (!addrtable_init_)
+		return NULL;
+	Tcl_HashEntry *he = Tcl_FindHashEntry(&addrtable_, (char *)(long)id);
+	if (he == NULL)
+		return NULL;
+	return (Node *)Tcl_GetHashValue(he);
+}
+
+// Set the node address and enter the node in the address index
+void Node::index_address(int addr)
+{
+	int newEntry;
+	unindex_address();
+	address_ = addr;
+	if (!addrtable_init_) {
+		Tcl_InitHashTable(&addrtable_, TCL_ONE_WORD_KEYS);
+		addrtable_init_ = 1;
+	}
+	Tcl_HashEntry *he = Tcl_CreateHashEntry(&addrtable_, (char *)(long)addr, &newEntry);
+	Tcl_SetHashValue(he, (ClientData)this);
+}
+
+// Remove the node from the address index. If another node shares the
+// address, it takes over the entry, as in a walk of the node list.
+void Node::unindex_address()
+{
+	if (!addrtable_init_ || address_ == -1)
+		return;
+	Tcl_HashEntry *he = Tcl_FindHashEntry(&addrtable_, (char *)(long)address_);
+	if (he == NULL || Tcl_GetHashValue(he) != (ClientData)this)
+		return;
+	Tcl_DeleteHashEntry(he);
+	for (Node *tnode = nodehead_.lh_first; tnode; tnode = tnode->nextnode()) {
+		if (tnode != this && tnode->address_ == address_) {
+			int newEntry;
+			he = Tcl_CreateHashEntry(&addrtable_, (char *)(long)address_, &newEntry);
+			Tcl_SetHashValue(he, (ClientData)tnode);
+			break;
 		}
 	}
-	return NULL;
 }
@@ -167,6 +167,11 @@ public:
 protected:
 	LIST_ENTRY(Node) entry;  // declare list entry structure
 	int address_;
+	// Index of the static list of nodes by address, for get_node_by_address
+	static Tcl_HashTable addrtable_;
+	static int addrtable_init_;
+	void index_address(int addr);
+	void unindex_address();
 	int nodeid_; 		 // for nam use
 
 	// Nam tracing facility
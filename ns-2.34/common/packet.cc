@@ -59,6 +59,140 @@ int p_info::addPacket(char *name)
 
 int Packet::hdrlen_ = 0;		// size of a packet's header
 Packet* Packet::free_;			// free list
+PacketPool Packet::pool_;
+uint64_t* Packet::hdrmask_;
+int Packet::hdrmasklen_ = -1;
+int Packet::hdrchunk_;
+int Packet::slabhdrlen_;
+
+/*
+ * Headers with an offset, for the dirty chunk masks of Packet::access()
+ */
+static struct hdr_region {
+	int* offp_;
+	int off_;
+	int len_;
+} *hdr_regions;
+static int nhdr_regions;
+static int maxhdr_regions;
+
+void Packet::register_header(int* offp, int off, int len)
+{
+	int i;
+	for (i = 0; i < nhdr_regions; i++)
+		if (hdr_regions[i].offp_ == offp)
+			break;
+	if (i == maxhdr_regions) {
+		maxhdr_regions = maxhdr_regions ? 2 * maxhdr_regions : 64;
+		hdr_region* r = new hdr_region[maxhdr_regions];
+		for (int j = 0; j < nhdr_regions; j++)
+			r[j] = hdr_regions[j];
+		delete [] hdr_regions;
+		hdr_regions = r;
+	}
+	if (i == nhdr_regions)
+		nhdr_regions++;
+	hdr_regions[i].offp_ = offp;
+	hdr_regions[i].off_ = off;
+	hdr_regions[i].len_ = len;
+	hdrmasklen_ = -1;	// recompute the masks on the next alloc()
+}
+
+/*
+ * Compute the chunks of each header, once the offsets are known.
+ * Bytes out of the registered headers dirty all the chunks.
+ */
+void Packet::hdrlayout()
+{
+	int ngran = (hdrlen_ + 7) >> 3;
+	hdrchunk_ = (((hdrlen_ + PACKET_CHUNKS - 1) / PACKET_CHUNKS) + 7) & ~7;
+	if (hdrchunk_ == 0)
+		hdrchunk_ = 8;
+	delete [] hdrmask_;
+	hdrmask_ = new uint64_t[ngran > 0 ? ngran : 1];
+	for (int g = 0; g < ngran; g++)
+		hdrmask_[g] = ~(uint64_t)0;
+	for (int i = 0; i < nhdr_regions; i++) {
+		int off = hdr_regions[i].off_;
+		int end = off + hdr_regions[i].len_;
+		if (off < 0 || end > hdrlen_ || end <= off)
+			continue;
+		uint64_t m = 0;
+		for (int c = off / hdrchunk_; c <= (end - 1) / hdrchunk_; c++)
+			m |= (uint64_t)1 << c;
+		for (int g = off >> 3; g < ((end + 7) >> 3); g++)
+			hdrmask_[g] = m;
+	}
+	// the free packets have bits_[] of the old size
+	if (slabhdrlen_ != hdrlen_)
+		free_ = 0;
+	hdrmasklen_ = hdrlen_;
+}
+
+void Packet::clearhdrs(unsigned char* bits, uint64_t dirty)
+{
+	for (int c = 0; c < PACKET_CHUNKS && dirty >> c; ) {
+		if (!((dirty >> c) & 1)) {
+			c++;
+			continue;
+		}
+		int last = c;
+		while (last + 1 < PACKET_CHUNKS && ((dirty >> (last + 1)) & 1))
+			last++;
+		int start = c * hdrchunk_;
+		int end = (last + 1) * hdrchunk_;
+		if (end > hdrlen_)
+			end = hdrlen_;
+		if (start < end)
+			bzero(bits + start, end - start);
+		c = last + 1;
+	}
+}
+
+void Packet::copyhdrs(unsigned char* to, const unsigned char* from,
+		      uint64_t dirty)
+{
+	for (int c = 0; c < PACKET_CHUNKS && dirty >> c; ) {
+		if (!((dirty >> c) & 1)) {
+			c++;
+			continue;
+		}
+		int last = c;
+		while (last + 1 < PACKET_CHUNKS && ((dirty >> (last + 1)) & 1))
+			last++;
+		int start = c * hdrchunk_;
+		int end = (last + 1) * hdrchunk_;
+		if (end > hdrlen_)
+			end = hdrlen_;
+		if (start < end)
+			memcpy(to + start, from + start, end - start);
+		c = last + 1;
+	}
+}
+
+/*
+ * Allocate PACKET_SLAB packets with zeroed header bits: return one of
+ * them and put the others on the free list.
+ */
+Packet* Packet::slab()
+{
+	Packet* ps = new Packet[PACKET_SLAB];
+	unsigned char* bits = new unsigned char[PACKET_SLAB * hdrlen_];
+	if (ps == 0 || bits == 0)
+		abort();
+	bzero(bits, PACKET_SLAB * hdrlen_);
+	for (int i = 0; i < PACKET_SLAB; i++) {
+		ps[i].bits_ = bits + i * hdrlen_;
+		ps[i].fflag_ = FALSE;
+	}
+	for (int i = PACKET_SLAB - 1; i > 0; i--) {
+		ps[i].next_ = free_;
+		free_ = &ps[i];
+	}
+	slabhdrlen_ = hdrlen_;
+	pool_.grow(PACKET_SLAB);
+	return (&ps[0]);
+}
 int hdr_cmn::offset_;			// static offset of common header
 int hdr_flags::offset_;			// static offset of flags header
 
@@ -102,6 +236,8 @@ int PacketHeaderClass::method(int ac, const char*const* av)
 		if (strcmp(argv[1], "offset") == 0) {
 			if (offset_) {
 				*offset_ = atoi(argv[2]);
+				Packet::register_header(offset_, *offset_,
+							hdrlen_);
 				return TCL_OK;
 			}
 			tcl.resultf("Warning: cannot set offset_ for %s",
@@ -454,6 +454,22 @@ private:
 //Monarch ext
 typedef void (*FailureCallback)(Packet *,void *);
 
+// Allocation counters of the packets (see PoolStats)
+class PacketPool : public PoolStats {
+public:
+	PacketPool() : PoolStats("Packet") {}
+	inline void get() {
+		++requests_;
+		if (++live_ > peak_)
+			peak_ = live_;
+	}
+	inline void put() { --live_; }
+	inline void grow(int n) { allocs_ += n; }
+};
+
+#define PACKET_SLAB	64	// packets allocated at once
+#define PACKET_CHUNKS	64	// bits of Packet::dirty_
+
 class Packet : public Event {
 private:
 	unsigned char* bits_;	// header bits
@@ -462,15 +478,38 @@ private:
 	AppData* data_;		// variable size buffer for 'data'
 	static void init(Packet*);     // initialize pkt hdr 
 	bool fflag_;
+	/*
+	 * The header bits are split in PACKET_CHUNKS chunks of hdrchunk_
+	 * bytes.  access() marks the chunks of the header it returns as
+	 * dirty: the other chunks are still zero, so that free() only
+	 * zeroes and copy() only copies the dirty chunks.
+	 */
+	mutable uint64_t dirty_;
+	static uint64_t* hdrmask_;	// chunks of the header of each NS_ALIGN bytes
+	static int hdrmasklen_;		// hdrlen_ of hdrmask_
+	static int hdrchunk_;
+	static int slabhdrlen_;		// hdrlen_ of the packets of free_
+	static void hdrlayout();
+	static void clearhdrs(unsigned char* bits, uint64_t dirty);
+	static void copyhdrs(unsigned char* to, const unsigned char* from,
+			     uint64_t dirty);
+	static Packet* slab();		// allocate PACKET_SLAB packets
 protected:
 	static Packet* free_;	// packet free list
 	int	ref_count_;	// free the pkt until count to 0
 public:
 	Packet* next_;		// for queues and the free list
+	Packet* prev_;		// for ChannelPacketQueue: previous packet
+	Packet* chnext_;	// for ChannelPacketQueue: next packet on the same channel
 	static int hdrlen_;
-
-	Packet() : bits_(0), data_(0), ref_count_(0), next_(0) { }
-	inline unsigned char* const bits() { return (bits_); }
+	static PacketPool pool_;
+	// a header of len bytes at offset off (set by PacketHeaderClass)
+	static void register_header(int* offp, int off, int len);
+
+	Packet() : bits_(0), data_(0), dirty_(0), ref_count_(0), next_(0),
+		   prev_(0), chnext_(0) { }
+	// the caller may write anywhere in the header bits
+	inline unsigned char* const bits() { dirty_ = ~(uint64_t)0; return (bits_); }
 	inline Packet* copy() const;
 	inline Packet* refcopy() { ++ref_count_; return this; }
 	inline int& ref_count() { return (ref_count_); }
@@ -483,6 +522,7 @@ public:
 	inline unsigned char* access(int off) const {
 		if (off < 0)
 			abort();
+		dirty_ |= (off < hdrmasklen_) ? hdrmask_[off >> 3] : ~(uint64_t)0;
 		return (&bits_[off]);
 	}
 	// This is used for backward compatibility, i.e., assuming user data
@@ -674,11 +714,16 @@ public:
 
 inline void Packet::init(Packet* p)
 {
-	bzero(p->bits_, hdrlen_);
+	if (p->dirty_ != 0) {
+		clearhdrs(p->bits_, p->dirty_);
+		p->dirty_ = 0;
+	}
 }
 
 inline Packet* Packet::alloc()
 {
+	if (hdrmasklen_ != hdrlen_)
+		hdrlayout();
 	Packet* p = free_;
 	if (p != 0) {
 		assert(p->fflag_ == FALSE);
@@ -686,13 +731,10 @@ inline Packet* Packet::alloc()
 		assert(p->data_ == 0);
 		p->uid_ = 0;
 		p->time_ = 0;
-	} else {
-		p = new Packet;
-		p->bits_ = new unsigned char[hdrlen_];
-		if (p == 0 || p->bits_ == 0)
-			abort();
-	}
-	init(p); // Initialize bits_[]
+	} else
+		p = slab();
+	pool_.get();
+	// bits_[] is zero: cleared by free(), or a new slab
 	(HDR_CMN(p))->next_hop_ = -2; // -1 reserved for IP_BROADCAST
 	(HDR_CMN(p))->last_hop_ = -2; // -1 reserved for IP_BROADCAST
 	(HDR_CMN(p))->channel_ = 0;  //Added by Deepti
@@ -746,6 +788,7 @@ inline void Packet::free(Packet* p)
 			p->next_ = free_;
 			free_ = p;
 			p->fflag_ = FALSE;
+			pool_.put();
 		} else {
 			--p->ref_count_;
 		}
@@ -756,7 +799,9 @@ inline Packet* Packet::copy() const
 {
 	
 	Packet* p = alloc();
-	memcpy(p->bits(), bits_, hdrlen_);
+	// the chunks clean in both packets are zero in both
+	p->dirty_ |= dirty_;
+	copyhdrs(p->bits_, bits_, p->dirty_);
 	if (data_) 
 		p->data_ = data_->copy();
 	p->txinfo_.init(&txinfo_);
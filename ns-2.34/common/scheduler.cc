@@ -41,7 +41,17 @@ static const char rcsid[] =
 
 #include <stdlib.h>
 #include <limits.h>
+#include <float.h>
 #include <math.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#endif
 
 #include "config.h"
 #include "scheduler.h"
@@ -55,6 +65,39 @@ static const char rcsid[] =
 Scheduler* Scheduler::instance_;
 scheduler_uid_t Scheduler::uid_ = 1;
 
+PoolStats* PoolStats::all_;
+
+PoolStats::PoolStats(const char *name) : name_(name), requests_(0),
+	allocs_(0), live_(0), peak_(0)
+{
+	next_ = all_;
+	all_ = this;
+}
+
+void
+PoolStats::report(FILE *fp)
+{
+	fprintf(fp, "%-24s %12s %12s %10s %10s\n", "pool", "requests",
+		"allocs", "live", "peak");
+	for (PoolStats *p = all_; p; p = p->next_)
+		fprintf(fp, "%-24s %12ld %12ld %10ld %10ld\n", p->name_,
+			p->requests_, p->allocs_, p->live_, p->peak_);
+}
+
+static FILE *pool_report_fp;
+
+/* Replications forked by "fork-replicas" */
+static int replica = -1;		// index of this process, -1 in the parent
+static int nreplicas = 0;
+static int *replica_status = 0;		// exit status of each child
+
+static void
+pool_report_at_exit()
+{
+	PoolStats::report(pool_report_fp);
+	fflush(pool_report_fp);
+}
+
 // class AtEvent : public Event {
 // public:
 // 	char* proc_;
@@ -156,16 +199,81 @@ Scheduler::dispatch(Event* p)
 	dispatch(p, p->time_);
 }
 
+/*
+ * The scripts of the "at" events are Tcl objects shared by the events
+ * with the same text.  Tcl compiles a script to bytecode on its first
+ * evaluation and keeps it in the object, so a script scheduled again
+ * (a periodic proc, a traffic start repeated for many connections) is
+ * parsed once.  An entry goes away with the last event using it.
+ */
+struct AtScript {
+	Tcl_Obj* obj_;
+	Tcl_HashEntry* entry_;
+	int users_;		// events holding this script
+};
+
+static Tcl_HashTable at_scripts;
+static int at_scripts_init = 0;
+
+static AtScript*
+at_script(const char* proc)
+{
+	if (!at_scripts_init) {
+		Tcl_InitHashTable(&at_scripts, TCL_STRING_KEYS);
+		at_scripts_init = 1;
+	}
+	int isnew;
+	Tcl_HashEntry* he = Tcl_CreateHashEntry(&at_scripts, proc, &isnew);
+	AtScript* s;
+	if (isnew) {
+		s = new AtScript;
+		s->obj_ = Tcl_NewStringObj(proc, -1);
+		Tcl_IncrRefCount(s->obj_);
+		s->entry_ = he;
+		s->users_ = 0;
+		Tcl_SetHashValue(he, (ClientData)s);
+	} else
+		s = (AtScript*)Tcl_GetHashValue(he);
+	++s->users_;
+	return (s);
+}
+
+static void
+at_script_release(AtScript* s)
+{
+	if (--s->users_ > 0)
+		return;
+	Tcl_DeleteHashEntry(s->entry_);
+	Tcl_DecrRefCount(s->obj_);
+	delete s;
+}
+
 class AtEvent : public Event {
 public:
-	AtEvent() : proc_(0) {
-	}
-	~AtEvent() {
-		if (proc_) delete [] proc_;
+	AtEvent() : script_(0) {
 	}
-	char* proc_;
+	AtScript* script_;
 };
 
+static EventPool<AtEvent> at_pool("AtEvent");
+static ScratchBuffer<double> delay_scratch("at-batch delays");
+
+static AtEvent*
+at_alloc(const char* proc)
+{
+	AtEvent* e = at_pool.alloc();
+	e->script_ = at_script(proc);
+	return (e);
+}
+
+static void
+at_release(AtEvent* e)
+{
+	at_script_release(e->script_);
+	e->script_ = 0;
+	at_pool.release(e);
+}
+
 class AtHandler : public Handler {
 public:
 	void handle(Event* event);
@@ -175,8 +283,12 @@ void
 AtHandler::handle(Event* e)
 {
 	AtEvent* at = (AtEvent*)e;
-	Tcl::instance().eval(at->proc_);
-	delete at;
+	Tcl& tcl = Tcl::instance();
+	// the command may schedule new at events: release after eval
+	if (Tcl_EvalObjEx(tcl.interp(), at->script_->obj_,
+			  TCL_EVAL_GLOBAL) != TCL_OK)
+		tcl.error(Tcl_GetString(at->script_->obj_));
+	at_release(at);
 }
 
 void
@@ -227,6 +339,19 @@ Scheduler::command(int argc, const char*const* argv)
 			}
 			dumpq();
 			return (TCL_OK);
+		} else if (strcmp(argv[1], "pool-stats") == 0) {
+			PoolStats::report(stdout);
+			return (TCL_OK);
+		} else if (strcmp(argv[1], "replica") == 0) {
+			tcl.resultf("%d", replica);
+			return (TCL_OK);
+		} else if (strcmp(argv[1], "replica-status") == 0) {
+			Tcl_Obj* l = Tcl_NewListObj(0, 0);
+			for (int i = 0; i < nreplicas; i++)
+				Tcl_ListObjAppendElement(tcl.interp(), l,
+					Tcl_NewIntObj(replica_status[i]));
+			Tcl_SetObjResult(tcl.interp(), l);
+			return (TCL_OK);
 		}
 	} else if (argc == 3) {
 		if (strcmp(argv[1], "at") == 0 ||
@@ -235,38 +360,74 @@ Scheduler::command(int argc, const char*const* argv)
 			if (p != 0) {
 				/*XXX make sure it really is an atevent*/
 				cancel(p);
-				AtEvent* ae = (AtEvent*)p;
-				delete ae;
+				at_release((AtEvent*)p);
+			}
+		} else if (strcmp(argv[1], "pool-stats") == 0 ||
+			   strcmp(argv[1], "pool-report") == 0) {
+			FILE *fp = stdout;
+			if (strcmp(argv[2], "-") != 0 &&
+			    (fp = fopen(argv[2], "w")) == NULL) {
+				tcl.resultf("can't open %s", argv[2]);
+				return (TCL_ERROR);
+			}
+			if (strcmp(argv[1], "pool-stats") == 0) {
+				PoolStats::report(fp);
+				if (fp != stdout)
+					fclose(fp);
+			} else {
+				// report when ns exits
+				if (pool_report_fp == NULL)
+					atexit(pool_report_at_exit);
+				else if (pool_report_fp != stdout)
+					fclose(pool_report_fp);
+				pool_report_fp = fp;
+			}
+		} else if (strcmp(argv[1], "replay") == 0) {
+			long ops, mismatches;
+			double t = replay(argv[2], &ops, &mismatches);
+			if (t < 0) {
+				tcl.resultf("can't replay %s", argv[2]);
+				return (TCL_ERROR);
 			}
+			tcl.resultf("%f %ld %ld", t, ops, mismatches);
 		} else if (strcmp(argv[1], "at-now") == 0) {
 			const char* proc = argv[2];
 
 			// "at [$ns now]" may not work because of tcl's 
 			// string number resolution
-			AtEvent* e = new AtEvent;
-			int n = strlen(proc);
-			e->proc_ = new char[n + 1];
-			strcpy(e->proc_, proc);
+			AtEvent* e = at_alloc(proc);
 			schedule(&at_handler, e, 0);
 			sprintf(tcl.buffer(), UID_PRINTF_FORMAT, e->uid_);
 			tcl.result(tcl.buffer());
-		}
+		} else if (strcmp(argv[1], "at-batch") == 0)
+			return (at_batch(argv[2]));
 		return (TCL_OK);
 	} else if (argc == 4) {
+		if (strcmp(argv[1], "fork-replicas") == 0) {
+			int n = atoi(argv[2]), jobs = atoi(argv[3]);
+			if (n <= 0) {
+				tcl.resultf("fork-replicas: bad count %s", argv[2]);
+				return (TCL_ERROR);
+			}
+			int i = fork_replicas(n, jobs);
+			if (i == -2) {
+				tcl.result("fork-replicas: not supported");
+				return (TCL_ERROR);
+			}
+			tcl.resultf("%d", i);
+			return (TCL_OK);
+		}
 		if (strcmp(argv[1], "at") == 0) {
 			/* t < 0 means relative time: delay = -t */
 			double delay, t = atof(argv[2]);
 			const char* proc = argv[3];
 
-			AtEvent* e = new AtEvent;
-			int n = strlen(proc);
-			e->proc_ = new char[n + 1];
-			strcpy(e->proc_, proc);
 			delay = (t < 0) ? -t : t - clock();
 			if (delay < 0) {
 				tcl.result("can't schedule command in past");
 				return (TCL_ERROR);
 			}
+			AtEvent* e = at_alloc(proc);
 			schedule(&at_handler, e, delay);
 			sprintf(tcl.buffer(), UID_PRINTF_FORMAT, e->uid_);
 			tcl.result(tcl.buffer());
@@ -276,6 +437,238 @@ Scheduler::command(int argc, const char*const* argv)
 	return (TclObject::command(argc, argv));
 }
 
+/*
+ * "at-batch {t1 script1 t2 script2 ...}": schedules every pair as "at"
+ * would, in one call, and returns the list of the event uids.  Nothing
+ * is scheduled unless all the times are valid.
+ */
+int
+Scheduler::at_batch(const char* events)
+{
+	Tcl& tcl = Tcl::instance();
+	Tcl_Interp* interp = tcl.interp();
+	Tcl_Obj* list = Tcl_NewStringObj(events, -1);
+	Tcl_Obj** objv;
+	int objc, i;
+
+	Tcl_IncrRefCount(list);
+	if (Tcl_ListObjGetElements(interp, list, &objc, &objv) != TCL_OK) {
+		Tcl_DecrRefCount(list);
+		return (TCL_ERROR);
+	}
+	if (objc % 2 != 0) {
+		Tcl_DecrRefCount(list);
+		tcl.result("at-batch: odd number of elements in the list");
+		return (TCL_ERROR);
+	}
+	double* delay = delay_scratch.get(objc / 2 + 1);
+	for (i = 0; i < objc; i += 2) {
+		/* t < 0 means relative time: delay = -t */
+		double t;
+		if (Tcl_GetDoubleFromObj(interp, objv[i], &t) != TCL_OK) {
+			Tcl_DecrRefCount(list);
+			return (TCL_ERROR);
+		}
+		delay[i / 2] = (t < 0) ? -t : t - clock();
+		if (delay[i / 2] < 0) {
+			Tcl_DecrRefCount(list);
+			tcl.result("can't schedule command in past");
+			return (TCL_ERROR);
+		}
+	}
+	Tcl_Obj* uids = Tcl_NewListObj(0, 0);
+	for (i = 0; i < objc; i += 2) {
+		AtEvent* e = at_alloc(Tcl_GetString(objv[i + 1]));
+		schedule(&at_handler, e, delay[i / 2]);
+		sprintf(tcl.buffer(), UID_PRINTF_FORMAT, e->uid_);
+		Tcl_ListObjAppendElement(interp, uids,
+					 Tcl_NewStringObj(tcl.buffer(), -1));
+	}
+	Tcl_DecrRefCount(list);
+	Tcl_SetObjResult(interp, uids);
+	return (TCL_OK);
+}
+
+/*
+ * Gives a copy of the process its own output: it works in the directory
+ * dir, created if needed, so files opened from now on (traces, the stat
+ * files of PUmodel...) are its own.  Each regular file already open for
+ * writing is replaced by a copy, in that directory, of what it holds so
+ * far; files of the same name from different directories get a .<n>
+ * suffix, descriptors of the same file share its copy.  Files are found
+ * through /proc/self/fd: without it, the files opened before the fork
+ * stay shared.
+ */
+int
+Scheduler::own_output(const char *dir)
+{
+#ifndef WIN32
+	char link[64], path[PATH_MAX], name[PATH_MAX + 16], buf[8192];
+	if ((mkdir(dir, 0777) < 0 && errno != EEXIST) || chdir(dir) < 0)
+		return (-1);
+	DIR *d = opendir("/proc/self/fd");
+	if (d == 0)
+		return (0);
+	// list the descriptors first, the copies open new ones
+	int nfds = 0, maxfds = 64, i, j;
+	int *fds = new int[maxfds];
+	struct dirent *de;
+	while ((de = readdir(d)) != 0) {
+		int fd = atoi(de->d_name);
+		if (fd < 3 || fd == dirfd(d))
+			continue;
+		if (nfds == maxfds) {
+			int *nf = new int[maxfds *= 2];
+			memcpy(nf, fds, nfds * sizeof(int));
+			delete [] fds;
+			fds = nf;
+		}
+		fds[nfds++] = fd;
+	}
+	closedir(d);
+
+	struct stat *copied = new struct stat[nfds];
+	char **base = new char*[nfds];
+	int ncopied = 0, st = 0;
+	for (i = 0; i < nfds && st == 0; i++) {
+		int fd = fds[i];
+		struct stat sb;
+		int fl = fcntl(fd, F_GETFL);
+		if (fl < 0 || (fl & O_ACCMODE) == O_RDONLY ||
+		    fstat(fd, &sb) < 0 || !S_ISREG(sb.st_mode))
+			continue;
+		sprintf(link, "/proc/self/fd/%d", fd);
+		int n = readlink(link, path, sizeof(path) - 1);
+		if (n < 0)
+			continue;
+		path[n] = 0;
+		if (strstr(path, " (deleted)") != 0)
+			continue;
+		const char *b = strrchr(path, '/');
+		b = b ? b + 1 : path;
+		// n: other files of that name copied so far
+		int same = -1;
+		for (j = 0, n = 0; j < ncopied; j++) {
+			if (strcmp(base[j], b) != 0)
+				continue;
+			if (copied[j].st_dev == sb.st_dev &&
+			    copied[j].st_ino == sb.st_ino) {
+				same = j;
+				break;
+			}
+			n++;
+		}
+		int first = (same < 0);
+		if (n == 0)
+			strcpy(name, b);
+		else
+			sprintf(name, "%s.%d", b, n);
+		if (first) {
+			copied[ncopied] = sb;
+			base[ncopied++] = strdup(b);
+		}
+
+		// copy what is not in the copy yet, up to the offset of fd
+		int rfd = open(path, O_RDONLY);
+		int nfd = open(name, O_WRONLY | O_CREAT | (first ? O_TRUNC : 0),
+			       0666);
+		if (rfd < 0 || nfd < 0) {
+			st = -1;
+			break;
+		}
+		off_t off = lseek(fd, 0, SEEK_CUR);
+		off_t done = lseek(nfd, 0, SEEK_END);
+		lseek(rfd, done, SEEK_SET);
+		while (done < off) {
+			int k = read(rfd, buf, off - done < (off_t)sizeof(buf) ?
+				     (int)(off - done) : (int)sizeof(buf));
+			if (k <= 0 || write(nfd, buf, k) != k)
+				break;
+			done += k;
+		}
+		close(rfd);
+		lseek(nfd, off, SEEK_SET);
+		fcntl(nfd, F_SETFL, fl & O_APPEND);
+		if (dup2(nfd, fd) < 0)
+			st = -1;
+		close(nfd);
+	}
+	for (i = 0; i < ncopied; i++)
+		free(base[i]);
+	delete [] base;
+	delete [] copied;
+	delete [] fds;
+	return (st);
+#else
+	return (-1);
+#endif
+}
+
+/*
+ * Forks n copies of this process, running at most jobs (the number of
+ * cpus if <= 0) at a time.  Returns the index of the copy in the
+ * children, each with its own output in replica.<i> (see own_output).  The parent
+ * waits for all of them, keeps their exit status (128 + signal if
+ * killed, -1 if the fork failed) and returns -1.
+ */
+int
+Scheduler::fork_replicas(int n, int jobs)
+{
+#ifndef WIN32
+	if (jobs <= 0)
+		jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs <= 0)
+		jobs = 1;
+	delete [] replica_status;
+	replica_status = new int[n];
+	nreplicas = n;
+	pid_t *pids = new pid_t[n];
+	int started = 0, running = 0, st, i;
+
+	// or the children would write the parent's buffered output again
+	fflush(NULL);
+	while (started < n || running > 0) {
+		if (started < n && running < jobs) {
+			pid_t pid = fork();
+			if (pid == 0) {
+				char dir[32];
+				delete [] pids;
+				replica = started;
+				sprintf(dir, "replica.%d", replica);
+				if (own_output(dir) < 0) {
+					perror("fork-replicas: replica output");
+					exit(1);
+				}
+				return (replica);
+			}
+			pids[started] = pid;
+			replica_status[started] = -1;
+			if (pid < 0)
+				perror("fork-replicas");
+			else
+				running++;
+			started++;
+			continue;
+		}
+		pid_t pid = waitpid(-1, &st, 0);
+		if (pid < 0)
+			break;
+		for (i = 0; i < started; i++) {
+			if (pids[i] != pid)
+				continue;
+			replica_status[i] = WIFEXITED(st) ? WEXITSTATUS(st) :
+				128 + WTERMSIG(st);
+			running--;
+			break;
+		}
+	}
+	delete [] pids;
+	return (-1);
+#else
+	return (-2);
+#endif
+}
+
 void
 Scheduler::dumpq()
 {
@@ -290,6 +683,67 @@ Scheduler::dumpq()
 	}
 }
 
+/*
+ * Replay the queue operations recorded by Scheduler/Recorder: each
+ * recorded event is inserted, cancelled and dequeued in the recorded
+ * order, without being dispatched.  Returns the cpu time spent in the
+ * queue, the number of operations and the number of dequeues that did
+ * not return the recorded event (ties broken in another order).
+ */
+double
+Scheduler::replay(const char *file, long *ops, long *mismatches)
+{
+	FILE *fp = fopen(file, "rb");
+	if (fp == NULL)
+		return (-1);
+	fseek(fp, 0, SEEK_END);
+	long n = ftell(fp) / sizeof(sched_record);
+	rewind(fp);
+	sched_record *r = new sched_record[n > 0 ? n : 1];
+	n = fread(r, sizeof(sched_record), n, fp);
+	fclose(fp);
+
+	scheduler_uid_t maxuid = 0;
+	for (long i = 0; i < n; i++)
+		if (r[i].uid_ > maxuid)
+			maxuid = r[i].uid_;
+	Event *ev = new Event[maxuid + 1];
+
+	*mismatches = 0;
+	clock_t start = ::clock();
+	for (long i = 0; i < n; i++) {
+		Event *e;
+		switch (r[i].op_) {
+		case SCHED_RECORD_INSERT:
+			e = &ev[r[i].uid_];
+			e->time_ = r[i].time_;
+			e->uid_ = r[i].uid_;
+			insert(e);
+			break;
+		case SCHED_RECORD_CANCEL:
+			cancel(&ev[r[i].uid_]);
+			break;
+		case SCHED_RECORD_DEQUE:
+			e = deque();
+			if (e == NULL || e->uid_ != r[i].uid_)
+				(*mismatches)++;
+			if (e != NULL) {
+				clock_ = e->time_;
+				e->uid_ = -e->uid_;
+			}
+			break;
+		}
+	}
+	double t = (double)(::clock() - start) / CLOCKS_PER_SEC;
+
+	while (deque() != NULL)
+		;
+	delete [] ev;
+	delete [] r;
+	*ops = n;
+	return (t);
+}
+
 static class ListSchedulerClass : public TclClass {
 public:
 	ListSchedulerClass() : TclClass("Scheduler/List") {}
@@ -1016,6 +1470,556 @@ CalendarScheduler::lookup(scheduler_uid_t uid)
 	return NULL;
 }
 
+static class LadderSchedulerClass : public TclClass {
+public:
+	LadderSchedulerClass() : TclClass("Scheduler/Ladder") {}
+	TclObject* create(int /* argc */, const char*const* /* argv */) {
+		return (new LadderScheduler);
+	}
+} class_ladder_sched;
+
+LadderScheduler::LadderScheduler() : top_(0), ntop_(0), top_min_(0),
+	top_max_(0), top_start_(-DBL_MAX), nrungs_(0), bottom_(0),
+	bottom_tail_(0), nbottom_(0)
+{
+	for (int i = 0; i < LADDER_MAX_RUNGS; i++) {
+		rungs_[i].size_ = 0;
+		rungs_[i].bucket_ = 0;
+		rungs_[i].bcount_ = 0;
+	}
+}
+
+LadderScheduler::~LadderScheduler()
+{
+	// XXX free events?
+	for (int i = 0; i < LADDER_MAX_RUNGS; i++) {
+		delete [] rungs_[i].bucket_;
+		delete [] rungs_[i].bcount_;
+	}
+}
+
+/*
+ * Bucket of rung r holding time t, or -1 if t is below the buckets
+ * not yet moved down (the event then belongs to a lower rung or to
+ * the bottom).  Times above the rung go to its last bucket.
+ * insert() and cancel() must find the same bucket for an event, so
+ * the mapping only depends on the rung and is monotonic in t.
+ */
+int
+LadderScheduler::bucket_of(Rung *r, double t)
+{
+	if (r->cur_ >= r->nbuckets_)
+		return (-1);
+	double d = (t - r->start_) / r->width_;
+	if (d < r->cur_)
+		return (-1);
+	if (d >= r->nbuckets_ - 1)
+		return (r->nbuckets_ - 1);
+	return ((int)d);
+}
+
+void
+LadderScheduler::list_add(Event **list, Event *e)
+{
+	e->prev_ = 0;
+	e->next_ = *list;
+	if (*list)
+		(*list)->prev_ = e;
+	*list = e;
+}
+
+void
+LadderScheduler::list_remove(Event **list, Event *e)
+{
+	if (e->prev_)
+		e->prev_->next_ = e->next_;
+	else
+		*list = e->next_;
+	if (e->next_)
+		e->next_->prev_ = e->prev_;
+}
+
+static inline bool
+ladder_before(const Event *a, const Event *b)
+{
+	return (a->time_ < b->time_ ||
+		(a->time_ == b->time_ && a->uid_ < b->uid_));
+}
+
+static Event *
+ladder_msort(Event *list, int n)
+{
+	if (n <= 1) {
+		if (list)
+			list->next_ = 0;
+		return (list);
+	}
+	Event *p = list;
+	for (int i = 1; i < n / 2; i++)
+		p = p->next_;
+	Event *right = p->next_;
+	Event *left = ladder_msort(list, n / 2);
+	right = ladder_msort(right, n - n / 2);
+
+	Event head;
+	Event *tail = &head;
+	while (left && right) {
+		if (ladder_before(right, left)) {
+			tail->next_ = right;
+			right = right->next_;
+		} else {
+			tail->next_ = left;
+			left = left->next_;
+		}
+		tail = tail->next_;
+	}
+	tail->next_ = left ? left : right;
+	return (head.next_);
+}
+
+/* sort a list of n events by time, events with the same time in insertion order */
+Event *
+LadderScheduler::sort(Event *list, int n)
+{
+	list = ladder_msort(list, n);
+	Event *prev = 0;
+	for (Event *p = list; p; p = p->next_) {
+		p->prev_ = prev;
+		prev = p;
+	}
+	return (list);
+}
+
+void
+LadderScheduler::bottom_insert(Event *e)
+{
+	// new events usually go at the end: search from the tail
+	Event *p;
+	for (p = bottom_tail_; p && e->time_ < p->time_; p = p->prev_)
+		;
+	e->prev_ = p;
+	e->next_ = p ? p->next_ : bottom_;
+	if (e->next_)
+		e->next_->prev_ = e;
+	else
+		bottom_tail_ = e;
+	if (p)
+		p->next_ = e;
+	else
+		bottom_ = e;
+	++nbottom_;
+}
+
+/* the bottom is empty, list becomes the bottom */
+void
+LadderScheduler::bottom_append(Event *list)
+{
+	bottom_ = list;
+	for (Event *p = list; p; p = p->next_) {
+		bottom_tail_ = p;
+		++nbottom_;
+	}
+}
+
+/*
+ * Add a rung below the others, with n+1 buckets of the given width
+ * starting at start, and spread the n events of list over it.
+ */
+void
+LadderScheduler::spawn_rung(Event *list, int n, double start, double width)
+{
+	Rung *r = &rungs_[nrungs_++];
+	int nbuck = n + 1;
+	if (nbuck > r->size_) {
+		delete [] r->bucket_;
+		delete [] r->bcount_;
+		r->size_ = nbuck;
+		r->bucket_ = new Event*[nbuck];
+		r->bcount_ = new int[nbuck];
+	}
+	for (int i = 0; i < nbuck; i++) {
+		r->bucket_[i] = 0;
+		r->bcount_[i] = 0;
+	}
+	r->start_ = start;
+	r->width_ = width;
+	r->nbuckets_ = nbuck;
+	r->cur_ = 0;
+	r->count_ = n;
+	while (list) {
+		Event *e = list;
+		list = list->next_;
+		int i = bucket_of(r, e->time_);
+		list_add(&r->bucket_[i], e);
+		++r->bcount_[i];
+	}
+}
+
+/*
+ * Move the next events down to the (empty) bottom.  Crowded buckets
+ * are spread over a new rung instead of being sorted.
+ */
+int
+LadderScheduler::refill()
+{
+	for (;;) {
+		if (nrungs_ == 0) {
+			if (top_ == 0)
+				return (0);
+			double width = (top_max_ - top_min_) / ntop_;
+			Event *list = top_;
+			int n = ntop_;
+			top_ = 0;
+			ntop_ = 0;
+			// new events below top_start_ must not be taken for top
+			// events by cancel(): keep it strictly above top_max_
+			top_start_ = nextafter(top_max_, DBL_MAX);
+			if (top_min_ + width > top_min_) {
+				spawn_rung(list, n, top_min_, width);
+				if (top_max_ + width > top_start_)
+					top_start_ = top_max_ + width;
+			} else {
+				// all the events at the same time
+				bottom_append(sort(list, n));
+				return (1);
+			}
+		}
+		Rung *r = &rungs_[nrungs_ - 1];
+		while (r->cur_ < r->nbuckets_ && r->bcount_[r->cur_] == 0)
+			++r->cur_;
+		if (r->cur_ == r->nbuckets_) {
+			--nrungs_;
+			continue;
+		}
+		Event *list = r->bucket_[r->cur_];
+		int n = r->bcount_[r->cur_];
+		r->bucket_[r->cur_] = 0;
+		r->bcount_[r->cur_] = 0;
+		r->count_ -= n;
+		++r->cur_;
+		if (n > LADDER_THRES && nrungs_ < LADDER_MAX_RUNGS) {
+			double min = list->time_, max = list->time_;
+			for (Event *p = list->next_; p; p = p->next_) {
+				if (p->time_ < min)
+					min = p->time_;
+				if (p->time_ > max)
+					max = p->time_;
+			}
+			double width = (max - min) / n;
+			if (min + width > min) {
+				spawn_rung(list, n, min, width);
+				continue;
+			}
+		}
+		bottom_append(sort(list, n));
+		return (1);
+	}
+}
+
+void
+LadderScheduler::insert(Event* e)
+{
+	double t = e->time_;
+	if (t >= top_start_) {
+		if (ntop_ == 0)
+			top_min_ = top_max_ = t;
+		else if (t < top_min_)
+			top_min_ = t;
+		else if (t > top_max_)
+			top_max_ = t;
+		list_add(&top_, e);
+		++ntop_;
+		return;
+	}
+	for (int i = 0; i < nrungs_; i++) {
+		Rung *r = &rungs_[i];
+		int b = bucket_of(r, t);
+		if (b >= 0) {
+			list_add(&r->bucket_[b], e);
+			++r->bcount_[b];
+			++r->count_;
+			return;
+		}
+	}
+	bottom_insert(e);
+	if (nbottom_ > LADDER_THRES && nrungs_ < LADDER_MAX_RUNGS) {
+		// too many events to keep sorted: spread them over a new rung
+		double min = bottom_->time_;
+		double width = (bottom_tail_->time_ - min) / nbottom_;
+		if (min + width > min) {
+			Event *list = bottom_;
+			int n = nbottom_;
+			bottom_ = bottom_tail_ = 0;
+			nbottom_ = 0;
+			spawn_rung(list, n, min, width);
+		}
+	}
+}
+
+void
+LadderScheduler::cancel(Event* e)
+{
+	if (e->uid_ <= 0)	// event not in queue
+		return;
+	double t = e->time_;
+	if (t >= top_start_) {
+		list_remove(&top_, e);
+		--ntop_;
+	} else {
+		int i;
+		for (i = 0; i < nrungs_; i++) {
+			Rung *r = &rungs_[i];
+			int b = bucket_of(r, t);
+			if (b >= 0) {
+				list_remove(&r->bucket_[b], e);
+				--r->bcount_[b];
+				--r->count_;
+				break;
+			}
+		}
+		if (i == nrungs_) {
+			if (e == bottom_tail_)
+				bottom_tail_ = e->prev_;
+			list_remove(&bottom_, e);
+			--nbottom_;
+		}
+	}
+	e->uid_ = -e->uid_;
+	e->next_ = e->prev_ = 0;
+}
+
+Event*
+LadderScheduler::deque()
+{
+	if (bottom_ == 0 && !refill())
+		return (0);
+	Event *e = bottom_;
+	bottom_ = e->next_;
+	if (bottom_)
+		bottom_->prev_ = 0;
+	else
+		bottom_tail_ = 0;
+	--nbottom_;
+	return (e);
+}
+
+const Event*
+LadderScheduler::head()
+{
+	if (bottom_ == 0 && !refill())
+		return (0);
+	return (bottom_);
+}
+
+Event*
+LadderScheduler::lookup(scheduler_uid_t uid)
+{
+	Event *p;
+	for (p = bottom_; p; p = p->next_)
+		if (p->uid_ == uid)
+			return (p);
+	for (int i = 0; i < nrungs_; i++) {
+		Rung *r = &rungs_[i];
+		for (int b = r->cur_; b < r->nbuckets_; b++)
+			for (p = r->bucket_[b]; p; p = p->next_)
+				if (p->uid_ == uid)
+					return (p);
+	}
+	for (p = top_; p; p = p->next_)
+		if (p->uid_ == uid)
+			return (p);
+	return (0);
+}
+
+int
+LadderScheduler::command(int argc, const char*const* argv)
+{
+	Tcl& tcl = Tcl::instance();
+	if ((argc == 2 || argc == 4) && strcmp(argv[1], "test") == 0) {
+		long seed = (argc == 4) ? atol(argv[2]) : 1;
+		long ops = (argc == 4) ? atol(argv[3]) : 100000;
+		tcl.resultf("%ld", test(seed, ops));
+		return (TCL_OK);
+	}
+	return (Scheduler::command(argc, argv));
+}
+
+// small generator of its own, not to disturb the RNG streams
+static inline unsigned long
+ladder_test_rand(unsigned long *s, unsigned long k)
+{
+	*s = *s * 6364136223846793005UL + 1442695040888963407UL;
+	return ((*s >> 33) % k);
+}
+
+/*
+ * "$sched test ?seed ops?": random inserts, cancels and deques on a new
+ * ladder queue and a new heap, which must deque the same events in the
+ * same order.  Times are drawn to give many ties, all the events at the
+ * same time, and far events.  Returns the first operation where the
+ * queues differ, 0 if none.
+ */
+long
+LadderScheduler::test(long seed, long ops)
+{
+	if (ops < 1)
+		ops = 1;
+	Scheduler *saved = instance_;	// the destructors clear it
+	LadderScheduler *ladder = new LadderScheduler;
+	HeapScheduler *heap = new HeapScheduler;
+	Event *le = new Event[ops];
+	Event *he = new Event[ops];
+	long *live = new long[ops];	// events in the queues
+	long *pos = new long[ops];	// index of each event in live
+	long nlive = 0, n = 0, op, bad = 0;
+	unsigned long s = seed;
+	double now = 0;
+
+	for (op = 1; op <= ops && bad == 0; op++) {
+		unsigned long r = ladder_test_rand(&s, 10);
+		if (r < 5) {
+			double t = now;
+			switch (ladder_test_rand(&s, 4)) {
+			case 1:
+				t += ladder_test_rand(&s, 5);
+				break;
+			case 2:
+				t += ladder_test_rand(&s, 1000) / 100.0;
+				break;
+			case 3:
+				t += ladder_test_rand(&s, 100000) / 7.0;
+				break;
+			}
+			le[n].time_ = he[n].time_ = t;
+			le[n].uid_ = he[n].uid_ = n + 1;
+			ladder->insert(&le[n]);
+			heap->insert(&he[n]);
+			pos[n] = nlive;
+			live[nlive++] = n++;
+		} else if (r < 7) {
+			if (nlive == 0)
+				continue;
+			long i = live[ladder_test_rand(&s, nlive)];
+			ladder->cancel(&le[i]);
+			heap->cancel(&he[i]);
+			live[pos[i]] = live[--nlive];
+			pos[live[pos[i]]] = pos[i];
+		} else {
+			Event *l = ladder->deque();
+			Event *h = heap->deque();
+			if ((l == 0) != (h == 0) || (l && l->uid_ != h->uid_)) {
+				bad = op;
+				break;
+			}
+			if (l == 0)
+				continue;
+			now = l->time_;
+			long i = l - le;
+			live[pos[i]] = live[--nlive];
+			pos[live[pos[i]]] = pos[i];
+		}
+	}
+	while (bad == 0) {
+		Event *l = ladder->deque();
+		Event *h = heap->deque();
+		if ((l == 0) != (h == 0) || (l && l->uid_ != h->uid_))
+			bad = op;
+		if (l == 0 || h == 0)
+			break;
+		++op;
+	}
+	delete ladder;
+	delete heap;
+	delete [] le;
+	delete [] he;
+	delete [] live;
+	delete [] pos;
+	instance_ = saved;
+	return (bad);
+}
+
+static class RecordSchedulerClass : public TclClass {
+public:
+	RecordSchedulerClass() : TclClass("Scheduler/Recorder") {}
+	TclObject* create(int /* argc */, const char*const* /* argv */) {
+		return (new RecordScheduler);
+	}
+} class_record_sched;
+
+RecordScheduler::RecordScheduler() : fp_(0)
+{
+	queue_ = new HeapScheduler;
+}
+
+RecordScheduler::~RecordScheduler()
+{
+	if (fp_)
+		fclose(fp_);
+	delete queue_;
+}
+
+void
+RecordScheduler::record(int op, const Event *e)
+{
+	if (fp_ == 0)
+		return;
+	sched_record r;
+	r.time_ = e->time_;
+	r.uid_ = e->uid_;
+	r.op_ = op;
+	r.pad_ = 0;
+	fwrite(&r, sizeof(r), 1, fp_);
+}
+
+void
+RecordScheduler::insert(Event* e)
+{
+	record(SCHED_RECORD_INSERT, e);
+	queue_->insert(e);
+}
+
+void
+RecordScheduler::cancel(Event* e)
+{
+	if (e->uid_ > 0)
+		record(SCHED_RECORD_CANCEL, e);
+	queue_->cancel(e);
+}
+
+Event*
+RecordScheduler::deque()
+{
+	Event *e = queue_->deque();
+	if (e)
+		record(SCHED_RECORD_DEQUE, e);
+	return (e);
+}
+
+int
+RecordScheduler::command(int argc, const char*const* argv)
+{
+	if (argc == 2) {
+		if (strcmp(argv[1], "record-stop") == 0) {
+			if (fp_)
+				fclose(fp_);
+			fp_ = 0;
+			return (TCL_OK);
+		}
+	} else if (argc == 3) {
+		if (strcmp(argv[1], "record") == 0) {
+			if (fp_)
+				fclose(fp_);
+			fp_ = fopen(argv[2], "wb");
+			if (fp_ == 0) {
+				Tcl::instance().resultf("can't open %s", argv[2]);
+				return (TCL_ERROR);
+			}
+			return (TCL_OK);
+		}
+	}
+	return (Scheduler::command(argc, argv));
+}
+
 #ifndef WIN32
 #include <sys/time.h>
 #endif
@@ -74,6 +74,80 @@ class Handler {
 	virtual void handle(Event* event) = 0;
 };
 
+/*
+ * Allocation counters of the object pools, all reported together by
+ * "$ns pool-stats" (or at exit after "$ns pool-report").
+ */
+class PoolStats {
+public:
+	PoolStats(const char *name);
+	static void report(FILE *fp);
+protected:
+	const char *name_;
+	long requests_;		// objects asked for
+	long allocs_;		// heap allocations
+	long live_;		// objects in use
+	long peak_;		// most objects in use
+	PoolStats *next_;
+	static PoolStats *all_;
+};
+
+/*
+ * Free list of Event-derived objects, linked through next_: handlers
+ * release() the events they consume instead of deleting them, and
+ * alloc() hands out a released event before allocating a new one.
+ * Fields of a recycled event keep their last values.
+ */
+template <class T> class EventPool : public PoolStats {
+public:
+	EventPool(const char *name) : PoolStats(name), free_(0) {}
+	T* alloc() {
+		T* e;
+		++requests_;
+		if (++live_ > peak_)
+			peak_ = live_;
+		if (free_) {
+			e = free_;
+			free_ = (T*)e->next_;
+		} else {
+			++allocs_;
+			e = new T;
+		}
+		return (e);
+	}
+	void release(T* e) {
+		--live_;
+		e->next_ = free_;
+		free_ = e;
+	}
+private:
+	T* free_;
+};
+
+/*
+ * Scratch array kept across calls, for handlers which need a temporary
+ * buffer per event: get(n) only allocates when n exceeds the size of
+ * the buffer.  The buffer is reused by the next get().
+ */
+template <class T> class ScratchBuffer : public PoolStats {
+public:
+	ScratchBuffer(const char *name) : PoolStats(name), buf_(0), size_(0) {}
+	T* get(int n) {
+		++requests_;
+		if (n > size_) {
+			++allocs_;
+			delete [] buf_;
+			size_ = (n > 2 * size_) ? n : 2 * size_;
+			buf_ = new T[size_];
+			live_ = peak_ = size_;
+		}
+		return (buf_);
+	}
+private:
+	T* buf_;
+	int size_;
+};
+
 #define	SCHED_START	0.0	/* start time (secs) */
 
 class Scheduler : public TclObject {
@@ -96,8 +170,16 @@ public:
 		return SCHED_START;
 	}
 	virtual void reset();
+	// copies of the process (replications, restored checkpoints)
+	// write their own output in dir
+	static int own_output(const char *dir);
 protected:
 	void dumpq();	// for debug: remove + print remaining events
+	// for benchmarks: run the operations recorded by Scheduler/Recorder
+	// on this (empty) queue, return the cpu time
+	double replay(const char *file, long *ops, long *mismatches);
+	int at_batch(const char *events);	// "at" for many events
+	int fork_replicas(int n, int jobs);	// replications of the process
 	void dispatch(Event*);	// execute an event
 	void dispatch(Event*, double);	// exec event, set clock_
 	Scheduler();
@@ -218,4 +300,91 @@ private:
 };
 
 
+/*
+ * Ladder queue: an unsorted top list for the far future, a ladder of
+ * up to LADDER_MAX_RUNGS rungs of unsorted buckets, each rung spawned
+ * from a crowded bucket of the previous one, and a sorted bottom list
+ * with the events to be dequeued next.  Events only get sorted when a
+ * bucket with at most LADDER_THRES events reaches the bottom.
+ *
+ * See W. T. Tang, R. S. M. Goh, I. L.-J. Thng. "Ladder queue: An O(1)
+ *  priority queue structure for large-scale discrete event simulation."
+ *  ACM TOMACS, 15(3):175-204, July 2005
+ */
+#define LADDER_THRES		50
+#define LADDER_MAX_RUNGS	8
+
+class LadderScheduler : public Scheduler {
+public:
+	LadderScheduler();
+	~LadderScheduler();
+	void cancel(Event*);
+	void insert(Event*);
+	Event* lookup(scheduler_uid_t uid);
+	Event* deque();
+	const Event* head();
+	int command(int argc, const char*const* argv);
+	long test(long seed, long ops);	// against a heap, 0 if they agree
+
+protected:
+	struct Rung {
+		double start_;		// start time of bucket 0
+		double width_;		// bucket width
+		int nbuckets_;
+		int cur_;		// first bucket not yet moved down
+		int size_;		// allocated buckets
+		int count_;		// events in the rung
+		Event **bucket_;	// unsorted lists
+		int *bcount_;		// events per bucket
+	};
+	int bucket_of(Rung *r, double t);	// -1 if t is below the rung
+	void list_add(Event **list, Event *e);
+	void list_remove(Event **list, Event *e);
+	Event *sort(Event *list, int n);	// by time, then insertion order
+	void bottom_insert(Event *e);
+	void bottom_append(Event *list);	// sorted list, into the empty bottom
+	void spawn_rung(Event *list, int n, double start, double width);
+	int refill();				// fill the bottom, 0 if empty
+
+	Event *top_;			// unsorted, time >= top_start_
+	int ntop_;
+	double top_min_, top_max_, top_start_;
+	Rung rungs_[LADDER_MAX_RUNGS];
+	int nrungs_;
+	Event *bottom_;			// sorted
+	Event *bottom_tail_;
+	int nbottom_;
+};
+
+/*
+ * Scheduler/Recorder: dispatches events like Scheduler/Heap, and records
+ * the queue operations of the simulation into a file, to be replayed
+ * on the other schedulers with "$sched replay <file>".
+ */
+struct sched_record {
+	double time_;
+	scheduler_uid_t uid_;
+	int op_;
+	int pad_;
+};
+#define SCHED_RECORD_INSERT	'i'
+#define SCHED_RECORD_CANCEL	'c'
+#define SCHED_RECORD_DEQUE	'd'
+
+class RecordScheduler : public Scheduler {
+public:
+	RecordScheduler();
+	~RecordScheduler();
+	void cancel(Event* e);
+	void insert(Event* e);
+	Event* lookup(scheduler_uid_t uid) { return queue_->lookup(uid); }
+	Event* deque();
+	const Event* head() { return queue_->head(); }
+protected:
+	int command(int argc, const char*const* argv);
+	void record(int op, const Event *e);
+	HeapScheduler *queue_;
+	FILE *fp_;
+};
+
 #endif
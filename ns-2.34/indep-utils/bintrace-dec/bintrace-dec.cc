@@ -0,0 +1,134 @@
+/*
+ * bintrace-dec: convert a binary trace written by CRBinTrace
+ * (see trace/bintrace-file.h) into the -newtrace text format
+ *
+ * Usage: bintrace-dec [-c] binary_trace [text_trace]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bintrace-file.h"
+
+static void fail(const char *msg, const char *file) {
+	fprintf(stderr, "bintrace-dec: %s %s\n", msg, file);
+	exit(1);
+}
+
+static void print_record(FILE *out, const bin_trace_record *r,
+			 char (*ptype)[BIN_TRACE_PTYPE_LEN], uint32_t number_ptypes,
+			 int print_channel) {
+	char level[BIN_TRACE_LEVEL_LEN + 1];
+	char why[BIN_TRACE_WHY_LEN + 1];
+	const char *name = "undefined";
+
+	memcpy(level, r->level, BIN_TRACE_LEVEL_LEN);
+	level[BIN_TRACE_LEVEL_LEN] = 0;
+	memcpy(why, r->why, BIN_TRACE_WHY_LEN);
+	why[BIN_TRACE_WHY_LEN] = 0;
+	if (r->ptype >= 0 && (uint32_t)r->ptype < number_ptypes)
+		name = ptype[r->ptype];
+
+	// CMUTrace::format_mac_common
+	fprintf(out, "%c -t %.9f -Hs %d -Hd %d -Ni %d -Nx %.2f -Ny %.2f -Nz %.2f -Ne %f -Nl %3s -Nw %s ",
+		r->op, r->time, r->node, r->next_hop, r->node,
+		r->x, r->y, r->z, r->energy, level, why);
+
+	// CMUTrace::format_mac / format_smac
+	if (r->mac_kind == BIN_TRACE_MAC_SMAC)
+		fprintf(out, " [%.2f %d %d] ", r->mac_dur, (int)r->mac[1], (int)r->mac[2]);
+	else
+		fprintf(out, "-Ma %x -Md %x -Ms %x -Mt %x ",
+			r->mac[0], r->mac[1], r->mac[2], r->mac[3]);
+
+	// CMUTrace::format_arp
+	if (r->ext_kind == BIN_TRACE_EXT_ARP)
+		fprintf(out, "-P arp -Po %s -Pms %d -Ps %d -Pmd %d -Pd %d ",
+			r->ext[0] ? "REQUEST" : "REPLY",
+			r->ext[1], r->ext[2], r->ext[3], r->ext[4]);
+
+	// CMUTrace::format_ip
+	if (r->flags & BIN_TRACE_HAS_IP)
+		fprintf(out, "-Is %d.%d -Id %d.%d -It %s -Il %d -If %d -Ii %d -Iv %d ",
+			r->ip[0], r->ip[1], r->ip[2], r->ip[3], name,
+			r->size, r->ip[4], r->uid, r->ip[5]);
+
+	switch (r->ext_kind) {
+	case BIN_TRACE_EXT_TCP:
+		fprintf(out, "-Pn tcp -Ps %d -Pa %d -Pf %d -Po %d ",
+			r->ext[0], r->ext[1], r->ext[2], r->ext[3]);
+		break;
+	case BIN_TRACE_EXT_CBR:
+		fprintf(out, "-Pn cbr -Pi %d -Pf %d -Po %d ",
+			r->ext[0], r->ext[1], r->ext[2]);
+		break;
+	case BIN_TRACE_EXT_AODV_REQ:
+		fprintf(out, "-P aodv -Pt 0x%x -Ph %d -Pb %d -Pd %d -Pds %d -Ps %d -Pss %d -Pc REQUEST ",
+			r->ext[0], r->ext[1], r->ext[2], r->ext[3],
+			r->ext[4], r->ext[5], r->ext[6]);
+		break;
+	case BIN_TRACE_EXT_AODV_REP:
+		// AODVTYPE_RREP 0x04, AODVTYPE_RERR 0x08 (aodv/aodv_packet.h)
+		fprintf(out, "-P aodv -Pt 0x%x -Ph %d -Pd %d -Pds %d -Pl %f -Pc %s ",
+			r->ext[0], r->ext[1], r->ext[2], r->ext[3], r->ext_d,
+			r->ext[0] == 0x04 ? "REPLY" :
+			(r->ext[0] == 0x08 ? "ERROR" : "HELLO"));
+		break;
+	default:
+		break;
+	}
+
+	if (print_channel)
+		fprintf(out, "-Nc %d ", r->channel);
+	fputc('\n', out);
+}
+
+int main(int argc, char **argv) {
+	int print_channel = 0;
+	int arg = 1;
+
+	if (arg < argc && strcmp(argv[arg], "-c") == 0) {
+		print_channel = 1;
+		arg++;
+	}
+	if (argc - arg < 1 || argc - arg > 2) {
+		fprintf(stderr, "Usage: bintrace-dec [-c] binary_trace [text_trace]\n");
+		exit(1);
+	}
+	FILE *in = fopen(argv[arg], "rb");
+	if (in == NULL)
+		fail("can't open", argv[arg]);
+	FILE *out = stdout;
+	if (argc - arg == 2 && (out = fopen(argv[arg + 1], "w")) == NULL)
+		fail("can't create", argv[arg + 1]);
+
+	bin_trace_header header;
+	if (fread(&header, sizeof(header), 1, in) != 1 ||
+	    memcmp(header.magic, BIN_TRACE_MAGIC, BIN_TRACE_MAGIC_LEN) != 0)
+		fail("not a binary trace:", argv[arg]);
+	if (header.byte_order != BIN_TRACE_BYTE_ORDER)
+		fail("binary trace written with a different byte order:", argv[arg]);
+	if (header.version != BIN_TRACE_VERSION ||
+	    header.record_size != sizeof(bin_trace_record))
+		fail("unsupported binary trace version:", argv[arg]);
+
+	char (*ptype)[BIN_TRACE_PTYPE_LEN] = new char[header.number_ptypes][BIN_TRACE_PTYPE_LEN];
+	if (header.number_ptypes > 0 &&
+	    fread(ptype, BIN_TRACE_PTYPE_LEN, header.number_ptypes, in) != header.number_ptypes)
+		fail("truncated packet type table in", argv[arg]);
+	for (uint32_t i = 0; i < header.number_ptypes; i++)
+		ptype[i][BIN_TRACE_PTYPE_LEN - 1] = 0;
+
+	bin_trace_record r;
+	size_t n;
+	while ((n = fread(&r, 1, sizeof(r), in)) == sizeof(r))
+		print_record(out, &r, ptype, header.number_ptypes, print_channel);
+	if (n != 0)
+		fprintf(stderr, "bintrace-dec: ignoring a truncated record at the end of %s\n", argv[arg]);
+
+	delete [] ptype;
+	fclose(in);
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * pumap-conv: convert a text PU map into the binary PU map format
+ * read by the PUMap object (see cognitive/PUmapfile.h)
+ *
+ * Usage: pumap-conv text_map binary_map
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PUmapfile.h"
+
+struct pu_entry {
+	double arrival;
+	double departure;
+};
+
+static int compare_entry(const void *a, const void *b) {
+	const pu_entry *e1 = (const pu_entry *) a;
+	const pu_entry *e2 = (const pu_entry *) b;
+	if (e1->arrival < e2->arrival)
+		return -1;
+	if (e1->arrival > e2->arrival)
+		return 1;
+	return 0;
+}
+
+static void fail(const char *msg, const char *file) {
+	fprintf(stderr, "pumap-conv: %s %s\n", msg, file);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: pumap-conv text_map binary_map\n");
+		exit(1);
+	}
+	FILE *in = fopen(argv[1], "r");
+	if (in == NULL)
+		fail("can't open", argv[1]);
+	FILE *out = fopen(argv[2], "wb");
+	if (out == NULL)
+		fail("can't create", argv[2]);
+
+	int number_pu;
+	if (fscanf(in, "%d", &number_pu) != 1 || number_pu < 0)
+		fail("can't read the number of PUs from", argv[1]);
+
+	pu_map_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PU_MAP_MAGIC, PU_MAP_MAGIC_LEN);
+	header.version = PU_MAP_VERSION;
+	header.byte_order = PU_MAP_BYTE_ORDER;
+	header.number_pu = number_pu;
+
+	pu_map_record *records = new pu_map_record[number_pu];
+	memset(records, 0, number_pu * sizeof(pu_map_record));
+	for (int i = 0; i < number_pu; i++) {
+		int channel;
+		if (fscanf(in, "%d %lf %lf %lf %lf %le %le %lf", &channel,
+			   &records[i].x_loc, &records[i].y_loc,
+			   &records[i].x_loc_receiver, &records[i].y_loc_receiver,
+			   &records[i].alpha, &records[i].beta, &records[i].radius) != 8)
+			fail("can't read the PU information from", argv[1]);
+		records[i].main_channel = channel;
+	}
+
+	// Header and records are rewritten once the entry offsets are known
+	if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+	    fwrite(records, sizeof(pu_map_record), number_pu, out) != (size_t) number_pu)
+		fail("can't write", argv[2]);
+
+	uint64_t offset = sizeof(header) + number_pu * sizeof(pu_map_record);
+	for (int i = 0; i < number_pu; i++) {
+		int number;
+		if (fscanf(in, "%d", &number) != 1 || number < 0)
+			fail("can't read the number of PU entries from", argv[1]);
+		pu_entry *entries = new pu_entry[number];
+		for (int j = 0; j < number; j++)
+			if (fscanf(in, "%lf %lf", &entries[j].arrival, &entries[j].departure) != 2)
+				fail("can't read the PU entries from", argv[1]);
+		qsort(entries, number, sizeof(pu_entry), compare_entry);
+
+		records[i].number_data = number;
+		records[i].offset = offset;
+		for (int j = 0; j < number; j++)
+			if (fwrite(&entries[j].arrival, sizeof(double), 1, out) != 1)
+				fail("can't write", argv[2]);
+		for (int j = 0; j < number; j++)
+			if (fwrite(&entries[j].departure, sizeof(double), 1, out) != 1)
+				fail("can't write", argv[2]);
+		offset += 2 * number * sizeof(double);
+		delete [] entries;
+	}
+
+	if (fseek(out, sizeof(header), SEEK_SET) != 0 ||
+	    fwrite(records, sizeof(pu_map_record), number_pu, out) != (size_t) number_pu)
+		fail("can't write", argv[2]);
+	fclose(in);
+	fclose(out);
+	delete [] records;
+	return 0;
+}
@@ -40,10 +40,6 @@ static const char rcsid[] =
     "@(#) $Header: /cvsroot/nsnam/ns-2/mac/channel.cc,v 1.47 2009/01/02 21:50:24 tom_henderson Exp $ (UCB)";
 #endif
 
-// Time interval for updating a position of a node in the X-List
-// (can be adjusted by the user, depending on the nodes mobility). /* VAL NAUMOV */
-#define XLIST_POSITION_UPDATE_INTERVAL 1.0 //seconds
-
 // Change made by Deepti
 // Change all nextX_ to nextX_[this->index()] and prevX_ to prevX_[this->index()]
     
@@ -234,11 +230,22 @@ Channel::dump(void)
 
 struct ChannelDelayEvent : public Event {
 public:
-	ChannelDelayEvent(Packet *p, Phy *txphy) : p_(p), txphy_(txphy) {};
+	ChannelDelayEvent() : p_(0), txphy_(0) {};
 	Packet *p_;
 	Phy *txphy_;
 };
 
+static EventPool<ChannelDelayEvent> delay_event_pool("ChannelDelayEvent");
+
+/*
+ * Receptions scheduled by WirelessChannel::sendUp, only for the
+ * interfaces whose carrier sense detects the packet.
+ */
+static EventPool<ChannelReception> reception_pool("ChannelReception");
+
+// Neighbors returned by the GridKeeper in WirelessChannel::sendUp
+static ScratchBuffer<MobileNode*> gk_neighbors("GridKeeper neighbors");
+
 class NoDupChannel : public Channel, public Handler {
 public:
 	void recv(Packet* p, Handler*);	
@@ -254,13 +261,15 @@ void NoDupChannel::recv(Packet* p, Handler* h) {
 	assert(hdr_cmn::access(p)->direction() == hdr_cmn::DOWN);
 	// Delay this packet
 	Scheduler &s = Scheduler::instance();
-	ChannelDelayEvent *de = new ChannelDelayEvent(p, (Phy *)h);
+	ChannelDelayEvent *de = delay_event_pool.alloc();
+	de->p_ = p;
+	de->txphy_ = (Phy *)h;
 	s.schedule(this, de, delay_);
 }
 void NoDupChannel::handle(Event *e) {
 	ChannelDelayEvent *cde = (ChannelDelayEvent *)e;
 	sendUp(cde->p_, cde->txphy_);
-	delete cde;
+	delay_event_pool.release(cde);
 }
 
 void NoDupChannel::sendUp(Packet *p, Phy *txif) {
@@ -291,8 +300,7 @@ class MobileNode;
 double WirelessChannel::highestAntennaZ_ = -1; // i.e., uninitialized
 double WirelessChannel::distCST_ = -1;
 
-WirelessChannel::WirelessChannel(void) : Channel(), numNodes_(0), 
-					 xListHead_(NULL), sorted_(0) {
+WirelessChannel::WirelessChannel(void) : Channel(), numNodes_(0) {
 	// Added by Deepti -- start					
 	bind("bandwidth_", &bandwidth_);	
 	bind("frequency_", &frequency_);	
@@ -311,6 +319,11 @@ int WirelessChannel::command(int argc, const char*const* argv)
 			return TCL_ERROR;
 		}
 		if (strcmp(argv[1], "add-node") == 0) {
+			if (this->index() >= XLIST_MAX_CHANNELS) {
+				fprintf(stderr, "add-node: more than %d channels\n",
+					XLIST_MAX_CHANNELS);
+				return TCL_ERROR;
+			}
 			addNodeToList((MobileNode*) obj);
 			return TCL_OK;
 		}
@@ -330,8 +343,9 @@ WirelessChannel::sendUp(Packet* p, Phy *tifp)
 	Phy *rifp = ifhead_.lh_first;
 	Node *tnode = tifp->node();
 	Node *rnode = 0;
-	Packet *newp;
+	ChannelReception *rec;
 	double propdelay = 0.0;
+	double Pr;
 	struct hdr_cmn *hdr = HDR_CMN(p);
 
          /* list-based improvement */
@@ -349,25 +363,32 @@ WirelessChannel::sendUp(Packet* p, Phy *tifp)
 	    GridKeeper* gk = GridKeeper::instance();
 	    int size = gk->size_; 
 	    
-	    MobileNode **outlist = new MobileNode *[size];
+	    MobileNode **outlist = gk_neighbors.get(size);
 	 
        	    int out_index = gk->get_neighbors((MobileNode*)tnode,
 						         outlist);
 	    for (i=0; i < out_index; i ++) {
 		
-		  newp = p->copy();
 		  rnode = outlist[i];
-		  propdelay = get_pdelay(tnode, rnode);
 
 		  rifp = (rnode->ifhead()).lh_first; 
 		  for(; rifp; rifp = rifp->nextnode()){
 			  if (rifp->channel() == this){
-				 s.schedule(rifp, newp, propdelay); 
+				 // Skip radios tuned to another channel
+				 if (!rifp->is_tuned_to(hdr->channel_))
+					 break;
+				 if (!rifp->carrier_sense(p, &Pr))
+					 break;
+				 rec = reception_pool.alloc();
+				 rec->p_ = p->refcopy();
+				 rec->rxphy_ = rifp;
+				 rec->RxPr_ = Pr;
+				 propdelay = get_pdelay(tnode, rnode);
+				 s.schedule(this, rec, propdelay);
 				 break;
 			  }
 		  }
  	    }
-	    delete [] outlist; 
 	 
 	 } else { // use list-based improvement
 	 
@@ -375,258 +396,108 @@ WirelessChannel::sendUp(Packet* p, Phy *tifp)
 		 MobileNode **affectedNodes;// **aN;
 		 int numAffectedNodes = -1, i;
 		 
-		 if(!sorted_){
-			 sortLists();
+		 if (numNodes_ == 0 || mtnode->topography() == NULL) {
+			 fprintf(stderr, "no node on the channel when trying to send!!!\n");
+			 Packet::free(p);
+			 return;
 		 }
-		 
-		 affectedNodes = getAffectedNodes(mtnode, distCST_ + /* safety */ 5, &numAffectedNodes);
+		 affectedNodes = mtnode->topography()->getAffectedNodes(mtnode,
+				distCST_ + /* safety */ 5, this->index(),
+				&numAffectedNodes);
 		 for (i=0; i < numAffectedNodes; i++) {
 			 rnode = affectedNodes[i];
 			 
 			 if(rnode == tnode)
 				 continue;
 			 
-			 newp = p->copy();
-			 
-			 propdelay = get_pdelay(tnode, rnode);
+			 propdelay = -1.0;
 			 
 			 rifp = (rnode->ifhead()).lh_first;
 			 for(; rifp; rifp = rifp->nextnode()){
 				//Added by Deepti -- start
 				if (rifp->getchannelnum() > 0) {
-					if(rifp->getmultichannel(this->index()) == this){
-						s.schedule(rifp, newp, propdelay);
-					}
-				}
-				else {
-					s.schedule(rifp, newp, propdelay);
+					if(rifp->getmultichannel(this->index()) != this)
+						continue;
 				}
-				//s.schedule(rifp, newp, propdelay);
 				//Added by Deepti  -- end 
+				// Radios tuned to another channel would drop the packet: 
+				// do not copy it nor schedule its reception
+				if (!rifp->is_tuned_to(hdr->channel_))
+					continue;
+				if (!rifp->carrier_sense(p, &Pr))
+					continue;
+				if (propdelay < 0.0)
+					propdelay = get_pdelay(tnode, rnode);
+				rec = reception_pool.alloc();
+				rec->p_ = p->refcopy();
+				rec->rxphy_ = rifp;
+				rec->RxPr_ = Pr;
+				s.schedule(this, rec, propdelay);
 			 }
 		 }
-		 delete [] affectedNodes;
 	 }
 	 Packet::free(p);
 }
 
-
 void
-WirelessChannel::addNodeToList(MobileNode *mn)
+WirelessChannel::handle(Event *e)
 {
-	MobileNode *tmp;
-
-	// create list of mobilenodes for this channel
-	if (xListHead_ == NULL) {
-		fprintf(stderr, "INITIALIZE THE LIST xListHead\n");
-		xListHead_ = mn;
-		xListHead_->nextX_[this->index()] = NULL;
-		xListHead_->prevX_[this->index()] = NULL;
-	} else {
-		for (tmp = xListHead_; tmp->nextX_[this->index()] != NULL; tmp=tmp->nextX_[this->index()]);
-		tmp->nextX_[this->index()] = mn;
-		mn->prevX_[this->index()] = tmp;
-		mn->nextX_[this->index()] = NULL;
-	}
-	numNodes_++;
-}
-
-void
-WirelessChannel::removeNodeFromList(MobileNode *mn) {
-	
-	MobileNode *tmp;
-	// Find node in list
-	for (tmp = xListHead_; tmp->nextX_[this->index()] != NULL; tmp=tmp->nextX_[this->index()]) {
-		if (tmp == mn) {
-			if (tmp == xListHead_) {
-				xListHead_ = tmp->nextX_[this->index()];
-				if (tmp->nextX_[this->index()] != NULL)
-					tmp->nextX_[this->index()]->prevX_[this->index()] = NULL;
-			} else if (tmp->nextX_[this->index()] == NULL) 
-				tmp->prevX_[this->index()]->nextX_[this->index()] = NULL;
-			else {
-				tmp->prevX_[this->index()]->nextX_[this->index()] = tmp->nextX_[this->index()];
-				tmp->nextX_[this->index()]->prevX_[this->index()] = tmp->prevX_[this->index()];
-			}
-			numNodes_--;
-			return;
-		}
-	}
-	fprintf(stderr, "Channel: node not found in list\n");
-}
+	ChannelReception *rec = (ChannelReception *)e;
+	Packet *p = rec->p_;
+	Phy *rifp = rec->rxphy_;
 
-void
-WirelessChannel::sortLists(void) {
-	bool flag = true;
-	MobileNode *m, *q;
+	int st = rifp->sendUp_shared(p, rec);
 
-	sorted_ = true;
-	
-	fprintf(stderr, "SORTING LISTS ...");
-	/* Buble sort algorithm */
-	// SORT x-list
-	while(flag) {
-		flag = false;
-		m = xListHead_;
-		while (m != NULL){
-			if(m->nextX_[this->index()] != NULL)
-				if ( m->X() > m->nextX_[this->index()]->X() ){
-					flag = true;
-					//delete_after m;
-					q = m->nextX_[this->index()];
-					m->nextX_[this->index()] = q->nextX_[this->index()];
-					if (q->nextX_[this->index()] != NULL)
-						q->nextX_[this->index()]->prevX_[this->index()] = m;
-			    
-					//insert_before m;
-					q->nextX_[this->index()] = m;
-					q->prevX_[this->index()] = m->prevX_[this->index()];
-					m->prevX_[this->index()] = q;
-					if (q->prevX_[this->index()] != NULL)
-						q->prevX_[this->index()]->nextX_[this->index()] = q;
-
-					// adjust Head of List
-					if(m == xListHead_) 
-						xListHead_ = m->prevX_[this->index()];
-				}
-			m = m -> nextX_[this->index()];
-		}
-	}
-	
-	fprintf(stderr, "DONE!\n");
-}
-
-void
-WirelessChannel::updateNodesList(class MobileNode *mn, double oldX) {
-	
-	MobileNode* tmp;
-	double X = mn->X();
-	bool skipX=false;
-	
-	if(!sorted_) {
-		sortLists();
+	if (st == 0) {
+		/* Not received: the shared packet was left untouched */
+		reception_pool.release(rec);
+		Packet::free(p);
 		return;
 	}
-	
-	/* xListHead cannot be NULL here (they are created during creation of mobilenode) */
-	
-	/***  DELETE ***/
-	// deleting mn from x-list
-	if(mn->nextX_[this->index()] != NULL) {
-		if(mn->prevX_[this->index()] != NULL){
-			if((mn->nextX_[this->index()]->X() >= X) && (mn->prevX_[this->index()]->X() <= X)) skipX = true; // the node doesn't change its position in the list
-			else{
-				mn->nextX_[this->index()]->prevX_[this->index()] = mn->prevX_[this->index()];
-				mn->prevX_[this->index()]->nextX_[this->index()] = mn->nextX_[this->index()];
-			}
-		}
-		
-		else{
-			if(mn->nextX_[this->index()]->X() >= X) skipX = true; // skip updating the first element
-			else{
-				mn->nextX_[this->index()]->prevX_[this->index()] = NULL;
-				xListHead_ = mn->nextX_[this->index()];
-			}
-		}
+	// The receiver gets its own copy, the last one the shared packet
+	if (p->ref_count() > 0) {
+		Packet *newp = p->copy();
+		Packet::free(p);
+		p = newp;
 	}
-	
-	else if(mn->prevX_[this->index()] !=NULL){
-		if(mn->prevX_[this->index()]->X() <= X) skipX = true; // skip updating the last element
-		else mn->prevX_[this->index()]->nextX_[this->index()] = NULL;
-	}
-	
-	if ((mn->prevX_[this->index()] == NULL) && (mn->nextX_[this->index()] == NULL)) skipX = true; //skip updating if only one element in list
-	
-	/*** INSERT ***/
-	//inserting mn in x-list
-	if(!skipX){
-		if(X > oldX){			
-			for(tmp = mn; tmp->nextX_[this->index()] != NULL && tmp->nextX_[this->index()]->X() < X; tmp = tmp->nextX_[this->index()]);
-			//fprintf(stdout,"Scanning the element addr %d X=%0.f, next addr %d X=%0.f\n", tmp, tmp->X(), tmp->nextX_[this->index()], tmp->nextX_[this->index()]->X());
-			if(tmp->nextX_[this->index()] == NULL) { 
-				//fprintf(stdout, "tmp->nextX_[this->index()] is NULL\n");
-				tmp->nextX_[this->index()] = mn;
-				mn->prevX_[this->index()] = tmp;
-				mn->nextX_[this->index()] = NULL;
-			} 
-			else{ 
-				//fprintf(stdout, "tmp->nextX_[this->index()] is not NULL, tmp->nextX_[this->index()]->X()=%0.f\n", tmp->nextX_[this->index()]->X());
-				mn->prevX_[this->index()] = tmp->nextX_[this->index()]->prevX_[this->index()];
-				mn->nextX_[this->index()] = tmp->nextX_[this->index()];
-				tmp->nextX_[this->index()]->prevX_[this->index()] = mn;  	
-				tmp->nextX_[this->index()] = mn;
-			} 
-		}
-		else{
-			for(tmp = mn; tmp->prevX_[this->index()] != NULL && tmp->prevX_[this->index()]->X() > X; tmp = tmp->prevX_[this->index()]);
-				//fprintf(stdout,"Scanning the element addr %d X=%0.f, prev addr %d X=%0.f\n", tmp, tmp->X(), tmp->prevX_[this->index()], tmp->prevX_[this->index()]->X());
-			if(tmp->prevX_[this->index()] == NULL) {
-				//fprintf(stdout, "tmp->prevX_[this->index()] is NULL\n");
-				tmp->prevX_[this->index()] = mn;
-				mn->nextX_[this->index()] = tmp;
-				mn->prevX_[this->index()] = NULL;
-				xListHead_ = mn;
-			} 
-			else{
-				//fprintf(stdout, "tmp->prevX_[this->index()] is not NULL, tmp->prevX_[this->index()]->X()=%0.f\n", tmp->prevX_[this->index()]->X());
-				mn->nextX_[this->index()] = tmp->prevX_[this->index()]->nextX_[this->index()];
-				mn->prevX_[this->index()] = tmp->prevX_[this->index()];
-				tmp->prevX_[this->index()]->nextX_[this->index()] = mn;  	
-				tmp->prevX_[this->index()] = mn;		
-			}
-		}
+	if (st < 0)
+		rifp->recv(p, 0);
+	else {
+		p->txinfo_.RxPr = rec->RxPr_;
+		p->txinfo_.CPThresh = rec->CPThresh_;
+		if (rec->error_ >= 0)
+			HDR_CMN(p)->error() = rec->error_;
+		rifp->deliver(p);
 	}
+	reception_pool.release(rec);
 }
 
 
-MobileNode **
-WirelessChannel::getAffectedNodes(MobileNode *mn, double radius,
-				  int *numAffectedNodes)
+/* The nodes are kept in the index of their Topography: the channel
+ * only sets their bit.
+ */
+void
+WirelessChannel::addNodeToList(MobileNode *mn)
 {
-	double xmin, xmax, ymin, ymax;
-	int n = 0;
-	MobileNode *tmp, **list, **tmpList;
-
-	if (xListHead_ == NULL) {
-		*numAffectedNodes=-1;
-		fprintf(stderr, "xListHead_ is NULL when trying to send!!!\n");
-		return NULL;
-	}
-	
-	xmin = mn->X() - radius;
-	xmax = mn->X() + radius;
-	ymin = mn->Y() - radius;
-	ymax = mn->Y() + radius;
-	
-	// First allocate as much as possibly needed
-	tmpList = new MobileNode*[numNodes_];
-	
-	for(tmp = xListHead_; tmp != NULL; tmp = tmp->nextX_[this->index()]) tmpList[n++] = tmp;
-	for(int i = 0; i < n; ++i)
-		if(tmpList[i]->speed()!=0.0 && (Scheduler::instance().clock() -
-						tmpList[i]->getUpdateTime()) > XLIST_POSITION_UPDATE_INTERVAL )
-			tmpList[i]->update_position();
-	n=0;
-	
-	for(tmp = mn; tmp != NULL && tmp->X() >= xmin; tmp=tmp->prevX_[this->index()])
-		if(tmp->Y() >= ymin && tmp->Y() <= ymax){
-			tmpList[n++] = tmp;
-		}
-	for(tmp = mn->nextX_[this->index()]; tmp != NULL && tmp->X() <= xmax; tmp=tmp->nextX_[this->index()]){
-		if(tmp->Y() >= ymin && tmp->Y() <= ymax){
-			tmpList[n++] = tmp;
-		}
+	uint64_t bit = (uint64_t)1 << this->index();
+
+	if (!(mn->channels_ & bit)) {
+		mn->channels_ |= bit;
+		numNodes_++;
 	}
-	
-	list = new MobileNode*[n];
-	memcpy(list, tmpList, n * sizeof(MobileNode *));
-	delete [] tmpList;
-         
-	*numAffectedNodes = n;
-	return list;
 }
- 
 
+void
+WirelessChannel::removeNodeFromList(MobileNode *mn) {
+	uint64_t bit = (uint64_t)1 << this->index();
+
+	if (!(mn->channels_ & bit)) {
+		fprintf(stderr, "Channel: node not found in list\n");
+		return;
+	}
+	mn->channels_ &= ~bit;
+	numNodes_--;
+}
 
 /* Only to be used with mobile nodes (WirelessPhy).
  * NS-2 at its current state support only a flat (non 3D) movement of nodes,
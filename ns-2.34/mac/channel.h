@@ -96,17 +96,35 @@ protected:
   };*/
 
 
+/*
+ * Reception of a packet by one interface of a WirelessChannel.  All the
+ * receivers share the packet of the transmitter (one reference each):
+ * what a PHY would write into the packet is kept here, and the packet is
+ * copied only when the PHY accepts it (see WirelessChannel::handle).
+ */
+struct ChannelReception : public Event {
+public:
+	ChannelReception() : p_(0), rxphy_(0), RxPr_(-1), CPThresh_(0),
+			     error_(-1) {};
+	Packet *p_;
+	Phy *rxphy_;
+	double RxPr_;		// by Phy::carrier_sense() (-1 if none), then
+				// the power the PHY received
+	double CPThresh_;	// capture threshold of the PHY
+	int error_;		// error flag of the reception, -1 if unset
+};
+
 /*====================================================================
   WirelessChannel
 
   This class is used to represent the physical media used by mobilenodes
 ====================================================================*/
 
-class WirelessChannel : public Channel{
-	friend class Topography;
+class WirelessChannel : public Channel, public Handler {
 public:
 	WirelessChannel(void);
 	virtual int command(int argc, const char*const* argv);
+	void handle(Event *e);		// reception of a shared packet
         inline double gethighestAntennaZ() { return highestAntennaZ_; }
 
         // Added by Deepti -- start
@@ -119,16 +137,10 @@ private:
 	void sendUp(Packet* p, Phy *txif);
 	double get_pdelay(Node* tnode, Node* rnode);
 	
-	/* For list-keeper, channel keeps list of mobilenodes 
-	   listening on to it */
+	/* List-keeper: the nodes are in the grid of their Topography */
 	int numNodes_;
-	MobileNode *xListHead_;
-	bool sorted_;
 	void addNodeToList(MobileNode *mn);
 	void removeNodeFromList(MobileNode *mn);
-	void sortLists(void);
-	void updateNodesList(class MobileNode *mn, double oldX);
-	MobileNode **getAffectedNodes(MobileNode *mn, double radius, int *numAffectedNodes);
 	
 protected:
 	static double distCST_;        
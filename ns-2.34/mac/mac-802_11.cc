@@ -337,6 +337,13 @@ Mac802_11::command(int argc, const char*const* argv)
      		
 			if (index_%MAX_RADIO == RECEIVER_RADIO)  
 				sm_->setRepository(repository_);
+			// Tune the radio, so that the channel only delivers the packets sent on its current channel
+			if (index_%MAX_RADIO == CONTROL_RADIO)
+				netif_->tune(CONTROL_CHANNEL);
+			if (index_%MAX_RADIO == TRANSMITTER_RADIO)
+				netif_->tune(switching_channel_);
+			if (index_%MAX_RADIO == RECEIVER_RADIO)
+				repository_->set_recv_interface(index_/MAX_RADIO, netif_);
 			//if (index_%MAX_RADIO == TRANSMITTER_RADIO)
 				//sm_t->setRepository(repository_);
 			return (TCL_OK);
@@ -1664,6 +1671,7 @@ Mac802_11::send(Packet *p, Handler *h)
 	// Added by Deepti -- start
 	if (index_%MAX_RADIO == TRANSMITTER_RADIO) {
 		switching_channel_ = repository_->get_recv_channel(ETHER_ADDR(dh->dh_ra)/MAX_RADIO);
+		netif_->tune(switching_channel_);
 		if (first_tx_attempt_) {
 			new_switchable_channel_=switching_channel_;
 			mhQueue_.start(QUEUE_UTILIZATION_INTERVAL);
@@ -3421,7 +3429,7 @@ Mac802_11::switchqueueHandler()
 		// ROUND_ROBIN_ALL_CHANNELS policy: Visit all the available channels sequentially
 		case ROUND_ROBIN_ALL_CHANNELS:
 
-			new_switchable_channel_=(new_switchable_channel_ + 1) % MAX_CHANNELS;
+			new_switchable_channel_=(new_switchable_channel_ + 1) % repository_->get_number_channels();
 			
 			// Data packets must not be sent on the CONTROL_CHANNEL
 			if (new_switchable_channel_ == CONTROL_CHANNEL)
@@ -3432,9 +3440,9 @@ Mac802_11::switchqueueHandler()
 		case ROUND_ROBIN_ACTIVE_CHANNELS:
 			
 			// Look for the next channel on which the node is transmitting
-			for (int i=0; i< MAX_CHANNELS && !end; i++)  {	
+			for (int i=0; i< repository_->get_number_channels() && !end; i++)  {	
 				
-				new_switchable_channel_=(new_switchable_channel_ + 1) % MAX_CHANNELS;
+				new_switchable_channel_=(new_switchable_channel_ + 1) % repository_->get_number_channels();
 				
 				if (new_switchable_channel_ == CONTROL_CHANNEL)
 					new_switchable_channel_ = CONTROL_CHANNEL + 1;
@@ -3462,11 +3470,10 @@ Mac802_11::switchqueueHandler()
 //	#endif
 
 	// Notify the IFQ layer that a queue switching has been performed
-	EventSwitch *p=new EventSwitch();
-	p->channel = new_switchable_channel_;
+	switch_event_.channel = new_switchable_channel_;
 	// If the node is not transmitting, then ask for another packet to the upper IFQ layer
 	if (callbackQueue_ && pktTx_==NULL) {
-		callbackQueue_->handle(p);
+		callbackQueue_->handle(&switch_event_);
 	 }
 
 	
@@ -671,6 +671,8 @@ private:
 	void 			switchchannelHandler();
 	// Callback Function 
 	Handler* 		callbackQueue_;
+	// Event passed to callbackQueue_ on queue switching, handled synchronously
+	EventSwitch		switch_event_;
 	
 	
 	// Cognitive Radio Environment
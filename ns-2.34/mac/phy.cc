@@ -63,6 +63,8 @@ Phy::Phy() : BiConnector() {
 		multichannel[i]=0;
 	}	
 	// Added by Deepti -- end 
+	tuned_ = 0;
+	tuned_channel_ = -1;
 }
 
 int
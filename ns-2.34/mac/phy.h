@@ -57,6 +57,7 @@
 // 
 class Phy;
 LIST_HEAD(if_head, Phy);
+struct ChannelReception;
 
 #include "channel.h"
 #include "node.h"
@@ -79,6 +80,18 @@ class Phy : public BiConnector {
 	
 	virtual int sendUp(Packet *p)=0;
 
+	// Carrier sense by the channel before it schedules the reception
+	// of p: 0 if p will not be sensed, otherwise *Pr is the received
+	// power, or -1 if the interface computes it on reception.
+	virtual int carrier_sense(Packet *, double *Pr) { *Pr = -1; return 1; }
+	// Decides, as sendUp() does, on a packet shared with other
+	// receivers, but keeps what it would write into p in rec: 1 if
+	// p is accepted, then pass a copy to deliver(), 0 if not, -1 if
+	// the interface needs its own copy of p for sendUp().
+	virtual int sendUp_shared(Packet *, ChannelReception *) { return -1; }
+	// Passes up a packet accepted by sendUp_shared()
+	inline void deliver(Packet *p) { uptarget_->recv(p, (Handler*) 0); }
+
 	inline double  txtime(Packet *p) {
 		return (hdr_cmn::access(p)->size() * 8.0) / bandwidth_; }
 	inline double txtime(int bytes) {
@@ -112,6 +125,11 @@ class Phy : public BiConnector {
 	virtual Channel* getmultichannel(int index) const { return multichannel[index]; }	
 	inline int getchannelnum() {return nchannel;}
 	//Added by Deepti -- end 	
+	
+	// Logical channel (hdr_cmn::channel_) the interface is tuned to.
+	// The channel only delivers the packets sent on that channel to a tuned interface.
+	inline void tune(int channel) { tuned_ = 1; tuned_channel_ = channel; }
+	inline int is_tuned_to(int channel) const { return !tuned_ || tuned_channel_ == channel; }
 
  protected:
 	//void		drop(Packet *p);
@@ -148,6 +166,8 @@ class Phy : public BiConnector {
 	int             nchannel;                   //Number of channel  
  	int 		ChannelIndex;
 	//Added by Deepti -- end 	
+	int		tuned_;			// tuned_channel_ is valid
+	int		tuned_channel_;
 
 };
 
@@ -44,6 +44,7 @@
 
 #include <mobilenode.h>
 #include <phy.h>
+#include <channel.h>
 #include <propagation.h>
 #include <modulation.h>
 #include <omni-antenna.h>
@@ -316,6 +317,47 @@ WirelessPhy::sendDown(Packet *p)
 
 int 
 WirelessPhy::sendUp(Packet *p)
+{
+	double Pr = -1;
+	int error = -1;
+	int pkt_recvd = reception(p, &Pr, &error);
+
+	/* WILD HACK: The following two variables are a wild hack.
+	   They will go away in the next release...
+	   They're used by the mac-802_11 object to determine
+	   capture.  This will be moved into the net-if family of 
+	   objects in the future. */
+	p->txinfo_.RxPr = Pr;
+	p->txinfo_.CPThresh = CPThresh_;
+	if (error >= 0)
+		HDR_CMN(p)->error() = error;
+	return pkt_recvd;
+}
+
+/*
+ * Reception of a packet shared by the receivers of the channel: the
+ * received power, capture threshold and error flag are kept in rec,
+ * the channel writes them into the copy it passes to deliver().
+ */
+int
+WirelessPhy::sendUp_shared(Packet *p, ChannelReception *rec)
+{
+	int error = -1;
+	int pkt_recvd = reception(p, &rec->RxPr_, &error);
+
+	rec->CPThresh_ = CPThresh_;
+	rec->error_ = error;
+	return pkt_recvd;
+}
+
+/*
+ * Whether p is received, with its received power in *Pr (given by
+ * carrier_sense() on entry, -1 if none) and its error flag in *error
+ * (left as it is if the flag of p stays unchanged).  Accounts for the
+ * energy of the reception, but does not write into p.
+ */
+int
+WirelessPhy::reception(Packet *p, double *rxPr, int *error)
 {
 	/*
 	 * Sanity Check
@@ -325,6 +367,7 @@ WirelessPhy::sendUp(Packet *p)
 	PacketStamp s;
 	double Pr;
 	int pkt_recvd = 0;
+	double sensedPr = *rxPr;	// computed by carrier_sense()
 
 	lambda_ = p->txinfo_.getLambda(); //Added by Deepti to modify code for carrier frequency
 	Pr = p->txinfo_.getTxPr();
@@ -351,8 +394,12 @@ WirelessPhy::sendUp(Packet *p)
 	}
 
 	if(propagation_) {
-		s.stamp((MobileNode*)node(), ant_, 0, lambda_);
-		Pr = propagation_->Pr(&p->txinfo_, &s, this);
+		if (sensedPr >= 0)
+			Pr = sensedPr;
+		else {
+			s.stamp((MobileNode*)node(), ant_, 0, lambda_);
+			Pr = propagation_->Pr(&p->txinfo_, &s, this);
+		}
 		if (Pr < CSThresh_) {
 			pkt_recvd = 0;
 			goto DONE;
@@ -362,8 +409,7 @@ WirelessPhy::sendUp(Packet *p)
 			 * We can detect, but not successfully receive
 			 * this packet.
 			 */
-			hdr_cmn *hdr = HDR_CMN(p);
-			hdr->error() = 1;
+			*error = 1;
 #if DEBUG > 3
 			printf("SM %f.9 _%d_ drop pkt from %d low POWER %e/%e\n",
 			       Scheduler::instance().clock(), node()->index(),
@@ -373,8 +419,7 @@ WirelessPhy::sendUp(Packet *p)
 		}
 	}
 	if(modulation_) {
-		hdr_cmn *hdr = HDR_CMN(p);
-		hdr->error() = modulation_->BitError(Pr);
+		*error = modulation_->BitError(Pr);
 	}
 	
 	/*
@@ -386,14 +431,7 @@ WirelessPhy::sendUp(Packet *p)
 
 DONE:
 	p->txinfo_.getAntenna()->release();
-
-	/* WILD HACK: The following two variables are a wild hack.
-	   They will go away in the next release...
-	   They're used by the mac-802_11 object to determine
-	   capture.  This will be moved into the net-if family of 
-	   objects in the future. */
-	p->txinfo_.RxPr = Pr;
-	p->txinfo_.CPThresh = CPThresh_;
+	*rxPr = Pr;
 
 	/*
 	 * Decrease energy if packet successfully received
@@ -446,6 +484,30 @@ DONE:
 	return pkt_recvd;
 }
 
+/*
+ * Received power of p, computed when the channel schedules its
+ * reception, so that the packets below the carrier sense threshold are
+ * neither copied nor scheduled.  sendUp() drops them without side
+ * effect.  When the node is off, asleep or out of energy, sendUp() does
+ * not call the propagation model: leave the decision to it.
+ */
+int
+WirelessPhy::carrier_sense(Packet *p, double *Pr)
+{
+	PacketStamp s;
+
+	*Pr = -1;
+	if (!initialized())
+		return 1;
+	if (em() && (Is_node_on() != true || Is_sleeping() ||
+		     em()->energy() <= 0))
+		return 1;
+	lambda_ = p->txinfo_.getLambda();
+	s.stamp((MobileNode*)node(), ant_, 0, lambda_);
+	*Pr = propagation_->Pr(&p->txinfo_, &s, this);
+	return (*Pr >= CSThresh_);
+}
+
 void
 WirelessPhy::node_on()
 {
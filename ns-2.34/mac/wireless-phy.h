@@ -68,6 +68,8 @@ public:
 	
 	void sendDown(Packet *p);
 	int sendUp(Packet *p);
+	int sendUp_shared(Packet *p, ChannelReception *rec);
+	int carrier_sense(Packet *p, double *Pr);
 	
 	inline double getL() const {return L_;}
 	inline double getLambda() const {return lambda_;}
@@ -99,6 +101,9 @@ public:
 	double T_sleep_;	// 2.31 change: Time at which sleeping is to be enabled (sec)
 
 protected:
+	// decision of sendUp(), which leaves p as it is
+	int reception(Packet *p, double *Pr, int *error);
+
 	double Pt_;		// transmitted signal power (W)
 	double Pt_consume_;	// power consumption for transmission (W)
 	double Pr_consume_;	// power consumption for reception (W)
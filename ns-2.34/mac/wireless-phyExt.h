@@ -168,6 +168,13 @@ public:
 	//ns2 calls
 	void sendDown(Packet *p);
 	int sendUp(Packet *p);
+	// the power monitor records the packets below the threshold too
+	int carrier_sense(Packet *p, double *Pr) {
+		return Phy::carrier_sense(p, Pr);
+	}
+	int sendUp_shared(Packet *p, ChannelReception *rec) {
+		return Phy::sendUp_shared(p, rec);
+	}
 
 	int discard(Packet *p, double power, char* reason);
 	double getDist(double Pr, double Pt, double Gt, double Gr,
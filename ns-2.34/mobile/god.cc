@@ -54,6 +54,9 @@ er in the
 #include <ip.h>
 #include <god.h>
 #include <sys/param.h>  /* for MIN/MAX */
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
 
 #include "diffusion/hash_table.h"
 #include "mobilenode.h"
@@ -88,6 +91,13 @@ God::God()
 	num_send = 0;
 	active = false;
 	allowTostop = false;
+	nb_start_ = nb_ = 0;
+	old_nb_start_ = old_nb_ = 0;
+	nb_max_ = old_nb_max_ = 0;
+	hops_valid = false;
+	incremental = true;
+	route_threads = 1;
+	num_bfs = 0;
 }
 
 
@@ -120,34 +130,8 @@ void God::ComputeNextHop()
     return;
   }
 
-  int from, to, neighbor;
-
-  for (from=0; from<num_nodes; from++) {
-    for (to=0; to<num_nodes; to++) {
-
-      NEXT_HOP(from,to) = UNREACHABLE;
-
-      if (from==to) {
-	NEXT_HOP(from,to) = from;     // next hop is itself.
-      }
-
-      if (MIN_HOPS(from, to) == UNREACHABLE) {
-	continue;
-      }
-
-      for (neighbor=0; neighbor<num_nodes; neighbor++){
-	if ( MIN_HOPS(from, neighbor) != 1) {
-	  continue;
-	}
-
-	if ( MIN_HOPS(from, to) == (MIN_HOPS(neighbor,to) +1) ) {
-	  NEXT_HOP(from, to) = neighbor;
-	  break;
-	}
-      }
-
-    }
-  }
+  // next_hop is filled in with min_hops
+  ComputeHops();
 }
 
 
@@ -575,8 +559,7 @@ void God::ComputeRoute()
     return;
   }
 
-  floyd_warshall();
-  ComputeNextHop();
+  ComputeHops();
   Rewrite_OIF_Map();
   CountConnect();
   CountAliveNode();
@@ -619,45 +602,245 @@ void God::StopSimulation()
 }
 
 
-// Modified from setdest.cc -- Chalermek 12/1/99
-
-void God::ComputeW()
+/*
+ * Neighbor lists of all the nodes.  The pairs are found in increasing
+ * order, so that each list is sorted.
+ */
+void God::ComputeNeighbors()
 {
-  int i, j;
-  int *W = min_hops;
+  int i, j, k, n = 0;
+  int max = 4 * num_nodes;
+  int *pairs = new int[2 * max];
 
-  memset(W, '\xff', sizeof(int) * num_nodes * num_nodes);
+  for (i = 0; i < num_nodes; i++) {
+    for (j = i+1; j < num_nodes; j++) {
+      if (!IsNeighbor(i,j))
+	continue;
+      if (n == max) {
+	int *tmp = new int[4 * max];
+	memcpy(tmp, pairs, sizeof(int) * 2 * max);
+	delete [] pairs;
+	pairs = tmp;
+	max *= 2;
+      }
+      pairs[2 * n] = i;
+      pairs[2 * n + 1] = j;
+      n++;
+    }
+  }
 
-  for(i = 0; i < num_nodes; i++) {
-     W[i*num_nodes + i] = 0;     
-     for(j = i+1; j < num_nodes; j++) {
-	W[i*num_nodes + j] = W[j*num_nodes + i] = 
-	                     IsNeighbor(i,j) ? 1 : INFINITY;
-     }
+  if (nb_start_ == 0)
+    nb_start_ = new int[num_nodes + 1];
+  if (2 * n > nb_max_) {
+    delete [] nb_;
+    nb_max_ = 4 * n;
+    nb_ = new int[nb_max_];
   }
+
+  // nb_start_[i + 1] is the end of the list of i while filling it
+  for (i = 0; i <= num_nodes; i++)
+    nb_start_[i] = 0;
+  for (k = 0; k < n; k++) {
+    nb_start_[pairs[2 * k] + 1]++;
+    nb_start_[pairs[2 * k + 1] + 1]++;
+  }
+  for (i = 0; i < num_nodes; i++)
+    nb_start_[i + 1] += nb_start_[i];
+  for (i = num_nodes; i > 0; i--)
+    nb_start_[i] = nb_start_[i - 1];
+  for (k = 0; k < n; k++) {
+    i = pairs[2 * k];
+    j = pairs[2 * k + 1];
+    nb_[nb_start_[i + 1]++] = j;
+    nb_[nb_start_[j + 1]++] = i;
+  }
+  delete [] pairs;
 }
 
-void God::floyd_warshall()
+/*
+ * Links (pairs i < j) which are not in both old_nb_ and nb_, at most
+ * max.  Returns -1 if there are more.
+ */
+int God::ChangedLinks(int *links, int max)
 {
-  int i, j, k;
-
-  ComputeW();	// the connectivity matrix
+  int i, a, b, a_end, b_end, n = 0;
+
+  for (i = 0; i < num_nodes; i++) {
+    a = old_nb_start_[i];
+    a_end = old_nb_start_[i + 1];
+    b = nb_start_[i];
+    b_end = nb_start_[i + 1];
+    while (a < a_end || b < b_end) {
+      int j;
+      if (b == b_end || (a < a_end && old_nb_[a] < nb_[b]))
+	j = old_nb_[a++];
+      else if (a == a_end || nb_[b] < old_nb_[a])
+	j = nb_[b++];
+      else {
+	a++;
+	b++;
+	continue;
+      }
+      if (j < i)
+	continue;
+      if (n == max)
+	return -1;
+      links[2 * n] = i;
+      links[2 * n + 1] = j;
+      n++;
+    }
+  }
+  return n;
+}
 
-  for(i = 0; i < num_nodes; i++) {
-     for(j = 0; j < num_nodes; j++) {
-	 for(k = 0; k < num_nodes; k++) {
-	    MIN_HOPS(j,k) = MIN(MIN_HOPS(j,k), MIN_HOPS(j,i) + MIN_HOPS(i,k));
-	 }
-     }
+/*
+ * Breadth-first search from src on the neighbor lists.  The neighbors
+ * are queued in increasing order, so that the next hop to each node is
+ * the lowest neighbor of src on a shortest path, as ComputeNextHop used
+ * to pick it.
+ */
+void God::bfs(int src, int *queue)
+{
+  int *hops = &min_hops[src * num_nodes];
+  int *next = &next_hop[src * num_nodes];
+  int head = 0, tail = 0;
+  int i, k, u, v;
+
+  for (i = 0; i < num_nodes; i++) {
+    hops[i] = INFINITY;
+    next[i] = UNREACHABLE;
+  }
+  hops[src] = 0;
+  next[src] = src;       // next hop is itself.
+  queue[tail++] = src;
+
+  while (head < tail) {
+    u = queue[head++];
+    for (k = nb_start_[u]; k < nb_start_[u + 1]; k++) {
+      v = nb_[k];
+      if (hops[v] != INFINITY)
+	continue;
+      hops[v] = hops[u] + 1;
+      next[v] = (u == src) ? v : next[u];
+      queue[tail++] = v;
+    }
   }
+}
 
+#ifdef USE_THREADS
+struct god_bfs_job {
+  God *god;
+  int *sources;
+  int num_sources;
+  int first;
+  int step;
+};
+
+static void *god_bfs_thread(void *arg)
+{
+  god_bfs_job *job = (god_bfs_job *)arg;
+  int *queue = new int[job->god->nodes()];
+
+  for (int i = job->first; i < job->num_sources; i += job->step)
+    job->god->bfs(job->sources[i], queue);
+  delete [] queue;
+  return 0;
+}
+#endif
+
+/*
+ * min_hops and next_hop of all the nodes, by a breadth-first search
+ * from each node: O(n.e) instead of the O(n^3) of Floyd-Warshall.
+ *
+ * In incremental mode, only the sources for which a changed link joins
+ * two nodes at different distances are searched again: the links
+ * between nodes at the same distance from a source are on none of its
+ * shortest paths, before or after the change.
+ */
+void God::ComputeHops()
+{
+  int i, k, n = 0;
+  int *sources = new int[num_nodes];
+
+  ComputeNeighbors();
+
+  int max_links = num_nodes;
+  int *links = new int[2 * max_links];
+  int num_links = -1;
+
+  if (incremental && hops_valid)
+    num_links = ChangedLinks(links, max_links);
+
+  for (i = 0; i < num_nodes; i++) {
+    if (num_links < 0) {
+      sources[n++] = i;
+      continue;
+    }
+    for (k = 0; k < num_links; k++) {
+      if (MIN_HOPS(i, links[2 * k]) != MIN_HOPS(i, links[2 * k + 1])) {
+	sources[n++] = i;
+	break;
+      }
+    }
+  }
+  delete [] links;
+
+#ifdef USE_THREADS
+  int num_threads = MIN(route_threads, n / 16);
+  if (num_threads > 1) {
+    pthread_t *threads = new pthread_t[num_threads];
+    god_bfs_job *jobs = new god_bfs_job[num_threads];
+    bool *started = new bool[num_threads];
+
+    for (i = 0; i < num_threads; i++) {
+      jobs[i].god = this;
+      jobs[i].sources = sources;
+      jobs[i].num_sources = n;
+      jobs[i].first = i;
+      jobs[i].step = num_threads;
+      started[i] = (i > 0 && pthread_create(&threads[i], NULL,
+					    god_bfs_thread, &jobs[i]) == 0);
+    }
+    // this thread takes the first share, and those of the threads
+    // which could not be created
+    for (i = 0; i < num_threads; i++)
+      if (!started[i])
+	god_bfs_thread(&jobs[i]);
+    for (i = 1; i < num_threads; i++)
+      if (started[i])
+	pthread_join(threads[i], NULL);
+    delete [] started;
+    delete [] jobs;
+    delete [] threads;
+  } else
+#endif
+  {
+    int *queue = new int[num_nodes];
+    for (i = 0; i < n; i++)
+      bfs(sources[i], queue);
+    delete [] queue;
+  }
+  delete [] sources;
+  num_bfs = n;
+
+  // nb_ becomes the reference of the next incremental computation
+  int *tmp = old_nb_start_;
+  old_nb_start_ = nb_start_;
+  nb_start_ = tmp;
+  tmp = old_nb_;
+  old_nb_ = nb_;
+  nb_ = tmp;
+  k = old_nb_max_;
+  old_nb_max_ = nb_max_;
+  nb_max_ = k;
+  hops_valid = true;
 
 #ifdef SANITY_CHECKS
 
   for(i = 0; i < num_nodes; i++)
-     for(j = 0; j < num_nodes; j++) {
-	assert(MIN_HOPS(i,j) == MIN_HOPS(j,i));
-	assert(MIN_HOPS(i,j) <= INFINITY);
+     for(k = 0; k < num_nodes; k++) {
+	assert(MIN_HOPS(i,k) == MIN_HOPS(k,i));
+	assert(MIN_HOPS(i,k) <= INFINITY);
      }
 #endif
 
@@ -803,6 +986,31 @@ God::getMyBottomGrid(double x, double y)
 	return(yloc*gridX+xloc);
 }
 
+// Hop count between i and j given by the scenario file
+void
+God::SetDist(int i, int j, int d)
+{
+        assert(i >= 0 && i < num_nodes);
+        assert(j >= 0 && j < num_nodes);
+
+	if (active == true) {
+	  if (NOW > prev_time) {
+	    ComputeRoute();
+	  }
+	}
+	else {
+	  min_hops[i*num_nodes+j] = d;
+	  min_hops[j*num_nodes+i] = d;
+	  hops_valid = false;
+	}
+
+	// The scenario file should set the node positions
+	// before calling set-dist !!
+
+	assert(min_hops[i * num_nodes + j] == d);
+        assert(min_hops[j * num_nodes + i] == d);
+}
+
 int 
 God::command(int argc, const char* const* argv)
 {
@@ -955,6 +1163,36 @@ God::command(int argc, const char* const* argv)
 		  return TCL_OK;
 		}
 
+		// Search again only the sources affected by the link changes
+		if (strcasecmp(argv[1], "incremental") == 0) {
+		  if (strcmp(argv[2], "on") == 0)
+		    incremental = true;
+		  else if (strcmp(argv[2], "off") == 0)
+		    incremental = false;
+		  else {
+		    tcl.resultf("God: incremental on|off");
+		    return TCL_ERROR;
+		  }
+		  return TCL_OK;
+		}
+
+		// Threads of the breadth-first searches
+		if (strcasecmp(argv[1], "route_threads") == 0) {
+		  int n = atoi(argv[2]);
+		  if (n < 1) {
+		    tcl.resultf("God: route_threads must be at least 1");
+		    return TCL_ERROR;
+		  }
+#ifndef USE_THREADS
+		  if (n > 1) {
+		    tcl.resultf("God: ns built without threads (configure --disable-threads)");
+		    return TCL_ERROR;
+		  }
+#endif
+		  route_threads = n;
+		  return TCL_OK;
+		}
+
 		if (strcasecmp(argv[1], "new_node") == 0) {
 		  assert(num_nodes > 0);
 		  MobileNode *obj = (MobileNode *)TclObject::lookup(argv[2]);
@@ -1030,28 +1268,7 @@ God::command(int argc, const char* const* argv)
 		}
 
                 if (strcasecmp(argv[1], "set-dist") == 0) {
-                        int i = atoi(argv[2]);
-                        int j = atoi(argv[3]);
-                        int d = atoi(argv[4]);
-
-                        assert(i >= 0 && i < num_nodes);
-                        assert(j >= 0 && j < num_nodes);
-
-			if (active == true) {
-			  if (NOW > prev_time) {
-			    ComputeRoute();
-			  }
-			}
-			else {
-			  min_hops[i*num_nodes+j] = d;
-			  min_hops[j*num_nodes+i] = d;
-			}
-
-			// The scenario file should set the node positions
-			// before calling set-dist !!
-
-			assert(min_hops[i * num_nodes + j] == d);
-                        assert(min_hops[j * num_nodes + i] == d);
+			SetDist(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
                         return TCL_OK;
                 }
 
@@ -133,6 +133,7 @@ public:
         }
 
         int             hops(int i, int j);
+        void            SetDist(int i, int j, int d);
         static God*     instance() { assert(instance_); return instance_; }
 	int nodes() { return num_nodes; }
 
@@ -171,8 +172,10 @@ public:
         void Dump();               // Dump all internal data
         bool IsReachable(int i, int j);  // Is node i reachable to node j ?
         bool IsNeighbor(int i, int j);   // Is node i a neighbor of node j ?
-        void ComputeW();           // Initialize the connectivity metrix
-        void floyd_warshall();     // Calculate the shortest path
+        void ComputeNeighbors();   // Fill in the neighbor lists
+        void ComputeHops();        // min_hops and next_hop from the neighbor lists
+        void bfs(int src, int *queue);  // min_hops and next_hop of src
+        int  num_bfs;              // sources searched by the last ComputeHops
 
         void AddSink(int dt, int skid);
         void AddSource(int dt, int srcid);
@@ -222,6 +225,16 @@ private:
                               //   the next hop of i where i wants to send
                               //	 a packet to j.
 
+        // Neighbor lists: the neighbors of i are nb_[nb_start_[i]] to
+        // nb_[nb_start_[i+1] - 1], in increasing order.  old_nb_ are
+        // the lists min_hops and next_hop were computed from.
+        int *nb_start_, *nb_, nb_max_;
+        int *old_nb_start_, *old_nb_, old_nb_max_;
+        bool hops_valid;      // min_hops and next_hop match old_nb_
+        bool incremental;     // only search again the sources affected
+        int route_threads;    // threads searching the sources
+        int ChangedLinks(int *links, int max);
+
         int maxX;          // keeping grid demension info: max X, max Y and 
         int maxY;          // grid size
         int gridsize_;
@@ -10,6 +10,8 @@
 #include "gridkeeper.h"
 #include <sys/param.h> /* For MIN/MAX */
 
+static EventPool<MoveEvent> move_pool("MoveEvent");
+
 static double d2(double x1, double x2, double y1, double y2)
 {
   return ((x1-x2)*(x1-x2)+(y1-y2)*(y1-y2));
@@ -42,7 +44,7 @@ void GridHandler::handle(Event *e)
     token_->next() = *pptr;
     *pptr = token_;
   }
-  delete me;
+  move_pool.release(me);
 
   // dump info in the gridkeeper for debug only
   // dump();
@@ -139,7 +141,7 @@ void GridKeeper::new_moves(MobileNode *mn)
       tm = (i-x)/vx;
       pother = vy*tm + y;
       j = (int)pother;
-      me = new MoveEvent;
+      me = move_pool.alloc();
       if (j == pother && j != 0 && j != dim_y_) {
 	if (vy > 0) gother = j - 1;
 	else if (vy < 0) gother = j + 1;
@@ -164,7 +166,7 @@ void GridKeeper::new_moves(MobileNode *mn)
       tm = (i-x)/vx;
       pother = vy*tm + y;
       j = (int)pother;
-      me = new MoveEvent;
+      me = move_pool.alloc();
       if (j == pother && j != 0 && j != dim_y_) {
 	if (vy > 0) gother = j - 1;
 	else if (vy < 0) gother = j + 1;
@@ -188,8 +190,8 @@ void GridKeeper::new_moves(MobileNode *mn)
       tm = (j-y)/vy;
       pother = vx*tm + x;
       i = (int)pother;
-      me = new MoveEvent;
       if (i == pother && i != 0 && i != dim_x_ && vx != 0) continue;
+      me = move_pool.alloc();
       me->leave_ = &grid_[aligngrid(i, dim_x_)][aligngrid(j-1, dim_y_)];
 
       me->grid_x_ = grid_x = aligngrid(i, dim_x_);
@@ -207,8 +209,8 @@ void GridKeeper::new_moves(MobileNode *mn)
       tm = (j-y)/vy;
       pother = vx*tm + x;
       i = (int)pother;
-      me = new MoveEvent;
       if (i == pother && i != 0 && i != dim_x_ && vx != 0) continue;
+      me = move_pool.alloc();
       me->leave_ = &grid_[aligngrid(i, dim_x_)][aligngrid(j, dim_y_)];
 
       me->grid_x_ = grid_x = aligngrid(i, dim_x_);
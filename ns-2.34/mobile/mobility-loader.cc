@@ -0,0 +1,563 @@
+/* -*-	Mode:C++; c-basic-offset:8; tab-width:8; indent-tabs-mode:t -*- */
+/*
+ * Native loader of mobility scenarios.
+ *
+ * Usage:
+ *	set ml [new MobilityLoader]
+ *	$ml load scen.tcl		;# setdest scenario, or binary image
+ *	$ml load-bonnmotion scen.movements
+ *	$ml save scen.bin		;# binary image of what was loaded
+ *	$ml node-array node_		;# Tcl array of the nodes
+ *
+ * or simply "$ns load-mobility file ?bonnmotion?".
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "mobilenode.h"
+#include "god.h"
+#include "mobility-loader.h"
+
+static class MobilityLoaderClass : public TclClass {
+public:
+	MobilityLoaderClass() : TclClass("MobilityLoader") {}
+	TclObject* create(int, const char*const*) {
+		return (new MobilityLoader);
+	}
+} class_mobility_loader;
+
+/* Stable sorts keep the order of the file for simultaneous records */
+static bool leg_before(const mobility_leg& a, const mobility_leg& b)
+{
+	return a.time_ < b.time_;
+}
+
+static bool record_before(const mobility_record& a, const mobility_record& b)
+{
+	return a.time_ < b.time_;
+}
+
+static void append(mobility_record*& a, int& n, int& max, mobility_record* r)
+{
+	if (n == max) {
+		max = max ? 2 * max : 256;
+		mobility_record* na = new mobility_record[max];
+		if (n)
+			memcpy(na, a, n * sizeof(mobility_record));
+		delete [] a;
+		a = na;
+	}
+	a[n++] = *r;
+}
+
+// Reads a line of any length into buf, without its newline
+static char* read_line(FILE* fp, char*& buf, int& size)
+{
+	int n = 0;
+	for (;;) {
+		if (fgets(buf + n, size - n, fp) == 0) {
+			if (n == 0)
+				return 0;
+			break;
+		}
+		n += strlen(buf + n);
+		if (buf[n - 1] == '\n' || n < size - 1)
+			break;
+		char* nb = new char[size * 2];
+		memcpy(nb, buf, n + 1);
+		delete [] buf;
+		buf = nb;
+		size *= 2;
+	}
+	while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r'))
+		buf[--n] = 0;
+	return buf;
+}
+
+MobilityLoader::MobilityLoader() : recs_(0), nrecs_(0), maxrecs_(0),
+	tracks_(0), ntracks_(0), initial_(0), ninitial_(0), maxinitial_(0),
+	dists_(0), ndists_(0), maxdists_(0), nextdist_(0), dist_pending_(0)
+{
+	strcpy(array_, "node_");
+}
+
+MobilityLoader::~MobilityLoader()
+{
+	Scheduler& s = Scheduler::instance();
+	for (int i = 0; i < ntracks_; i++) {
+		if (tracks_[i] == 0)
+			continue;
+		if (tracks_[i]->pending_)
+			s.cancel(tracks_[i]);
+		delete tracks_[i];
+	}
+	if (dist_pending_)
+		s.cancel(&dist_ev_);
+	delete [] tracks_;
+	delete [] recs_;
+	delete [] initial_;
+	delete [] dists_;
+}
+
+int
+MobilityLoader::command(int argc, const char*const* argv)
+{
+	Tcl& tcl = Tcl::instance();
+	if (argc == 3) {
+		if (strcmp(argv[1], "node-array") == 0) {
+			if (strlen(argv[2]) >= sizeof(array_)) {
+				tcl.resultf("%s: array name too long", argv[2]);
+				return TCL_ERROR;
+			}
+			strcpy(array_, argv[2]);
+			return TCL_OK;
+		}
+		if (strcmp(argv[1], "save") == 0)
+			return save(argv[2]);
+		if (strcmp(argv[1], "load") == 0 ||
+		    strcmp(argv[1], "load-bonnmotion") == 0) {
+			FILE* fp = fopen(argv[2], "r");
+			if (fp == 0) {
+				tcl.resultf("%s: cannot open", argv[2]);
+				return TCL_ERROR;
+			}
+			char magic[8];
+			int st;
+			if (strcmp(argv[1], "load-bonnmotion") == 0)
+				st = read_bonnmotion(fp, argv[2]);
+			else if (fread(magic, 1, 8, fp) == 8 &&
+				 memcmp(magic, MOBILITY_MAGIC, 8) == 0)
+				st = read_binary(fp, argv[2]);
+			else {
+				rewind(fp);
+				st = read_text(fp, argv[2]);
+			}
+			fclose(fp);
+			if (st == TCL_OK)
+				st = add_records();
+			nrecs_ = 0;
+			return st;
+		}
+	}
+	return TclObject::command(argc, argv);
+}
+
+void
+MobilityLoader::add(mobility_record* r)
+{
+	append(recs_, nrecs_, maxrecs_, r);
+}
+
+/*
+ * Lines written by setdest are turned into records; any other command is
+ * evaluated by Tcl once the records before it are in place.  A command
+ * spans as many lines as Tcl needs to complete it.
+ */
+int
+MobilityLoader::read_text(FILE* fp, const char* file)
+{
+	Tcl& tcl = Tcl::instance();
+	int size = 256;
+	char* buf = new char[size];
+	char ns[64], obj[64], c;
+	int st = TCL_OK, lineno = 0, cmdline = 0;
+	mobility_record r;
+	Tcl_DString cmd;
+
+	Tcl_DStringInit(&cmd);
+	while (st == TCL_OK && read_line(fp, buf, size) != 0) {
+		lineno++;
+		char* p = buf;
+		if (Tcl_DStringLength(&cmd) == 0) {
+			while (*p == ' ' || *p == '\t')
+				p++;
+			if (*p == 0 || *p == '#')
+				continue;
+			int i, j, d;
+			memset(&r, 0, sizeof(r));
+			if (sscanf(p, "$%63s at %lf \"$%63[^(](%d) setdest %lf %lf %lf",
+				   ns, &r.time_, obj, &r.node_,
+				   &r.a_, &r.b_, &r.c_) == 7) {
+				r.kind_ = MOBILITY_SETDEST;
+				strcpy(array_, obj);
+			} else if (sscanf(p, "$%63s at %lf \"$%63s set-dist %d %d %d",
+					  ns, &r.time_, obj, &i, &j, &d) == 6) {
+				r.kind_ = MOBILITY_DIST;
+				r.node_ = i;
+				r.a_ = j;
+				r.b_ = d;
+			} else if (sscanf(p, "$%63[^(](%d) set %c_ %lf",
+					  obj, &r.node_, &c, &r.a_) == 4 &&
+				   strchr(obj, ' ') == 0 && c >= 'X' && c <= 'Z') {
+				r.kind_ = MOBILITY_X + (c - 'X');
+				strcpy(array_, obj);
+			} else if (sscanf(p, "$%63s set-dist %d %d %d",
+					  obj, &i, &j, &d) == 4) {
+				r.kind_ = MOBILITY_DIST;
+				r.time_ = -1;
+				r.node_ = i;
+				r.a_ = j;
+				r.b_ = d;
+			} else
+				cmdline = lineno;
+			if (cmdline != lineno) {
+				add(&r);
+				continue;
+			}
+		}
+		Tcl_DStringAppend(&cmd, p, -1);
+		Tcl_DStringAppend(&cmd, "\n", 1);
+		if (!Tcl_CommandComplete(Tcl_DStringValue(&cmd)))
+			continue;
+		if ((st = add_records()) == TCL_OK)
+			st = tcl.eval(Tcl_DStringValue(&cmd));
+		nrecs_ = 0;
+		if (st != TCL_OK)
+			tcl.resultf("%s:%d: %s", file, cmdline,
+				    Tcl_DStringValue(&cmd));
+		Tcl_DStringSetLength(&cmd, 0);
+	}
+	if (st == TCL_OK && Tcl_DStringLength(&cmd) != 0) {
+		tcl.resultf("%s:%d: command not complete at end of file",
+			    file, cmdline);
+		st = TCL_ERROR;
+	}
+	Tcl_DStringFree(&cmd);
+	delete [] buf;
+	return st;
+}
+
+/*
+ * BonnMotion movements: line i lists the waypoints "t x y" of node i.
+ * The node leaves each waypoint at its time, towards the next one, at
+ * the speed that gets it there on time.
+ */
+int
+MobilityLoader::read_bonnmotion(FILE* fp, const char* file)
+{
+	int size = 4096;
+	char* buf = new char[size];
+	mobility_record r;
+
+	for (int node = 0; read_line(fp, buf, size) != 0; node++) {
+		char* p = buf;
+		char* end;
+		double w[3], prev[3];
+		int n;
+		for (n = 0; ; n++) {
+			int k;
+			for (k = 0; k < 3; k++) {
+				w[k] = strtod(p, &end);
+				if (end == p)
+					break;
+				p = end;
+			}
+			if (k < 3)
+				break;
+			memset(&r, 0, sizeof(r));
+			r.node_ = node;
+			if (n == 0) {
+				r.kind_ = MOBILITY_X;
+				r.a_ = w[1];
+				add(&r);
+				r.kind_ = MOBILITY_Y;
+				r.a_ = w[2];
+				add(&r);
+			} else if (w[0] > prev[0] &&
+				   (w[1] != prev[1] || w[2] != prev[2])) {
+				double dx = w[1] - prev[1], dy = w[2] - prev[2];
+				r.kind_ = MOBILITY_SETDEST;
+				r.time_ = prev[0];
+				r.a_ = w[1];
+				r.b_ = w[2];
+				r.c_ = sqrt(dx * dx + dy * dy) / (w[0] - prev[0]);
+				add(&r);
+			}
+			memcpy(prev, w, sizeof(w));
+		}
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p != 0) {
+			Tcl::instance().resultf("%s:%d: not a 2D waypoint list",
+						file, node + 1);
+			delete [] buf;
+			return TCL_ERROR;
+		}
+	}
+	delete [] buf;
+	return TCL_OK;
+}
+
+// Binary images are in the byte order of the host that saved them
+int
+MobilityLoader::read_binary(FILE* fp, const char* file)
+{
+	int32_t n;
+	if (fread(&n, sizeof(n), 1, fp) != 1 || n < 0) {
+		Tcl::instance().resultf("%s: truncated header", file);
+		return TCL_ERROR;
+	}
+	if (n > maxrecs_) {
+		delete [] recs_;
+		maxrecs_ = n;
+		recs_ = new mobility_record[maxrecs_];
+	}
+	if (fread(recs_, sizeof(mobility_record), n, fp) != (size_t)n) {
+		Tcl::instance().resultf("%s: truncated", file);
+		return TCL_ERROR;
+	}
+	nrecs_ = n;
+	return TCL_OK;
+}
+
+int
+MobilityLoader::save(const char* file)
+{
+	FILE* fp = fopen(file, "w");
+	if (fp == 0) {
+		Tcl::instance().resultf("%s: cannot open", file);
+		return TCL_ERROR;
+	}
+	int32_t n = ninitial_ + ndists_;
+	int i, j;
+	for (i = 0; i < ntracks_; i++)
+		if (tracks_[i])
+			n += tracks_[i]->nlegs_;
+	fwrite(MOBILITY_MAGIC, 1, 8, fp);
+	fwrite(&n, sizeof(n), 1, fp);
+	fwrite(initial_, sizeof(mobility_record), ninitial_, fp);
+	for (i = 0; i < ntracks_; i++) {
+		MobilityTrack* t = tracks_[i];
+		if (t == 0)
+			continue;
+		for (j = 0; j < t->nlegs_; j++) {
+			mobility_record r;
+			memset(&r, 0, sizeof(r));
+			r.time_ = t->legs_[j].time_;
+			r.a_ = t->legs_[j].x_;
+			r.b_ = t->legs_[j].y_;
+			r.c_ = t->legs_[j].speed_;
+			r.node_ = i;
+			r.kind_ = MOBILITY_SETDEST;
+			fwrite(&r, sizeof(r), 1, fp);
+		}
+	}
+	fwrite(dists_, sizeof(mobility_record), ndists_, fp);
+	if (fclose(fp) != 0) {
+		Tcl::instance().resultf("%s: write error", file);
+		return TCL_ERROR;
+	}
+	return TCL_OK;
+}
+
+// Waypoint queue of node i of the Tcl array, 0 if there is no such node
+MobilityTrack*
+MobilityLoader::track(int i)
+{
+	if (i < 0)
+		return 0;
+	if (i >= ntracks_) {
+		int n = ntracks_ ? ntracks_ : 64;
+		while (n <= i)
+			n *= 2;
+		MobilityTrack** nt = new MobilityTrack*[n];
+		memset(nt, 0, n * sizeof(MobilityTrack*));
+		if (ntracks_)
+			memcpy(nt, tracks_, ntracks_ * sizeof(MobilityTrack*));
+		delete [] tracks_;
+		tracks_ = nt;
+		ntracks_ = n;
+	}
+	if (tracks_[i] == 0) {
+		char index[16];
+		sprintf(index, "%d", i);
+		const char* name = Tcl_GetVar2(Tcl::instance().interp(), array_,
+					       index, TCL_GLOBAL_ONLY);
+		if (name == 0)
+			return 0;
+		MobileNode* node = (MobileNode*)TclObject::lookup(name);
+		if (node == 0)
+			return 0;
+		tracks_[i] = new MobilityTrack;
+		tracks_[i]->node_ = node;
+		tracks_[i]->id_ = i;
+	}
+	return tracks_[i];
+}
+
+/*
+ * Checks recs_ before any of it is applied: the nodes must exist, set-dist
+ * must name nodes God knows of and legs must end on the topography, as
+ * MobileNode::set_destination() would refuse them later on.
+ */
+int
+MobilityLoader::check_records()
+{
+	Tcl& tcl = Tcl::instance();
+	for (int i = 0; i < nrecs_; i++) {
+		mobility_record* r = &recs_[i];
+		if (r->kind_ == MOBILITY_DIST) {
+			God* god = God::instance();
+			if (god == 0) {
+				tcl.resultf("set-dist %d %d without a God",
+					    r->node_, (int)r->a_);
+				return TCL_ERROR;
+			}
+			int n = god->nodes();
+			if (r->node_ < 0 || r->node_ >= n ||
+			    r->a_ < 0 || r->a_ >= n) {
+				tcl.resultf("set-dist %d %d: God has %d nodes",
+					    r->node_, (int)r->a_, n);
+				return TCL_ERROR;
+			}
+			continue;
+		}
+		if (r->kind_ < MOBILITY_SETDEST || r->kind_ > MOBILITY_Z) {
+			tcl.resultf("bad mobility record kind %d", r->kind_);
+			return TCL_ERROR;
+		}
+		MobilityTrack* t = track(r->node_);
+		if (t == 0) {
+			tcl.resultf("no node %s(%d)", array_, r->node_);
+			return TCL_ERROR;
+		}
+		Topography* T = t->node_->topography();
+		if (r->kind_ == MOBILITY_SETDEST && T &&
+		    (r->a_ >= T->upperX() || r->a_ <= T->lowerX() ||
+		     r->b_ >= T->upperY() || r->b_ <= T->lowerY())) {
+			tcl.resultf("%s(%d) setdest %f %f at %f is off the "
+				    "topography", array_, r->node_,
+				    r->a_, r->b_, r->time_);
+			return TCL_ERROR;
+		}
+	}
+	return TCL_OK;
+}
+
+/*
+ * Applies the positions and untimed set-dist of recs_ right away, as
+ * sourcing the scenario would, and queues its legs and timed set-dist.
+ */
+int
+MobilityLoader::add_records()
+{
+	int i;
+	if (check_records() != TCL_OK)
+		return TCL_ERROR;
+	for (i = 0; i < nrecs_; i++) {
+		mobility_record* r = &recs_[i];
+		if (r->kind_ == MOBILITY_DIST) {
+			if (r->time_ < 0) {
+				God::instance()->SetDist(r->node_, (int)r->a_,
+							 (int)r->b_);
+				append(initial_, ninitial_, maxinitial_, r);
+			} else
+				append(dists_, ndists_, maxdists_, r);
+			continue;
+		}
+		MobilityTrack* t = track(r->node_);
+		switch (r->kind_) {
+		case MOBILITY_SETDEST:
+			if (t->nlegs_ == t->maxlegs_) {
+				t->maxlegs_ = t->maxlegs_ ? 2 * t->maxlegs_ : 16;
+				mobility_leg* nl = new mobility_leg[t->maxlegs_];
+				if (t->nlegs_)
+					memcpy(nl, t->legs_,
+					       t->nlegs_ * sizeof(mobility_leg));
+				delete [] t->legs_;
+				t->legs_ = nl;
+			}
+			t->legs_[t->nlegs_].time_ = r->time_;
+			t->legs_[t->nlegs_].x_ = r->a_;
+			t->legs_[t->nlegs_].y_ = r->b_;
+			t->legs_[t->nlegs_].speed_ = r->c_;
+			t->nlegs_++;
+			continue;
+		case MOBILITY_X:
+			t->node_->X_ = r->a_;
+			break;
+		case MOBILITY_Y:
+			t->node_->Y_ = r->a_;
+			break;
+		case MOBILITY_Z:
+			t->node_->Z_ = r->a_;
+			break;
+		}
+		append(initial_, ninitial_, maxinitial_, r);
+	}
+
+	for (i = 0; i < ntracks_; i++) {
+		MobilityTrack* t = tracks_[i];
+		if (t == 0)
+			continue;
+		std::stable_sort(t->legs_ + t->next_leg_, t->legs_ + t->nlegs_,
+				 leg_before);
+		schedule(t);
+	}
+	std::stable_sort(dists_ + nextdist_, dists_ + ndists_, record_before);
+	schedule_dists();
+	return TCL_OK;
+}
+
+// (Re)schedules the event of t at the time of its next leg
+void
+MobilityLoader::schedule(MobilityTrack* t)
+{
+	Scheduler& s = Scheduler::instance();
+	if (t->pending_) {
+		s.cancel(t);
+		t->pending_ = 0;
+	}
+	if (t->next_leg_ == t->nlegs_)
+		return;
+	double delay = t->legs_[t->next_leg_].time_ - s.clock();
+	s.schedule(this, t, delay > 0 ? delay : 0);
+	t->pending_ = 1;
+}
+
+void
+MobilityLoader::schedule_dists()
+{
+	Scheduler& s = Scheduler::instance();
+	if (dist_pending_) {
+		s.cancel(&dist_ev_);
+		dist_pending_ = 0;
+	}
+	if (nextdist_ == ndists_)
+		return;
+	double delay = dists_[nextdist_].time_ - s.clock();
+	s.schedule(this, &dist_ev_, delay > 0 ? delay : 0);
+	dist_pending_ = 1;
+}
+
+/*
+ * Starts the next leg of a node, or the next set-dist; records of the
+ * same time are applied in the order of the file, the last leg wins.
+ */
+void
+MobilityLoader::handle(Event* e)
+{
+	if (e == &dist_ev_) {
+		God* god = God::instance();
+		double now = dists_[nextdist_].time_;
+		dist_pending_ = 0;
+		do {
+			mobility_record* r = &dists_[nextdist_++];
+			god->SetDist(r->node_, (int)r->a_, (int)r->b_);
+		} while (nextdist_ < ndists_ && dists_[nextdist_].time_ <= now);
+		schedule_dists();
+		return;
+	}
+
+	MobilityTrack* t = (MobilityTrack*)e;
+	double now = t->legs_[t->next_leg_].time_;
+	t->pending_ = 0;
+	do {
+		// check_records() kept off-topography legs out
+		mobility_leg* l = &t->legs_[t->next_leg_++];
+		t->node_->set_destination(l->x_, l->y_, l->speed_);
+	} while (t->next_leg_ < t->nlegs_ && t->legs_[t->next_leg_].time_ <= now);
+	schedule(t);
+}
@@ -0,0 +1,110 @@
+/* -*-	Mode:C++; c-basic-offset:8; tab-width:8; indent-tabs-mode:t -*- */
+/*
+ * Native loader of mobility scenarios.
+ *
+ * A setdest scenario ("$ns_ at t \"$node_(i) setdest x y s\"" lines,
+ * see indep-utils/cmu-scen-gen/setdest), a BonnMotion movements file
+ * or its binary image is read straight into per-node waypoint queues.
+ * Each node has a single pending event that moves it along its next leg,
+ * instead of one Tcl "at" string per leg.
+ */
+
+#ifndef ns_mobility_loader_h
+#define ns_mobility_loader_h
+
+#include <stdio.h>
+#include "object.h"
+#include "scheduler.h"
+
+class MobileNode;
+
+// Kinds of the records of a scenario
+#define MOBILITY_SETDEST	0	// at time_: node_ setdest a_ b_ c_
+#define MOBILITY_X		1	// node_ set X_ a_
+#define MOBILITY_Y		2	// node_ set Y_ a_
+#define MOBILITY_Z		3	// node_ set Z_ a_
+#define MOBILITY_DIST		4	// at time_ (now if < 0): god set-dist node_ a_ b_
+
+// Magic of the binary scenario files
+#define MOBILITY_MAGIC		"NSMOBIL1"
+
+/* One record of a scenario, also the layout of the binary files */
+struct mobility_record {
+	double time_;
+	double a_;
+	double b_;
+	double c_;
+	int32_t node_;
+	int32_t kind_;
+};
+
+/* One leg of a node: at time_ head to (x_, y_) at speed_ */
+struct mobility_leg {
+	double time_;
+	double x_;
+	double y_;
+	double speed_;
+};
+
+/* Waypoint queue of one node, and its pending event */
+class MobilityTrack : public Event {
+public:
+	MobilityTrack() : node_(0), id_(-1), legs_(0), nlegs_(0), maxlegs_(0),
+			  next_leg_(0), pending_(0) {}
+	~MobilityTrack() { delete [] legs_; }
+
+	MobileNode* node_;
+	int id_;		// index in the Tcl array of the nodes
+	mobility_leg* legs_;	// sorted by time
+	int nlegs_;
+	int maxlegs_;
+	int next_leg_;		// first leg not started yet
+	int pending_;		// scheduled at the time of legs_[next_leg_]
+};
+
+class MobilityLoader : public TclObject, public Handler {
+public:
+	MobilityLoader();
+	~MobilityLoader();
+	int command(int argc, const char*const* argv);
+	void handle(Event* e);
+
+protected:
+	int read_text(FILE* fp, const char* file);
+	int read_bonnmotion(FILE* fp, const char* file);
+	int read_binary(FILE* fp, const char* file);
+	int save(const char* file);
+
+	void add(mobility_record* r);
+	int check_records();
+	int add_records();
+	MobilityTrack* track(int i);
+	void schedule(MobilityTrack* t);
+	void schedule_dists();
+
+	char array_[64];	// Tcl array of the nodes, node_ by default
+
+	/* Records read from the file being loaded */
+	mobility_record* recs_;
+	int nrecs_;
+	int maxrecs_;
+
+	/* Waypoint queues, indexed by node */
+	MobilityTrack** tracks_;
+	int ntracks_;
+
+	/* Positions and untimed set-dist, replayed by save */
+	mobility_record* initial_;
+	int ninitial_;
+	int maxinitial_;
+
+	/* Timed set-dist, sorted by time */
+	mobility_record* dists_;
+	int ndists_;
+	int maxdists_;
+	int nextdist_;
+	Event dist_ev_;
+	int dist_pending_;
+};
+
+#endif // ns_mobility_loader_h
@@ -134,10 +134,26 @@ double Nakagami::Pr(PacketStamp *t, PacketStamp *r, WirelessPhy *ifp)
 	Yt += t->getAntenna()->getY();
 	Zt += t->getAntenna()->getZ();
 
+	double dist;
+	double Pr;
+
+	// the link did not move: only draw the Nakagami fading
+	link_gain *link = NULL;
+	double loc[6] = { Xt, Yt, Zt, Xr, Yr, Zr };
+	if (cache_links_) {
+		int valid;
+		link = links_.lookup(t->getNode(), r->getNode(), lambda, L, loc, &valid);
+		if (valid) {
+			dist = link->dist;
+			Pr = t->getTxPr() * link->gain;
+			return fading(Pr, dist);
+		}
+	}
+
 	double dX = Xr - Xt;
 	double dY = Yr - Yt;
 	double dZ = Zr - Zt;
-	double dist = sqrt(dX * dX + dY * dY + dZ * dZ);
+	dist = sqrt(dX * dX + dY * dY + dZ * dZ);
  
 	// get antenna gain
  	double Gt = t->getAntenna()->getTxGain(dX, dY, dZ, lambda);
@@ -163,8 +179,18 @@ double Nakagami::Pr(PacketStamp *t, PacketStamp *r, WirelessPhy *ifp)
 	}
 
     // calculate the receiving power at distance dist
- 	double Pr = Pr0 * pow(10.0, -path_loss_dB/10.0);
+ 	Pr = Pr0 * pow(10.0, -path_loss_dB/10.0);
+
+	if (link)
+		links_.store(link, L, loc, Friis(1.0, Gt, Gr, lambda, L, d_ref) *
+			     pow(10.0, -path_loss_dB/10.0), dist);
 	
+	return fading(Pr, dist);
+}	
+
+// Nakagami distributed power around the mean reception power Pr
+double Nakagami::fading(double Pr, double dist)
+{
  	if (!use_nakagami_dist_) {
  		return Pr; 
  	} else {
@@ -188,11 +214,11 @@ double Nakagami::Pr(PacketStamp *t, PacketStamp *r, WirelessPhy *ifp)
  		}
  		return resultPower;
 	}
-}	
+}
 
 int Nakagami::command(int argc, const char* const* argv)
 {
-	return 0;
+	return Propagation::command(argc, argv);
 }
 
 
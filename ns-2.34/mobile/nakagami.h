@@ -72,6 +72,8 @@ public:
 	virtual int command(int argc, const char*const* argv);
 	virtual double getDist(double Pr, double Pt, double Gt, double Gr, double hr, double ht, double L, double lambda);
 protected:
+	double fading(double Pr, double dist);
+
 	RNG *ranVar;	// random number generator for normal distribution
 	double gamma0,gamma1, gamma2;
 	double d0_gamma,d1_gamma;
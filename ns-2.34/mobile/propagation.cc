@@ -36,6 +36,8 @@
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 
 #include <topography.h>
 #include <propagation.h>
@@ -47,8 +49,29 @@ Propagation::command(int argc, const char*const* argv)
 {
   TclObject *obj;  
 
+  if(argc == 2)
+    {
+      if (strcasecmp(argv[1], "link-cache-stats") == 0)
+	{
+	  Tcl::instance().resultf("%lu %lu", links_.hits, links_.misses);
+	  return TCL_OK;
+	}
+    }
   if(argc == 3) 
     {
+      // link-cache on|off: cache the deterministic part of Pr per link
+      if (strcasecmp(argv[1], "link-cache") == 0) 
+	{
+	  if (strcasecmp(argv[2], "on") == 0 || strcmp(argv[2], "1") == 0)
+	    cache_links_ = 1;
+	  else if (strcasecmp(argv[2], "off") == 0 || strcmp(argv[2], "0") == 0) {
+	    cache_links_ = 0;
+	    links_.clear();
+	  } else
+	    return TCL_ERROR;
+	  return TCL_OK;
+	}
+
       if( (obj = TclObject::lookup(argv[2])) == 0) 
 	{
 	  fprintf(stderr, "Propagation: %s lookup of %s failed\n", argv[1],
@@ -66,6 +89,110 @@ Propagation::command(int argc, const char*const* argv)
 }
  
 
+/* Link gain cache */
+
+LinkGainCache::LinkGainCache() : hits(0), misses(0), buckets_(NULL),
+				 nbuckets_(0), nentries_(0)
+{
+}
+
+LinkGainCache::~LinkGainCache()
+{
+	clear();
+}
+
+static inline unsigned int
+link_hash(MobileNode *tx, MobileNode *rx)
+{
+	uintptr_t h = ((uintptr_t)tx >> 3) * 2654435761U;
+	h ^= ((uintptr_t)rx >> 3) + (h << 6) + (h >> 2);
+	return (unsigned int)h;
+}
+
+link_gain *
+LinkGainCache::lookup(MobileNode *tx, MobileNode *rx, double lambda,
+		      double L, const double *loc, int *valid)
+{
+	link_gain *link;
+	unsigned int b;
+
+	if (nentries_ >= nbuckets_)
+		grow();
+
+	b = link_hash(tx, rx) & (nbuckets_ - 1);
+	for (link = buckets_[b]; link; link = link->next)
+		if (link->tx == tx && link->rx == rx && link->lambda == lambda)
+			break;
+
+	if (link == NULL) {
+		link = new link_gain;
+		link->tx = tx;
+		link->rx = rx;
+		link->lambda = lambda;
+		link->L = -1.0;	// never valid before store()
+		link->next = buckets_[b];
+		buckets_[b] = link;
+		nentries_++;
+		*valid = 0;
+	} else
+		*valid = (link->L == L && memcmp(link->loc, loc, sizeof(link->loc)) == 0);
+
+	if (*valid)
+		hits++;
+	else
+		misses++;
+	return link;
+}
+
+void
+LinkGainCache::store(link_gain *link, double L, const double *loc,
+		     double gain, double dist)
+{
+	link->L = L;
+	memcpy(link->loc, loc, sizeof(link->loc));
+	link->gain = gain;
+	link->dist = dist;
+}
+
+void
+LinkGainCache::grow()
+{
+	unsigned int n = nbuckets_ ? 2 * nbuckets_ : 256;
+	link_gain **buckets = new link_gain*[n];
+	link_gain *link, *next;
+	unsigned int i, b;
+
+	for (i = 0; i < n; i++)
+		buckets[i] = NULL;
+	for (i = 0; i < nbuckets_; i++)
+		for (link = buckets_[i]; link; link = next) {
+			next = link->next;
+			b = link_hash(link->tx, link->rx) & (n - 1);
+			link->next = buckets[b];
+			buckets[b] = link;
+		}
+	delete [] buckets_;
+	buckets_ = buckets;
+	nbuckets_ = n;
+}
+
+void
+LinkGainCache::clear()
+{
+	link_gain *link, *next;
+
+	for (unsigned int i = 0; i < nbuckets_; i++)
+		for (link = buckets_[i]; link; link = next) {
+			next = link->next;
+			delete link;
+		}
+	delete [] buckets_;
+	buckets_ = NULL;
+	nbuckets_ = 0;
+	nentries_ = 0;
+}
+
+
 /* As new network-intefaces are added, add a default method here */
 
 double
@@ -51,6 +51,53 @@
 
 class PacketStamp;
 class WirelessPhy;
+class MobileNode;
+
+/*======================================================================
+   Link gain cache
+
+	Deterministic part of the received power of a link (Pr / Pt)
+	for the antenna positions it was computed with. Propagation
+	models look it up before computing the path loss, so that on
+	static links only the random fading is drawn per packet.
+
+   ====================================================================== */
+
+struct link_gain {
+	MobileNode *tx;
+	MobileNode *rx;
+	double lambda;		// wavelength
+	double L;		// system loss
+	double loc[6];		// antenna positions: Xt, Yt, Zt, Xr, Yr, Zr
+	double gain;		// Pr / Pt, without the random fading
+	double dist;		// distance between the antennas
+	link_gain *next;
+};
+
+class LinkGainCache {
+public:
+	LinkGainCache();
+	~LinkGainCache();
+
+	// Returns the entry of the link (tx, rx, lambda), allocated if
+	// needed. *valid is set if the entry holds a gain computed for 
+	// the same antenna positions and system loss.
+	link_gain *lookup(MobileNode *tx, MobileNode *rx, double lambda,
+			  double L, const double *loc, int *valid);
+	void store(link_gain *link, double L, const double *loc,
+		   double gain, double dist);
+	void clear();
+
+	unsigned long hits;
+	unsigned long misses;
+
+private:
+	void grow();
+
+	link_gain **buckets_;
+	unsigned int nbuckets_;		// power of 2
+	unsigned int nentries_;
+};
 /*======================================================================
    Progpagation Models
 
@@ -67,7 +114,7 @@ class WirelessPhy;
 class Propagation : public TclObject {
 
 public:
-  Propagation() : name(NULL), topo(NULL) {}
+  Propagation() : name(NULL), topo(NULL), cache_links_(0) {}
 
   // calculate the Pr by which the receiver will get a packet sent by
   // the node that applied the tx PacketStamp for a given inteface 
@@ -94,6 +141,9 @@ public:
 protected:
   char *name;
   Topography *topo;
+
+  int cache_links_;		// "link-cache on": use links_
+  LinkGainCache links_;
 };
 
 
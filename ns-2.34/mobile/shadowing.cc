@@ -112,6 +112,17 @@ double Shadowing::Pr(PacketStamp *t, PacketStamp *r, WirelessPhy *ifp)
 	Yt += t->getAntenna()->getY();
 	Zt += t->getAntenna()->getZ();
 
+	// the link did not move: only draw the shadowing
+	link_gain *link = NULL;
+	double loc[6] = { Xt, Yt, Zt, Xr, Yr, Zr };
+	if (cache_links_) {
+		int valid;
+		link = links_.lookup(t->getNode(), r->getNode(), lambda, L, loc, &valid);
+		if (valid)
+			return t->getTxPr() * link->gain *
+				pow(10.0, ranVar->normal(0.0, std_db_)/10.0);
+	}
+
 	double dX = Xr - Xt;
 	double dY = Yr - Yt;
 	double dZ = Zr - Zt;
@@ -132,6 +143,10 @@ double Shadowing::Pr(PacketStamp *t, PacketStamp *r, WirelessPhy *ifp)
             avg_db = 0.0;
         }
    
+	if (link)
+		links_.store(link, L, loc, Friis(1.0, Gt, Gr, lambda, L, dist0_) *
+			     pow(10.0, avg_db/10.0), dist);
+
 	// get power loss by adding a log-normal random variable (shadowing)
 	// the power loss is relative to that at reference distance dist0_
 	double powerLoss_db = avg_db + ranVar->normal(0.0, std_db_);
@@ -35,11 +35,13 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <sys/param.h>  /* for MIN/MAX */
 
 #include "object.h"
 
 #include "dem.h"
 #include "topography.h"
+#include "mobilenode.h"
 
 
 static class TopographyClass : public TclClass {
@@ -125,22 +127,249 @@ Topography::load_demfile(const char *fname)
 }
 
 
-void 
-Topography::updateNodesList(class MobileNode* mn, double oldX)
+Topography::Topography() : numNodes_(0), maxNodes_(0), nodes_(NULL),
+			   cells_(NULL), gridX_(0), gridY_(0),
+			   gridOriginX_(0.0), gridOriginY_(0.0),
+			   gridCellSize_(0.0), lastRefresh_(0.0), maxSpeed_(0.0),
+			   sorted_(false),
+			   affected_(NULL)
 {
-	//Added by Deepti  -- start
-	printf("[DS-TOPO] Number of Channels = %d Topography::updateNodesList\n", nchannels);
-	if(nchannels==0) {
-		channel_->updateNodesList(mn, oldX);
-	} else {
-		//update the position over each channel
-		for(int i=0;i<nchannels;i++) {
-			multichannel_[i]->updateNodesList(mn, oldX);
+	maxX = maxY = grid_resolution = 0.0;
+	grid = 0;
+}
+
+/* A node is in the index as soon as it is on the topography. Its
+ * channels only set its bits in MobileNode::channels_, so that a
+ * position update costs the same whatever the number of channels.
+ */
+void
+Topography::addNode(MobileNode *mn)
+{
+	if (mn->topoIndex_ >= 0)
+		return;
+	if (numNodes_ == maxNodes_) {
+		MobileNode **tmp;
+
+		maxNodes_ = maxNodes_ ? 2 * maxNodes_ : 64;
+		tmp = new MobileNode*[maxNodes_];
+		if (numNodes_ > 0)
+			memcpy(tmp, nodes_, numNodes_ * sizeof(MobileNode *));
+		delete [] nodes_;
+		nodes_ = tmp;
+		delete [] affected_;
+		affected_ = new MobileNode*[maxNodes_];
+	}
+	mn->topoIndex_ = numNodes_;
+	nodes_[numNodes_++] = mn;
+	mn->nextCell_ = NULL;
+	mn->prevCell_ = NULL;
+	mn->cell_ = -1;
+
+	// the position of the node may not be set yet: 
+	// build the grid again at the next transmission
+	sorted_ = false;
+}
+
+/* Place the nodes in cells of side (at least) cellSize, covering 
+ * the topography (where set_destination keeps the moving nodes) and
+ * the current positions of the nodes. Nodes placed out of this area
+ * later are kept in the border cells.
+ */
+void
+Topography::buildGrid(double cellSize) {
+	double xmin = lowerX(), xmax = upperX();
+	double ymin = lowerY(), ymax = upperY();
+	double nx, ny;
+	int i;
+
+	for (i = 0; i < numNodes_; i++) {
+		MobileNode *mn = nodes_[i];
+		xmin = MIN(xmin, MIN(mn->X(), mn->destX()));
+		xmax = MAX(xmax, MAX(mn->X(), mn->destX()));
+		ymin = MIN(ymin, MIN(mn->Y(), mn->destY()));
+		ymax = MAX(ymax, MAX(mn->Y(), mn->destY()));
+	}
+
+	gridOriginX_ = xmin;
+	gridOriginY_ = ymin;
+	gridCellSize_ = cellSize;
+	nx = floor((xmax - xmin) / gridCellSize_) + 1;
+	ny = floor((ymax - ymin) / gridCellSize_) + 1;
+	while (nx * ny > XLIST_MAX_CELLS) {
+		gridCellSize_ *= 2;
+		nx = floor((xmax - xmin) / gridCellSize_) + 1;
+		ny = floor((ymax - ymin) / gridCellSize_) + 1;
+	}
+	gridX_ = (int)nx;
+	gridY_ = (int)ny;
+
+	delete [] cells_;
+	cells_ = new MobileNode*[gridX_ * gridY_];
+	for (i = 0; i < gridX_ * gridY_; i++)
+		cells_[i] = NULL;
+	for (i = 0; i < numNodes_; i++) {
+		nodes_[i]->cell_ = -1;
+		gridInsert(nodes_[i], gridCell(nodes_[i]->X(), nodes_[i]->Y()));
+	}
+
+	lastRefresh_ = Scheduler::instance().clock();
+	sorted_ = true;
+}
+
+int
+Topography::gridCell(double x, double y) {
+	double cx = floor((x - gridOriginX_) / gridCellSize_);
+	double cy = floor((y - gridOriginY_) / gridCellSize_);
+
+	if (cx < 0)
+		cx = 0;
+	else if (cx > gridX_ - 1)
+		cx = gridX_ - 1;
+	if (cy < 0)
+		cy = 0;
+	else if (cy > gridY_ - 1)
+		cy = gridY_ - 1;
+	return (int)cy * gridX_ + (int)cx;
+}
+
+void
+Topography::gridInsert(MobileNode *mn, int cell) {
+	mn->prevCell_ = NULL;
+	mn->nextCell_ = cells_[cell];
+	if (cells_[cell] != NULL)
+		cells_[cell]->prevCell_ = mn;
+	cells_[cell] = mn;
+	mn->cell_ = cell;
+}
+
+void
+Topography::gridRemove(MobileNode *mn) {
+	int cell = mn->cell_;
+
+	if (cell < 0)
+		return;
+	if (mn->prevCell_ != NULL)
+		mn->prevCell_->nextCell_ = mn->nextCell_;
+	else
+		cells_[cell] = mn->nextCell_;
+	if (mn->nextCell_ != NULL)
+		mn->nextCell_->prevCell_ = mn->prevCell_;
+	mn->nextCell_ = NULL;
+	mn->prevCell_ = NULL;
+	mn->cell_ = -1;
+}
+
+// Update the position of the moving nodes of a cell. A node moving 
+// to another cell is moved in the grid by updateNodesList().
+void
+Topography::refreshCell(int cell, double now) {
+	MobileNode *tmp, *next;
+
+	for (tmp = cells_[cell]; tmp != NULL; tmp = next) {
+		next = tmp->nextCell_;
+		if (tmp->speed() != 0.0 && 
+		    now - tmp->getUpdateTime() > XLIST_POSITION_UPDATE_INTERVAL)
+			tmp->update_position();
+	}
+}
+
+// A node was given a new speed by MobileNode::set_destination()
+void
+Topography::updateSpeed(double speed)
+{
+	if (speed > maxSpeed_)
+		maxSpeed_ = speed;
+}
+
+void
+Topography::updateNodesList(MobileNode *mn)
+{
+	int cell;
+
+	// the grid is built at the next transmission
+	if (!sorted_ || mn->cell_ < 0)
+		return;
+
+	cell = gridCell(mn->X(), mn->Y());
+	if (cell != mn->cell_) {
+		gridRemove(mn);
+		gridInsert(mn, cell);
+	}
+}
+
+/* Returns the nodes listening to the channel of the given index within
+ * radius of mn in the plane (mn included). The array is owned by the
+ * topography and is overwritten by the next call.
+ */
+MobileNode **
+Topography::getAffectedNodes(MobileNode *mn, double radius, int channel,
+			     int *numAffectedNodes)
+{
+	double now = Scheduler::instance().clock();
+	double dx, dy, r2 = radius * radius;
+	int cell, cx, cy, x0, x1, y0, y1, x, y, i, ring;
+	int n = 0;
+	MobileNode *tmp;
+	uint64_t bit = (uint64_t)1 << channel;
+
+	if (numNodes_ == 0) {
+		*numAffectedNodes=-1;
+		fprintf(stderr, "no node on the channel when trying to send!!!\n");
+		return NULL;
+	}
+	
+	if (!sorted_ || radius > gridCellSize_)
+		buildGrid(radius);
+
+	// Nodes far from the transmitters are refreshed once per interval,
+	// so that the nodes moving into a neighbourhood are found in its cells
+	if (now - lastRefresh_ > XLIST_POSITION_UPDATE_INTERVAL) {
+		maxSpeed_ = 0.0;
+		for (i = 0; i < numNodes_; i++) {
+			if (nodes_[i]->speed() != 0.0 && 
+			    now - nodes_[i]->getUpdateTime() > XLIST_POSITION_UPDATE_INTERVAL)
+				nodes_[i]->update_position();
+			maxSpeed_ = MAX(maxSpeed_, nodes_[i]->speed());
 		}
-	}  
-	//Added by Deepti  -- start
-	//channel_->updateNodesList(mn, oldX); -- commentted by Deepti
+		lastRefresh_ = now;
+	}
+	if (mn->speed() != 0.0 && now - mn->getUpdateTime() > XLIST_POSITION_UPDATE_INTERVAL)
+		mn->update_position();
+
+	// A moving node is in the cell of its last update, at most two
+	// intervals ago (the refresh skips the nodes updated within one):
+	// search as far as it may have moved since
+	ring = (int)ceil((radius + 2 * XLIST_POSITION_UPDATE_INTERVAL * maxSpeed_) /
+			 gridCellSize_);
+	cell = gridCell(mn->X(), mn->Y());
+	cx = cell % gridX_;
+	cy = cell / gridX_;
+	x0 = MAX(cx - ring, 0);
+	x1 = MIN(cx + ring, gridX_ - 1);
+	y0 = MAX(cy - ring, 0);
+	y1 = MIN(cy + ring, gridY_ - 1);
+
+	for (y = y0; y <= y1; y++)
+		for (x = x0; x <= x1; x++)
+			refreshCell(y * gridX_ + x, now);
+
+	for (y = y0; y <= y1; y++)
+		for (x = x0; x <= x1; x++)
+			for (tmp = cells_[y * gridX_ + x]; tmp != NULL; tmp = tmp->nextCell_) {
+				if (!(tmp->channels_ & bit))
+					continue;
+				dx = tmp->X() - mn->X();
+				dy = tmp->Y() - mn->Y();
+				if (dx * dx + dy * dy <= r2)
+					affected_[n++] = tmp;
+			}
+         
+	*numAffectedNodes = n;
+	return affected_;
 }
+ 
+
+
 
 
 int
@@ -152,19 +381,15 @@ Topography::command(int argc, const char*const* argv)
 			if(load_demfile(argv[2]))
 				return TCL_ERROR;
 			return TCL_OK;
-		} else if (strcmp(argv[1], "channel") == 0) {
-			WirelessChannel *chan;
-			chan = (WirelessChannel *)TclObject::lookup(argv[2]);
-			if (chan == 0) {
-				fprintf(stderr, "%s lookup of channel failed\n", argv[1]);
-				return TCL_ERROR;
-			} else {
-				channel_ = chan;
-				return TCL_OK;
-			}
+		} else if (strcmp(argv[1], "channel") == 0 ||
+			   strcmp(argv[1], "numChannel") == 0) {
+			// The channels query the node index: nothing to record
+			return TCL_OK;
 		}
 	}
 	else if(argc == 4) {
+		if (strcmp(argv[1], "mchannel") == 0)
+			return TCL_OK;
 		if(strcmp(argv[1], "load_flatgrid") == 0) {
 			if(load_flatgrid(atoi(argv[2]), atoi(argv[3])))
 				return TCL_ERROR;
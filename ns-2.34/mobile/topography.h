@@ -42,15 +42,27 @@
 
 #include <object.h>
 #include "channel.h"
-#define MAX_CHANNEL 12      //Added by Deepti
+
+// Time interval for updating a position of a node in the node index
+// (can be adjusted by the user, depending on the nodes mobility). /* VAL NAUMOV */
+#define XLIST_POSITION_UPDATE_INTERVAL 1.0 //seconds
+#define XLIST_MAX_CELLS 65536
+// Channels a node can listen to in the index (bits of MobileNode::channels_)
+#define XLIST_MAX_CHANNELS 64
+
+class MobileNode;
 
 class Topography : public TclObject {
 
 public:
-	Topography() { maxX = maxY = grid_resolution = 0.0; grid = 0; }
+	Topography();
 
-	/* List-keeper */
-	void updateNodesList(class MobileNode *mn, double oldX);
+	/* List-keeper: nodes of all the channels */
+	void addNode(MobileNode *mn);
+	void updateNodesList(MobileNode *mn);
+	void updateSpeed(double speed);
+	MobileNode **getAffectedNodes(MobileNode *mn, double radius,
+				      int channel, int *numAffectedNodes);
 	
 	double	lowerX() { return 0.0; }
 	double	upperX() { return maxX * grid_resolution; }
@@ -70,13 +82,29 @@ private:
 	double	grid_resolution;
 	int*	grid;
 
-	/* List-keeper */
-	WirelessChannel *channel_;
-	
-	//Added by Deepti  -- start
-	WirelessChannel *multichannel_[MAX_CHANNEL];			//pointer for multiple channel 
-	int nchannels;					 //variable to record how many channel
-	//Added by Deepti  -- end
+	/* List-keeper: a uniform grid of the nodes shared by all the
+	   channels. Cells are at least as large as the carrier sense
+	   range, so the nodes affected by a transmission are in the 3x3
+	   cells around the sender, widened by the distance a moving node
+	   may have covered since its last position update (positions are
+	   updated lazily). The channels a node listens to are the bits of
+	   MobileNode::channels_ */
+	int numNodes_;
+	int maxNodes_;
+	MobileNode **nodes_;		// all the nodes, for the periodic refresh
+	MobileNode **cells_;		// head of the node list of each cell
+	int gridX_, gridY_;		// number of cells along X and Y
+	double gridOriginX_, gridOriginY_;
+	double gridCellSize_;
+	double lastRefresh_;		// last refresh of all the moving nodes
+	double maxSpeed_;		// highest speed of a node since then
+	bool sorted_;			// the grid is built
+	MobileNode **affected_;		// result buffer of getAffectedNodes
+	void buildGrid(double cellSize);
+	int gridCell(double x, double y);
+	void gridInsert(MobileNode *mn, int cell);
+	void gridRemove(MobileNode *mn);
+	void refreshCell(int cell, double now);
 };
 
 #endif // ns_topography_h
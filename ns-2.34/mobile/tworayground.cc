@@ -100,6 +100,17 @@ TwoRayGround::Pr(PacketStamp *t, PacketStamp *r, WirelessPhy *ifp)
   tX += t->getAntenna()->getX();
   tY += t->getAntenna()->getY();
 
+  // the link did not move: Pr is deterministic
+  link_gain *link = NULL;
+  double loc[6] = { tX, tY, tZ + t->getAntenna()->getZ(),
+		    rX, rY, rZ + r->getAntenna()->getZ() };
+  if (cache_links_) {
+    int valid;
+    link = links_.lookup(t->getNode(), r->getNode(), lambda, L, loc, &valid);
+    if (valid)
+      return t->getTxPr() * link->gain;
+  }
+
   d = sqrt((rX - tX) * (rX - tX) 
 	   + (rY - tY) * (rY - tY) 
 	   + (rZ - tZ) * (rZ - tZ));
@@ -157,6 +168,8 @@ TwoRayGround::Pr(PacketStamp *t, PacketStamp *r, WirelessPhy *ifp)
 
   if(d <= crossover_dist) {
     Pr = Friis(t->getTxPr(), Gt, Gr, lambda, L, d);
+    if (link)
+      links_.store(link, L, loc, Friis(1.0, Gt, Gr, lambda, L, d), d);
 #if DEBUG > 3
     printf("Friis %e\n",Pr);
 #endif
@@ -164,6 +177,8 @@ TwoRayGround::Pr(PacketStamp *t, PacketStamp *r, WirelessPhy *ifp)
   }
   else {
     Pr = TwoRay(t->getTxPr(), Gt, Gr, ht, hr, L, d);
+    if (link)
+      links_.store(link, L, loc, TwoRay(1.0, Gt, Gr, ht, hr, L, d), d);
 #if DEBUG > 3
     printf("TwoRay %e\n",Pr);
 #endif    
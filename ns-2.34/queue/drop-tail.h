@@ -47,7 +47,7 @@
 class DropTail : public Queue {
   public:
 	DropTail() { 
-		q_ = new PacketQueue; 
+		q_ = new ChannelPacketQueue; 
 		pq_ = q_;
 		bind_bool("drop_front_", &drop_front_);
 		bind_bool("summarystats_", &summarystats);
@@ -154,24 +154,19 @@ Packet*
 PriQueue::filter(nsaddr_t id)
 {
 	Packet *p = 0;
-	Packet *pp = 0;
 	struct hdr_cmn *ch;
 
 	for(p = q_->head(); p; p = p->next_) {
 		ch = HDR_CMN(p);
 		if(ch->next_hop() == id)
 			break;
-		pp = p;
 	}
 
 	/*
 	 * Deque Packet
 	 */
 	if(p) {
-		if(pp == 0)
-			q_->remove(p);
-		else
-			q_->remove(p, pp);
+		q_->remove(p);
 	}
 	return p;
 }
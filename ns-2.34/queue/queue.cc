@@ -126,6 +126,8 @@ Queue::Queue() : Connector(), blocked_(0), unblock_on_resume_(1), qh_(*this),
 void Queue::recv(Packet* p, Handler*)
 {
 	double now = Scheduler::instance().clock();
+	// enque() may drop and free p
+	int ch = HDR_CMN(p)->channel_;
 	enque(p);
 	/*if (!blocked_) {
 		/*
@@ -144,8 +146,6 @@ void Queue::recv(Packet* p, Handler*)
 	}*/
 	if (!blocked_ && ( current_tuned_channel_==-1 ) ) {
 		p = deque();
-		struct hdr_mac802_11* dh1 = HDR_MAC802_11(p);
-		struct hdr_cmn *ch1 =  HDR_CMN(p);
 		if (p != 0) {
 			utilUpdate(last_change_, now, blocked_);
 			last_change_ = now;
@@ -154,8 +154,8 @@ void Queue::recv(Packet* p, Handler*)
 		}
 	}
 
-	else if (!blocked_ && (current_tuned_channel_==HDR_CMN(p)->channel_)) {
-		p = pq_->dequePacket_from_channel(HDR_CMN(p)->channel_);
+	else if (!blocked_ && (current_tuned_channel_==ch)) {
+		p = pq_->dequePacket_from_channel(current_tuned_channel_);
 		if (p != 0) {
 			utilUpdate(last_change_, now, blocked_);
 			last_change_ = now;
@@ -306,4 +306,220 @@ Packet* PacketQueue::dequePacket_from_channel(int channel)
 		}
 	}
 	return 0;
-}
\ No newline at end of file
+}
+
+int PacketQueue::channelLength(int channel) const
+{
+	int n = 0;
+	for (Packet *p = head_; p; p = p->next_)
+		if (HDR_CMN(p)->channel_ == channel)
+			n++;
+	return n;
+}
+
+int PacketQueue::channelByteLength(int channel) const
+{
+	int n = 0;
+	for (Packet *p = head_; p; p = p->next_)
+		if (HDR_CMN(p)->channel_ == channel)
+			n += hdr_cmn::access(p)->size();
+	return n;
+}
+
+
+static class ChannelPacketQueueClass : public TclClass {
+public:
+	ChannelPacketQueueClass() : TclClass("PacketQueue/Channel") {}
+	TclObject* create(int, const char*const*) {
+		return (new ChannelPacketQueue());
+	}
+} class_channel_packet_queue;
+
+ChannelPacketQueue::~ChannelPacketQueue()
+{
+	delete [] chhead_;
+	delete [] chtail_;
+	delete [] chlen_;
+	delete [] chbytes_;
+}
+
+int ChannelPacketQueue::getSlot(int channel)
+{
+	int s = slot(channel);
+
+	if (s >= nslots_) {
+		int n = nslots_ ? 2 * nslots_ : 16;
+		if (n <= s)
+			n = s + 1;
+		Packet** head = new Packet*[n];
+		Packet** tail = new Packet*[n];
+		int* len = new int[n];
+		int* bytes = new int[n];
+		for (int i = 0; i < n; i++) {
+			if (i < nslots_) {
+				head[i] = chhead_[i];
+				tail[i] = chtail_[i];
+				len[i] = chlen_[i];
+				bytes[i] = chbytes_[i];
+			} else {
+				head[i] = tail[i] = 0;
+				len[i] = bytes[i] = 0;
+			}
+		}
+		delete [] chhead_;
+		delete [] chtail_;
+		delete [] chlen_;
+		delete [] chbytes_;
+		chhead_ = head;
+		chtail_ = tail;
+		chlen_ = len;
+		chbytes_ = bytes;
+		nslots_ = n;
+	}
+	return s;
+}
+
+Packet* ChannelPacketQueue::enque(Packet* p)
+{
+	Packet* pt = tail_;
+	int s = getSlot(HDR_CMN(p)->channel_);
+	int size = hdr_cmn::access(p)->size();
+
+	p->next_ = 0;
+	p->prev_ = tail_;
+	if (tail_)
+		tail_->next_ = p;
+	else
+		head_ = p;
+	tail_ = p;
+
+	p->chnext_ = 0;
+	if (chtail_[s])
+		chtail_[s]->chnext_ = p;
+	else
+		chhead_[s] = p;
+	chtail_[s] = p;
+
+	++len_;
+	bytes_ += size;
+	++chlen_[s];
+	chbytes_[s] += size;
+	return pt;
+}
+
+void ChannelPacketQueue::enqueHead(Packet* p)
+{
+	int s = getSlot(HDR_CMN(p)->channel_);
+	int size = hdr_cmn::access(p)->size();
+
+	p->prev_ = 0;
+	p->next_ = head_;
+	if (head_)
+		head_->prev_ = p;
+	else
+		tail_ = p;
+	head_ = p;
+
+	p->chnext_ = chhead_[s];
+	if (!chhead_[s])
+		chtail_[s] = p;
+	chhead_[s] = p;
+
+	++len_;
+	bytes_ += size;
+	++chlen_[s];
+	chbytes_[s] += size;
+}
+
+/* Unlink p, whose predecessor on its channel is chprev (0 if p is the first one) */
+void ChannelPacketQueue::unlink(Packet* p, int s, Packet* chprev)
+{
+	int size = hdr_cmn::access(p)->size();
+
+	if (p->prev_)
+		p->prev_->next_ = p->next_;
+	else
+		head_ = p->next_;
+	if (p->next_)
+		p->next_->prev_ = p->prev_;
+	else
+		tail_ = p->prev_;
+
+	if (chprev)
+		chprev->chnext_ = p->chnext_;
+	else
+		chhead_[s] = p->chnext_;
+	if (chtail_[s] == p)
+		chtail_[s] = chprev;
+
+	p->next_ = p->prev_ = p->chnext_ = 0;
+	--len_;
+	bytes_ -= size;
+	--chlen_[s];
+	chbytes_[s] -= size;
+}
+
+Packet* ChannelPacketQueue::deque()
+{
+	Packet* p = head_;
+
+	if (!p)
+		return 0;
+	// the first packet is also the first one of its channel
+	unlink(p, slot(HDR_CMN(p)->channel_), 0);
+	return p;
+}
+
+void ChannelPacketQueue::remove(Packet* target)
+{
+	int s = slot(HDR_CMN(target)->channel_);
+
+	if (s < nslots_) {
+		for (Packet *pp = 0, *p = chhead_[s]; p; pp = p, p = p->chnext_) {
+			if (p == target) {
+				unlink(p, s, pp);
+				return;
+			}
+		}
+	}
+	fprintf(stderr, "ChannelPacketQueue:: remove() couldn't find target\n");
+	abort();
+}
+
+Packet* ChannelPacketQueue::dequePacket_from_channel(int channel)
+{
+	int s = slot(channel);
+
+	if (s >= nslots_)
+		return 0;
+	for (Packet *pp = 0, *p = chhead_[s]; p; pp = p, p = p->chnext_) {
+		// slot 0 is shared by the negative channels
+		if (HDR_CMN(p)->channel_ == channel) {
+			unlink(p, s, pp);
+			return p;
+		}
+	}
+	return 0;
+}
+
+int ChannelPacketQueue::channelLength(int channel) const
+{
+	int s = slot(channel);
+
+	if (s >= nslots_)
+		return 0;
+	if (s == 0)
+		return PacketQueue::channelLength(channel);
+	return chlen_[s];
+}
+
+int ChannelPacketQueue::channelByteLength(int channel) const
+{
+	int s = slot(channel);
+
+	if (s >= nslots_)
+		return 0;
+	if (s == 0)
+		return PacketQueue::channelByteLength(channel);
+	return chbytes_[s];
+}
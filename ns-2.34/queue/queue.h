@@ -86,8 +86,11 @@ public:
 	Packet* tail() { return tail_; }
 	
 	//Added by Deepti -- start
-	Packet* dequePacket_from_channel(int channel);
+	virtual Packet* dequePacket_from_channel(int channel);
 	//Added by Deepti -- end 
+	/* number of packets/bytes to be sent on a specific channel */
+	virtual int channelLength(int channel) const;
+	virtual int channelByteLength(int channel) const;
 	
 	// MONARCH EXTNS
 	virtual inline void enqueHead(Packet* p) {
@@ -116,6 +119,40 @@ private:
 	Packet *iter;
 };
 
+/*
+ * A FIFO queue which also keeps one FIFO per channel (hdr_cmn::channel_),
+ * so that the first packet, the length and the size in bytes of a channel
+ * are available in constant time. The packets are kept in arrival order 
+ * in the head_/tail_ list as well, doubly linked through prev_. 
+ * The channel of a packet must not change while it is queued, and
+ * packets are removed with remove(Packet*) only.
+ */
+class ChannelPacketQueue : public PacketQueue {
+public:
+	ChannelPacketQueue() : nslots_(0), chhead_(0), chtail_(0), chlen_(0),
+			       chbytes_(0) {}
+	~ChannelPacketQueue();
+	Packet* enque(Packet*);
+	Packet* deque();
+	void enqueHead(Packet*);
+	void remove(Packet*);
+	Packet* dequePacket_from_channel(int channel);
+	int channelLength(int channel) const;
+	int channelByteLength(int channel) const;
+
+protected:
+	/* slot 0 holds the packets of all the negative channels */
+	inline int slot(int channel) const { return (channel < 0 ? 0 : channel + 1); }
+	int getSlot(int channel);	// grows the tables if needed
+	void unlink(Packet* p, int s, Packet* chprev);
+
+	int nslots_;
+	Packet** chhead_;
+	Packet** chtail_;
+	int* chlen_;
+	int* chbytes_;
+};
+
 class Queue;
 
 class QueueHandler : public Handler {
@@ -148,6 +185,8 @@ public:
 						 * underlying packet queue */
 	int byteLength() { return pq_->byteLength(); }	/* number of bytes *
 						 * currently in packet queue */
+	int length(int channel) { return pq_->channelLength(channel); }
+	int byteLength(int channel) { return pq_->channelByteLength(channel); }
 	/* mean utilization, decaying based on util_weight */
 	virtual double utilization (void);
 
@@ -44,6 +44,9 @@ static const char rcsid[] =
 
 #include <stdlib.h>
 #include <assert.h>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
 #include "config.h"
 #include "route.h"
 #include "address.h"
@@ -56,11 +59,15 @@ public:
 	}
 } routelogic_class;
 
+/*
+ * Remove all the links.  The storage of the lists and of the routes is
+ * kept for the next topology, which is usually the same size.
+ */
 void RouteLogic::reset_all()
 {
-	delete[] adj_;
-	delete[] route_;
-	adj_ = 0; 
+	for (int i = 0; i < maxnode_; i++)
+		nlinks_[i] = 0;
+	nlinks_total_ = 0;
 	route_ = 0;
 	size_ = 0;
 }
@@ -70,7 +77,7 @@ int RouteLogic::command(int argc, const char*const* argv)
 	Tcl& tcl = Tcl::instance();
 	if (argc == 2) {
 		if (strcmp(argv[1], "compute") == 0) {
-			if (adj_ == 0)
+			if (size_ == 0)
 				return (TCL_OK);
 			compute_routes();
 			return (TCL_OK);
@@ -189,6 +196,34 @@ int RouteLogic::command(int argc, const char*const* argv)
 			}
 			reset(src, dst);
 			return (TCL_OK);
+		} else if (argc == 3 && strcmp(argv[1], "incremental") == 0) {
+			if (strcmp(argv[2], "on") == 0)
+				incremental_ = 1;
+			else if (strcmp(argv[2], "off") == 0) {
+				incremental_ = 0;
+				delete[] dist_;
+				dist_ = 0;
+				old_size_ = 0;
+			} else {
+				tcl.result("incremental: on or off");
+				return (TCL_ERROR);
+			}
+			return (TCL_OK);
+		} else if (argc == 3 && strcmp(argv[1], "threads") == 0) {
+			int n = atoi(argv[2]);
+			if (n < 1) {
+				tcl.result("threads: at least 1");
+				return (TCL_ERROR);
+			}
+#ifndef USE_THREADS
+			if (n > 1) {
+				tcl.result("threads: ns built without threads "
+					   "(configure --disable-threads)");
+				return (TCL_ERROR);
+			}
+#endif
+			route_threads_ = n;
+			return (TCL_OK);
 		} else if (strcmp(argv[1], "lookup") == 0) {
 			int nh;
 			int res = lookup_flat((char*)argv[2], (char*)argv[3], 
@@ -310,8 +345,19 @@ int RouteLogic::lookup_hier(char* asrc, char* adst, int& result) {
 RouteLogic::RouteLogic()
 {
 	size_ = 0;
-	adj_ = 0;
+	maxnode_ = 0;
 	route_ = 0;
+	links_ = 0;
+	nlinks_ = maxlinks_ = 0;
+	nlinks_total_ = 0;
+	route_alloc_ = 0;
+	route_alloc_size_ = 0;
+	route_threads_ = 1;
+	incremental_ = 0;
+	dist_ = 0;
+	old_start_ = 0;
+	old_links_ = 0;
+	old_size_ = old_max_ = 0;
 	/* additions for hierarchical routing extension */
 	C_ = 0;
 	D_ = 0;
@@ -326,8 +372,15 @@ RouteLogic::RouteLogic()
 	
 RouteLogic::~RouteLogic()
 {
-	delete[] adj_;
-	delete[] route_;
+	for (int i = 0; i < maxnode_; i++)
+		delete[] links_[i];
+	delete[] links_;
+	delete[] nlinks_;
+	delete[] maxlinks_;
+	delete[] route_alloc_;
+	delete[] dist_;
+	delete[] old_start_;
+	delete[] old_links_;
 
 	for (int i = 0; i < (Cmax_ * D_); i++) {
 		for (int j = 0; j < (Cmax_ + D_) * (cluster_size_[i]+1); j++) {
@@ -354,17 +407,31 @@ RouteLogic::~RouteLogic()
 
 void RouteLogic::alloc(int n)
 {
-	size_ = n;
-	n *= n;
-	adj_ = new adj_entry[n];
-	for (int i = 0; i < n; ++i) {
-		adj_[i].cost = INFINITY;
-		adj_[i].entry = 0;
+	link_entry** links = new link_entry*[n];
+	int* nlinks = new int[n];
+	int* maxlinks = new int[n];
+	int i;
+
+	for (i = 0; i < maxnode_; i++) {
+		links[i] = links_[i];
+		nlinks[i] = nlinks_[i];
+		maxlinks[i] = maxlinks_[i];
+	}
+	for (; i < n; i++) {
+		links[i] = 0;
+		nlinks[i] = maxlinks[i] = 0;
 	}
+	delete[] links_;
+	delete[] nlinks_;
+	delete[] maxlinks_;
+	links_ = links;
+	nlinks_ = nlinks;
+	maxlinks_ = maxlinks;
+	maxnode_ = n;
 }
 
 /*
- * Check that we have enough storage in the adjacency array
+ * Check that we have enough storage in the link lists
  * to hold a node numbered "n"
  */
 void RouteLogic::check(int n)
@@ -372,114 +439,425 @@ void RouteLogic::check(int n)
 	if (n < size_)
 		return;
 
-	adj_entry* old = adj_;
-	int osize = size_;
-	int m = osize;
+	int m = size_;
 	if (m == 0)
 		m = 16;
 	while (m <= n)
 		m <<= 1;
 
-	alloc(m);
-	for (int i = 0; i < osize; ++i) {
-		for (int j = 0; j < osize; ++j)
-			adj_[INDEX(i, j, m)].cost =old[INDEX(i, j, osize)].cost;
-	}
+	if (m > maxnode_)
+		alloc(m);
 	size_ = m;
-	delete[] old;
+}
+
+link_entry* RouteLogic::find_link(int src, int dst)
+{
+	link_entry* l = links_[src];
+	for (int i = 0; i < nlinks_[src]; i++)
+		if (l[i].dst == dst)
+			return (&l[i]);
+	if (nlinks_[src] == maxlinks_[src]) {
+		int m = maxlinks_[src] ? 2 * maxlinks_[src] : 4;
+		l = new link_entry[m];
+		for (int i = 0; i < nlinks_[src]; i++)
+			l[i] = links_[src][i];
+		delete[] links_[src];
+		links_[src] = l;
+		maxlinks_[src] = m;
+	}
+	l = &links_[src][nlinks_[src]++];
+	nlinks_total_++;
+	l->dst = dst;
+	l->cost = INFINITY;
+	l->entry = 0;
+	return (l);
 }
 
 void RouteLogic::insert(int src, int dst, double cost)
 {
 	check(src);
 	check(dst);
-	adj_[INDEX(src, dst, size_)].cost = cost;
+	find_link(src, dst)->cost = cost;
 }
 void RouteLogic::insert(int src, int dst, double cost, void* entry_)
 {
 	check(src);
 	check(dst);
-	adj_[INDEX(src, dst, size_)].cost = cost;
-	adj_[INDEX(src, dst, size_)].entry = entry_;
+	link_entry* l = find_link(src, dst);
+	l->cost = cost;
+	l->entry = entry_;
 }
 
 void RouteLogic::reset(int src, int dst)
 {
 	assert(src < size_);
 	assert(dst < size_);
-	adj_[INDEX(src, dst, size_)].cost = INFINITY;
+	find_link(src, dst)->cost = INFINITY;
 }
 
-void RouteLogic::compute_routes()
+/*
+ * The routing table is reallocated only when the number of nodes
+ * changes.
+ */
+void RouteLogic::alloc_routes(int n)
+{
+	if (route_alloc_size_ != n) {
+		delete[] route_alloc_;
+		route_alloc_ = new route_entry[n * n];
+		memset((char *)route_alloc_, 0, n * n * sizeof(route_alloc_[0]));
+		route_alloc_size_ = n;
+		delete[] dist_;
+		dist_ = 0;
+		old_size_ = 0;
+	}
+	if (incremental_ && dist_ == 0) {
+		dist_ = new double[n * n];
+		old_size_ = 0;
+	}
+	route_ = route_alloc_;
+}
+
+void RouteLogic::scratch_init(route_scratch* s)
+{
+	s->hopcnt = new double[size_];
+	s->done = new char[size_];
+	s->heap_max = nlinks_total_ + size_;
+	s->heap_cost = new double[s->heap_max];
+	s->heap_node = new int[s->heap_max];
+	s->heap_size = 0;
+}
+
+void RouteLogic::scratch_free(route_scratch* s)
+{
+	delete[] s->hopcnt;
+	delete[] s->done;
+	delete[] s->heap_cost;
+	delete[] s->heap_node;
+}
+
+// (cost, node) of heap entry i is lower than that of j
+#define HEAP_LESS(s, i, j) ((s)->heap_cost[i] < (s)->heap_cost[j] || \
+	((s)->heap_cost[i] == (s)->heap_cost[j] && \
+	 (s)->heap_node[i] < (s)->heap_node[j]))
+
+static inline void heap_swap(route_scratch* s, int i, int j)
+{
+	double c = s->heap_cost[i];
+	int n = s->heap_node[i];
+	s->heap_cost[i] = s->heap_cost[j];
+	s->heap_node[i] = s->heap_node[j];
+	s->heap_cost[j] = c;
+	s->heap_node[j] = n;
+}
+
+static void heap_push(route_scratch* s, double cost, int node)
+{
+	int i = s->heap_size++;
+	assert(i < s->heap_max);
+	s->heap_cost[i] = cost;
+	s->heap_node[i] = node;
+	while (i > 0 && HEAP_LESS(s, i, (i - 1) / 2)) {
+		heap_swap(s, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static int heap_pop(route_scratch* s, double* cost)
+{
+	int node = s->heap_node[0];
+	*cost = s->heap_cost[0];
+	s->heap_size--;
+	s->heap_cost[0] = s->heap_cost[s->heap_size];
+	s->heap_node[0] = s->heap_node[s->heap_size];
+	int i = 0;
+	for (;;) {
+		int m = i, l = 2 * i + 1, r = 2 * i + 2;
+		if (l < s->heap_size && HEAP_LESS(s, l, m))
+			m = l;
+		if (r < s->heap_size && HEAP_LESS(s, r, m))
+			m = r;
+		if (m == i)
+			break;
+		heap_swap(s, i, m);
+		i = m;
+	}
+	return (node);
+}
+
+/*
+ * Routes from k.  The nodes are routed by increasing (cost, node
+ * number), and a route is only replaced by a strictly shorter one: the
+ * next hops are the same as those of the O(n^2) scan this replaces.
+ */
+void RouteLogic::dijkstra(int k, route_scratch* s)
 {
 	int n = size_;
-	int* parent = new int[n];
-	double* hopcnt = new double[n];
-#define ADJ(i, j) adj_[INDEX(i, j, size_)].cost
-#define ADJ_ENTRY(i, j) adj_[INDEX(i, j, size_)].entry
-#define ROUTE(i, j) route_[INDEX(i, j, size_)].next_hop
-#define ROUTE_ENTRY(i, j) route_[INDEX(i, j, size_)].entry
-	delete[] route_;
-	route_ = new route_entry[n * n];
-	memset((char *)route_, 0, n * n * sizeof(route_[0]));
+	double* hopcnt = s->hopcnt;
+	route_entry* route = &route_[INDEX(k, 0, n)];
+	int v, i;
 
-	/* do for all the sources */
-	int k;
-	for (k = 1; k < n; ++k) {
-		int v;
-		for (v = 0; v < n; v++)
-			parent[v] = v;
-	
-		/* set the route for all neighbours first */
-		for (v = 1; v < n; ++v) {
-			if (parent[v] != k) {
-				hopcnt[v] = ADJ(k, v);
-				if (hopcnt[v] != INFINITY) {
-					ROUTE(k, v) = v;
-					ROUTE_ENTRY(k, v) = ADJ_ENTRY(k, v);
-				}
-			}
-		}
-		for (v = 1; v < n; ++v) {
-			/*
-			 * w is the node that is the nearest to the subtree
-			 * that has been routed
-			 */
-			int o = 0;
-			/* XXX */
-			hopcnt[0] = INFINITY;
-			int w;
-			for (w = 1; w < n; w++)
-				if (parent[w] != k && hopcnt[w] < hopcnt[o])
-					o = w;
-			parent[o] = k;
-			/*
-			 * update distance counts for the nodes that are
-			 * adjacent to o
-			 */
-			if (o == 0)
+	memset((char *)route, 0, n * sizeof(route[0]));
+	for (v = 0; v < n; v++) {
+		hopcnt[v] = INFINITY;
+		s->done[v] = 0;
+	}
+	s->done[k] = 1;
+	s->heap_size = 0;
+
+	/* set the route for all neighbours first */
+	for (i = 0; i < nlinks_[k]; i++) {
+		link_entry* l = &links_[k][i];
+		if (l->dst == k || l->cost == INFINITY)
+			continue;
+		hopcnt[l->dst] = l->cost;
+		route[l->dst].next_hop = l->dst;
+		route[l->dst].entry = l->entry;
+		if (l->cost < INFINITY)
+			heap_push(s, l->cost, l->dst);
+	}
+	while (s->heap_size > 0) {
+		double c;
+		int o = heap_pop(s, &c);
+		if (s->done[o] || c != hopcnt[o])
+			continue;	// routed, or a longer route
+		s->done[o] = 1;
+		/*
+		 * update distance counts for the nodes that are
+		 * adjacent to o
+		 */
+		for (i = 0; i < nlinks_[o]; i++) {
+			link_entry* l = &links_[o][i];
+			int w = l->dst;
+			if (s->done[w] || l->cost == INFINITY)
 				continue;
-			for (w = 1; w < n; w++) {
-				if (parent[w] != k &&
-				    hopcnt[o] + ADJ(o, w) < hopcnt[w]) {
-					ROUTE(k, w) = ROUTE(k, o);
-					ROUTE_ENTRY(k, w) = 
-					    ROUTE_ENTRY(k, o);
-					hopcnt[w] = hopcnt[o] + ADJ(o, w);
-				}
+			if (hopcnt[o] + l->cost < hopcnt[w]) {
+				route[w] = route[o];
+				hopcnt[w] = hopcnt[o] + l->cost;
+				heap_push(s, hopcnt[w], w);
 			}
 		}
 	}
 	/*
 	 * The route to yourself is yourself.
 	 */
+	route[k].next_hop = k;
+	route[k].entry = 0; // This should not matter
+	if (dist_ != 0) {
+		memcpy(&dist_[INDEX(k, 0, n)], hopcnt, n * sizeof(double));
+		dist_[INDEX(k, k, n)] = 0;
+	}
+}
+
+#ifdef USE_THREADS
+void* RouteLogic::route_thread(void* arg)
+{
+	route_job* job = (route_job *)arg;
+	job->rl->compute_sources(job->sources, -job->step);
+	return (0);
+}
+#endif
+
+/*
+ * Routes of the given sources.  With several threads, each computes
+ * every route_threads_-th source: the threads only write the rows of
+ * their sources.  A negative n is the (negated) step of a thread over
+ * a -1 terminated list.
+ */
+void RouteLogic::compute_sources(int* sources, int n)
+{
+	route_scratch s;
+	int i;
+
+	if (n < 0) {
+		scratch_init(&s);
+		for (i = 0; sources[i] >= 0; i -= n)
+			dijkstra(sources[i], &s);
+		scratch_free(&s);
+		return;
+	}
+#ifdef USE_THREADS
+	int nthreads = route_threads_;
+	if (nthreads > n / 8)
+		nthreads = n / 8;
+	if (nthreads > 1) {
+		// pad the list so that every thread finds its end
+		int* list = new int[n + nthreads];
+		pthread_t* threads = new pthread_t[nthreads];
+		route_job* jobs = new route_job[nthreads];
+		char* started = new char[nthreads];
+		for (i = 0; i < n; i++)
+			list[i] = sources[i];
+		for (; i < n + nthreads; i++)
+			list[i] = -1;
+		for (i = 0; i < nthreads; i++) {
+			jobs[i].rl = this;
+			jobs[i].sources = list + i;
+			jobs[i].step = nthreads;
+			started[i] = (i > 0 &&
+				      pthread_create(&threads[i], NULL,
+						     route_thread,
+						     &jobs[i]) == 0);
+		}
+		for (i = 0; i < nthreads; i++)
+			if (!started[i])
+				compute_sources(list + i, -nthreads);
+		for (i = 1; i < nthreads; i++)
+			if (started[i])
+				pthread_join(threads[i], NULL);
+		delete[] started;
+		delete[] jobs;
+		delete[] threads;
+		delete[] list;
+		return;
+	}
+#endif
+	scratch_init(&s);
+	for (i = 0; i < n; i++)
+		dijkstra(sources[i], &s);
+	scratch_free(&s);
+}
+
+/*
+ * Keep the links (sorted by destination) for the next incremental
+ * computation.
+ */
+void RouteLogic::save_links()
+{
+	int i, j, k, n = 0;
+
+	if (old_size_ < size_) {
+		delete[] old_start_;
+		old_start_ = new int[size_ + 1];
+	}
+	for (i = 0; i < size_; i++)
+		for (j = 0; j < nlinks_[i]; j++)
+			if (links_[i][j].cost != INFINITY)
+				n++;
+	if (n > old_max_) {
+		delete[] old_links_;
+		old_max_ = 2 * n;
+		old_links_ = new link_entry[old_max_];
+	}
+	n = 0;
+	for (i = 0; i < size_; i++) {
+		old_start_[i] = n;
+		for (j = 0; j < nlinks_[i]; j++) {
+			if (links_[i][j].cost == INFINITY)
+				continue;
+			link_entry l = links_[i][j];
+			for (k = n; k > old_start_[i] &&
+				     old_links_[k - 1].dst > l.dst; k--)
+				old_links_[k] = old_links_[k - 1];
+			old_links_[k] = l;
+			n++;
+		}
+	}
+	old_start_[size_] = n;
+	old_size_ = size_;
+}
+
+/*
+ * Links added, removed or changed since save_links(), at most max.
+ * changed[i].cost is the lower of the old and new costs.  Returns -1
+ * if there are more.
+ */
+int RouteLogic::changed_links(link_entry* changed, int* srcs, int max)
+{
+	int i, j, n = 0;
+
+	for (i = 0; i < size_; i++) {
+		int a = old_start_[i], a_end = old_start_[i + 1];
+		// links of i still there or changed
+		for (j = 0; j < nlinks_[i]; j++) {
+			link_entry* l = &links_[i][j];
+			if (l->cost == INFINITY)
+				continue;
+			int lo = a, hi = a_end;
+			while (lo < hi) {
+				int mid = (lo + hi) / 2;
+				if (old_links_[mid].dst < l->dst)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			link_entry* o = (lo < a_end && old_links_[lo].dst == l->dst)
+				? &old_links_[lo] : 0;
+			if (o && o->cost == l->cost && o->entry == l->entry)
+				continue;
+			if (n == max)
+				return (-1);
+			changed[n] = *l;
+			if (o && o->cost < l->cost)
+				changed[n].cost = o->cost;
+			srcs[n++] = i;
+		}
+		// links of i removed
+		for (; a < a_end; a++) {
+			link_entry* l = 0;
+			for (j = 0; j < nlinks_[i]; j++)
+				if (links_[i][j].dst == old_links_[a].dst &&
+				    links_[i][j].cost != INFINITY)
+					l = &links_[i][j];
+			if (l != 0)
+				continue;
+			if (n == max)
+				return (-1);
+			changed[n] = old_links_[a];
+			srcs[n++] = i;
+		}
+	}
+	return (n);
+}
+
+/*
+ * Routes between all the nodes.  In incremental mode, a source is
+ * computed again only if a changed link (u, v) may be on one of its
+ * shortest paths: dist(k, u) + cost(u, v) <= dist(k, v), cost being
+ * the lower of the old and new costs.
+ */
+void RouteLogic::compute_routes()
+{
+	int n = size_;
+	int* sources = new int[n];
+	int nsources = 0;
+	int k, i;
+
+	int incremental = (incremental_ && old_size_ == n &&
+			   route_alloc_size_ == n && dist_ != 0);
+	alloc_routes(n);
+
+	int nchanged = -1;
+	link_entry* changed = 0;
+	int* srcs = 0;
+	if (incremental) {
+		changed = new link_entry[n];
+		srcs = new int[n];
+		nchanged = changed_links(changed, srcs, n);
+	}
+	/* do for all the sources */
 	for (k = 1; k < n; ++k) {
-		ROUTE(k, k) = k;
-		ROUTE_ENTRY(k, k) = 0; // This should not matter
+		if (nchanged < 0) {
+			sources[nsources++] = k;
+			continue;
+		}
+		double* d = &dist_[INDEX(k, 0, n)];
+		for (i = 0; i < nchanged; i++) {
+			int u = srcs[i];
+			if (d[u] < INFINITY &&
+			    d[u] + changed[i].cost <= d[changed[i].dst]) {
+				sources[nsources++] = k;
+				break;
+			}
+		}
 	}
+	delete[] changed;
+	delete[] srcs;
 
-	delete[] hopcnt;
-	delete[] parent;
+	memset((char *)route_, 0, n * sizeof(route_[0]));	// node 0
+	compute_sources(sources, nsources);
+	delete[] sources;
+	if (incremental_)
+		save_links();
 }
 
 /* hierarchical routing support */
@@ -703,17 +1081,16 @@ void RouteLogic::hier_insert(int *src_addr, int *dst_addr, int cost)
 	}
 }
 
-void RouteLogic::hier_compute_routes(int i, int j)
+void RouteLogic::hier_compute_routes(int i, int j, adj_entry* adj,
+				     route_entry* route)
 {
 	int size = (cluster_size_[i] + C_[j] + D_);
 	int n = size ;
 	double* hopcnt = new double[n];
-#define HADJ(i, j) adj_[INDEX(i, j, size)].cost
-#define HROUTE(i, j) route_[INDEX(i, j, size)].next_hop
-	delete[] route_;
-	route_ = new route_entry[n * n];
+#define HADJ(i, j) adj[INDEX(i, j, size)].cost
+#define HROUTE(i, j) route[INDEX(i, j, size)].next_hop
 	int* parent = new int[n];
-	memset((char *)route_, 0, n * n * sizeof(route_[0]));
+	memset((char *)route, 0, n * n * sizeof(route[0]));
 
 	/* do for all the sources */
 	int k;
@@ -805,17 +1182,19 @@ void RouteLogic::hier_compute()
 		for (k=1; k < C_[j]; k++) {
 			i = INDEX(j, k, Cmax_);
 			int s = (cluster_size_[i] + C_[j] + D_);
-			adj_ = new adj_entry[(s * s)];
-			memset((char *)adj_, 0, s * s * sizeof(adj_[0]));
+			adj_entry* adj = new adj_entry[(s * s)];
+			route_entry* route = new route_entry[(s * s)];
+			memset((char *)adj, 0, s * s * sizeof(adj[0]));
 			for (n=0; n < s; n++)
 				for(m=0; m < s; m++)
-					adj_[INDEX(n, m, s)].cost = hadj_[i][INDEX(n, m, s)];
-			hier_compute_routes(i, j);
+					adj[INDEX(n, m, s)].cost = hadj_[i][INDEX(n, m, s)];
+			hier_compute_routes(i, j, adj, route);
 	
 			for (n=0; n < s; n++)
 				for(m=0; m < s; m++)
-					hroute_[i][INDEX(n, m, s)] = route_[INDEX(n, m, s)].next_hop;
-			delete [] adj_;
+					hroute_[i][INDEX(n, m, s)] = route[INDEX(n, m, s)].next_hop;
+			delete [] adj;
+			delete [] route;
 		}
 }
 
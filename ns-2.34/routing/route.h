@@ -70,6 +70,23 @@ public:
 	void* entry;
 };
 
+// A link of the flat topology
+struct link_entry {
+	int dst;
+	double cost;		// INFINITY once reset
+	void* entry;
+};
+
+// Scratch space of a shortest path computation (see RouteLogic::dijkstra)
+struct route_scratch {
+	double* hopcnt;
+	char* done;
+	double* heap_cost;	// binary heap on (cost, node)
+	int* heap_node;
+	int heap_size;
+	int heap_max;
+};
+
 class RouteLogic : public TclObject {
 public:
 	RouteLogic();
@@ -90,12 +107,49 @@ protected:
 	void reset(int src, int dst);
 	void compute_routes();
 	void insert(int src, int dst, double cost);
-	adj_entry *adj_;
-	route_entry *route_;
+	route_entry *route_;	// size_ x size_ next hops, 0 if not computed
 	void insert(int src, int dst, double cost, void* entry);
 	void reset_all();
 	int size_,
-		maxnode_;
+		maxnode_;	// nodes the link lists are allocated for
+
+	/*
+	 * Flat topology: the links of node i are links_[i][0] to
+	 * links_[i][nlinks_[i] - 1].  The routes of each source are
+	 * computed with a binary heap, in O(e log n) instead of O(n^2).
+	 */
+	link_entry *find_link(int src, int dst);
+	void alloc_routes(int n);
+	void scratch_init(route_scratch* s);
+	void scratch_free(route_scratch* s);
+	void dijkstra(int src, route_scratch* s);
+	void compute_sources(int* sources, int n);
+#ifdef USE_THREADS
+	struct route_job {
+		RouteLogic* rl;
+		int* sources;
+		int step;
+	};
+	static void* route_thread(void* arg);
+#endif
+	void save_links();
+	int changed_links(link_entry* changed, int* srcs, int max);
+	link_entry **links_;
+	int *nlinks_, *maxlinks_;
+	int nlinks_total_;
+	route_entry *route_alloc_;	// storage of route_, kept by reset_all
+	int route_alloc_size_;
+	int route_threads_;		// threads computing the sources
+	/*
+	 * Incremental computation: the links and the distances of the last
+	 * computation, to compute again only the sources a change affects
+	 */
+	int incremental_;
+	double *dist_;			// size_ x size_ distances
+	int *old_start_;		// links of i: old_links_[old_start_[i]] ..
+	link_entry *old_links_;		//   old_links_[old_start_[i + 1] - 1]
+	int old_size_;			// size_ of old_links_, 0 if none
+	int old_max_;
 
 	/**** Hierarchical routing support ****/
 
@@ -107,7 +161,8 @@ protected:
 	void hier_insert(int *src, int *dst, int cost);
 	void hier_reset(int *src, int *dst);
 	void hier_compute();
-	void hier_compute_routes(int index, int d);
+	void hier_compute_routes(int index, int d, adj_entry* adj,
+				 route_entry* route);
 
 	/* Debugging print functions */
 	void hier_print_hadj();
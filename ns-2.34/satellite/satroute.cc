@@ -447,79 +447,27 @@ void* SatRouteObject::lookup_entry(int s, int d)
 // This method is used for debugging only
 void SatRouteObject::dump()
 {
-	int i, src, dst;
-	for (i = 0; i < (size_ * size_); i++) {
-		if (adj_[i].cost != SAT_ROUTE_INFINITY) {
-			src = i / size_ - 1;
-			dst = i % size_ - 1;
-			printf("Found a link from %d to %d with cost %f\n", src, dst, adj_[i].cost);
+	int i, j, src, dst;
+	for (i = 0; i < size_; i++) {
+		for (j = 0; j < nlinks_[i]; j++) {
+			if (links_[i][j].cost == SAT_ROUTE_INFINITY)
+				continue;
+			src = i - 1;
+			dst = links_[i][j].dst - 1;
+			printf("Found a link from %d to %d with cost %f\n", src, dst, links_[i][j].cost);
 		}
         }
 }
 
+// Routes of a single node (data driven computation).  The rows of the
+// other nodes are left as they are: only this one is installed.
 void SatRouteObject::node_compute_routes(int node)
 {
-        int n = size_;
-        int* parent = new int[n];
-        double* hopcnt = new double[n];
-#define ADJ(i, j) adj_[INDEX(i, j, size_)].cost
-#define ADJ_ENTRY(i, j) adj_[INDEX(i, j, size_)].entry
-#define ROUTE(i, j) route_[INDEX(i, j, size_)].next_hop
-#define ROUTE_ENTRY(i, j) route_[INDEX(i, j, size_)].entry
-        delete[] route_;
-        route_ = new route_entry[n * n];
-        memset((char *)route_, 0, n * n * sizeof(route_[0]));
-        /* compute routes only for node "node" */
-        int k = node + 1; // must add one to get the right offset in tables  
-        int v;
-        for (v = 0; v < n; v++) 
-                parent[v] = v;
-
-        /* set the route for all neighbours first */
-        for (v = 1; v < n; ++v) {
-                if (parent[v] != k) {
-                        hopcnt[v] = ADJ(k, v);
-                        if (hopcnt[v] != SAT_ROUTE_INFINITY) {
-                                ROUTE(k, v) = v;
-                                ROUTE_ENTRY(k, v) = ADJ_ENTRY(k, v);
-                        }
-                }
-        }
-        for (v = 1; v < n; ++v) {
-                /*
-                 * w is the node that is the nearest to the subtree
-                 * that has been routed
-                 */
-                int o = 0;
-                /* XXX */
-                hopcnt[0] = SAT_ROUTE_INFINITY;
-                int w;
-                for (w = 1; w < n; w++)
-                        if (parent[w] != k && hopcnt[w] < hopcnt[o])
-                                o = w;
-                parent[o] = k;
-                /*
-                 * update distance counts for the nodes that are
-                 * adjacent to o
-                 */
-                if (o == 0)
-                        continue;
-                for (w = 1; w < n; w++) {
-                        if (parent[w] != k &&
-                            hopcnt[o] + ADJ(o, w) < hopcnt[w]) {
-                                ROUTE(k, w) = ROUTE(k, o);
-                                ROUTE_ENTRY(k, w) =
-                                    ROUTE_ENTRY(k, o);
-                                hopcnt[w] = hopcnt[o] + ADJ(o, w);
-                        }
-                }
-        }
-        /*
-         * The route to yourself is yourself.
-         */
-        ROUTE(k, k) = k;
-        ROUTE_ENTRY(k, k) = 0; // This should not matter
+	route_scratch s;
 
-        delete[] hopcnt;
-        delete[] parent;
+	alloc_routes(size_);
+	old_size_ = 0;	// the next compute_routes() computes all the nodes
+	scratch_init(&s);
+	dijkstra(node + 1, &s); // must add one to get the right offset in tables
+	scratch_free(&s);
 }
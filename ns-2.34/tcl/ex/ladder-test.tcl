@@ -0,0 +1,28 @@
+#
+# Usage: ns ladder-test.tcl [runs] [operations]
+#
+# Random inserts, cancels and deques on Scheduler/Ladder, checked
+# against Scheduler/Heap: both must deque the same events in the same
+# order.  Each run uses its own seed.
+#
+
+set runs 100
+set ops 20000
+if {$argc >= 1} {
+    set runs [lindex $argv 0]
+}
+if {$argc >= 2} {
+    set ops [lindex $argv 1]
+}
+
+set sched [new Scheduler/Ladder]
+set failed 0
+for {set seed 1} {$seed <= $runs} {incr seed} {
+    set op [$sched test $seed $ops]
+    if {$op != 0} {
+	puts "seed $seed: queues differ at operation $op"
+	incr failed
+    }
+}
+puts "$failed of $runs runs failed"
+exit [expr $failed > 0]
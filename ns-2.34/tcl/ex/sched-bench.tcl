@@ -0,0 +1,56 @@
+#
+# Compare the event schedulers on the queue operations of a recorded
+# simulation.
+#
+# To record the operations of a scenario, select the recording
+# scheduler right after creating the simulator:
+#
+#	set ns [new Simulator]
+#	$ns use-scheduler Recorder
+#	[$ns set scheduler_] record events.rec
+#
+# then replay them on each scheduler:
+#
+#	ns sched-bench.tcl events.rec ?repeat? ?schedulers?
+#
+# For each scheduler, the cpu time of the best of repeat runs is printed,
+# with the dequeues that returned another event than the recorded one
+# (should be 0: all the schedulers dispatch same-time events in FIFO order).
+#
+
+if { $argc < 1 } {
+	puts "usage: ns sched-bench.tcl events.rec ?repeat? ?schedulers?"
+	exit 1
+}
+set file [lindex $argv 0]
+set repeat 3
+if { $argc > 1 } {
+	set repeat [lindex $argv 1]
+}
+set types { Heap Calendar Splay Map Ladder }
+if { $argc > 2 } {
+	set types [lrange $argv 2 end]
+}
+
+puts [format "%-10s %12s %12s %10s" scheduler cpu(s) ops/s mismatches]
+foreach type $types {
+	set best -1
+	for { set i 0 } { $i < $repeat } { incr i } {
+		# a new queue for each run, not deleted: the destructor
+		# would reset Scheduler::instance()
+		set s [new Scheduler/$type]
+		set r [$s replay $file]
+		set t [lindex $r 0]
+		if { $best < 0 || $t < $best } {
+			set best $t
+		}
+	}
+	set ops [lindex $r 1]
+	if { $best > 0 } {
+		set rate [expr $ops / $best]
+	} else {
+		set rate 0
+	}
+	puts [format "%-10s %12.3f %12.0f %10d" $type $best $rate [lindex $r 2]]
+}
+exit 0
@@ -93,3 +93,44 @@ CMUTrace/EOT set src_ 0
  CMUTrace/EOT set callback_ 0
  CMUTrace/EOT set show_tcphdr_ 0
 
+#
+# Binary traces of mobile nodes, used instead of CMUTrace after
+# "$ns bintrace-all"
+#
+CRBinTrace instproc init { tname type } {
+	$self next $tname $type
+	$self instvar type_ src_ dst_ callback_ show_tcphdr_
+
+	set type_ $type
+	set src_ 0
+	set dst_ 0
+	set callback_ 0
+	set show_tcphdr_ 0
+}
+
+Class CRBinTrace/Send -superclass CRBinTrace
+CRBinTrace/Send instproc init { tname } {
+	$self next $tname "s"
+}
+
+Class CRBinTrace/Recv -superclass CRBinTrace
+CRBinTrace/Recv instproc init { tname } {
+	$self next $tname "r"
+}
+
+Class CRBinTrace/Drop -superclass CRBinTrace
+CRBinTrace/Drop instproc init { tname } {
+	$self next $tname "D"
+}
+
+Class CRBinTrace/EOT -superclass CRBinTrace
+CRBinTrace/EOT instproc init { tname } {
+	$self next $tname "x"
+}
+
+foreach cls { CRBinTrace/Recv CRBinTrace/Send CRBinTrace/Drop CRBinTrace/EOT } {
+	$cls set src_ 0
+	$cls set dst_ 0
+	$cls set callback_ 0
+	$cls set show_tcphdr_ 0
+}
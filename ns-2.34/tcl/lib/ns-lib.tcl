@@ -939,6 +939,148 @@ Simulator instproc at-now args {
 	return [eval $scheduler_ at-now $args]
 }
 
+# Runs the rest of the scenario as n replications, each in its own
+# process forked from this one, at most jobs (default: one per cpu) at a
+# time.  The fork is made now, or at time "at" of the run if given.
+# Replication i works in the directory replica.<i>: the files open for
+# writing (traces...) are replaced by copies there, and the files it
+# opens (PUmodel stat files...) are its own.  It moves every RNG i
+# substreams ahead, calls "eval $start $i" if start is given, and goes
+# on with the script (replicate returns i) or the run; "$ns replica"
+# also gives i.  The parent waits for the children, then calls
+# replicate-done with their exit status.
+Simulator instproc replicate { n {at ""} {start ""} {jobs 0} } {
+	$self instvar scheduler_
+	if { $at != "" && $at > [$self now] } {
+		$self at $at [list $self replicate $n "" $start $jobs]
+		return -1
+	}
+	foreach c [file channels] {
+		catch { flush $c }
+	}
+	set i [$scheduler_ fork-replicas $n $jobs]
+	if { $i < 0 } {
+		$self replicate-done [$scheduler_ replica-status]
+		return -1
+	}
+	foreach rng [RNG info instances] {
+		for {set k 0} {$k < $i} {incr k} {
+			$rng next-substream
+		}
+	}
+	if { $start != "" } {
+		eval $start $i
+	}
+	return $i
+}
+
+# Index of the replication run by this process, -1 if none
+Simulator instproc replica {} {
+	$self instvar scheduler_
+	return [$scheduler_ replica]
+}
+
+# Called in the parent once all the replications exited: reports the
+# failed ones and exits.  Redefine it to collect the results instead.
+Simulator instproc replicate-done { status } {
+	set failed 0
+	set i 0
+	foreach st $status {
+		if { $st != 0 } {
+			puts stderr "replication $i failed with status $st"
+			incr failed
+		}
+		incr i
+	}
+	exit [expr $failed > 0]
+}
+
+# Checkpoint of the run at time "at": a copy of the whole process is
+# kept by a server listening on the unix socket "file", until
+# "$ns checkpoint-drop file".  "$ns restore file script ?dir?", from another
+# ns, resumes a copy of the run from that time after evaluating script
+# in it (to set the parameters of a variant), and exits with its status.
+# The copy writes its output in the directory "dir" (restore.<pid> by
+# default), with copies of the trace files open at the checkpoint, as
+# the replications do.  The original run goes on, or exits if
+# "then" is "exit".  Returns 0 in the original run, 1 in the copies, -1
+# if the checkpoint failed: the run then goes on without it.
+Simulator instproc checkpoint { at file {then continue} } {
+	if { $at > [$self now] } {
+		$self at $at [list $self checkpoint $at $file $then]
+		return 0
+	}
+	$self instvar scheduler_ noCheckpoint_
+	set why ""
+	if { [$scheduler_ info class] == "Scheduler/RealTime" } {
+		lappend why "the real-time scheduler"
+	}
+	foreach obj [array names noCheckpoint_] {
+		lappend why "$obj ($noCheckpoint_($obj))"
+	}
+	if { $why != "" } {
+		puts stderr "checkpoint at [$self now] failed, not checkpointable: [join $why {, }]"
+		return -1
+	}
+	foreach c [file channels] {
+		catch { flush $c }
+	}
+	if [catch { ns-checkpoint $file } st] {
+		puts stderr "checkpoint at [$self now] failed: $st"
+		return -1
+	}
+	if { $st == 0 && $then == "exit" } {
+		exit 0
+	}
+	return $st
+}
+
+# Objects that a copy of the process cannot take over (live network
+# taps, external processes...) make the checkpoints fail
+Simulator instproc non-checkpointable { obj {reason "declared"} } {
+	$self instvar noCheckpoint_
+	set noCheckpoint_($obj) $reason
+}
+
+Simulator instproc checkpointable { obj } {
+	$self instvar noCheckpoint_
+	catch { unset noCheckpoint_($obj) }
+}
+
+Simulator instproc restore { file {script ""} {dir ""} } {
+	if { $dir == "" } {
+		exit [ns-restore $file $script]
+	}
+	exit [ns-restore $file $script $dir]
+}
+
+Simulator instproc checkpoint-drop { file } {
+	ns-checkpoint-drop $file
+}
+
+# Schedules a list of {time script} pairs in one call, eg a whole
+# traffic pattern: "$ns at-batch {1.0 {$cbr_(0) start} 2.5 {$cbr_(1) start}}"
+Simulator instproc at-batch { events } {
+	$self instvar scheduler_
+	return [$scheduler_ at-batch $events]
+}
+
+# Replays a mobility scenario (setdest, BonnMotion with "bonnmotion",
+# or a binary image saved by MobilityLoader) from per-node waypoint
+# queues, instead of sourcing one "at" event per movement
+Simulator instproc load-mobility { file {format setdest} } {
+	$self instvar mobilityLoader_
+	if ![info exists mobilityLoader_] {
+		set mobilityLoader_ [new MobilityLoader]
+	}
+	if { $format == "bonnmotion" } {
+		$mobilityLoader_ load-bonnmotion $file
+	} else {
+		$mobilityLoader_ load $file
+	}
+	return $mobilityLoader_
+}
+
 Simulator instproc cancel args {
 	$self instvar scheduler_
 	return [eval $scheduler_ cancel $args]
@@ -1056,6 +1198,18 @@ Simulator instproc dumpq {} {
 	$scheduler_ dumpq
 }
 
+# Print the allocation counters of the event pools on file (- for stdout)
+Simulator instproc pool-stats { {file -} } {
+	$self instvar scheduler_
+	$scheduler_ pool-stats $file
+}
+
+# Print the allocation counters of the event pools on file when ns exits
+Simulator instproc pool-report { {file -} } {
+	$self instvar scheduler_
+	$scheduler_ pool-report $file
+}
+
 Simulator instproc is-started {} {
 	$self instvar started_
 	return [info exists started_]
@@ -1301,12 +1455,15 @@ Simulator instproc duplex-link-op { n1 n2 op args } {
 }
 
 Simulator instproc flush-trace {} {
-	$self instvar alltrace_
+	$self instvar alltrace_ binTraceWriter_
 	if [info exists alltrace_] {
 		foreach trace $alltrace_ {
 			$trace flush
 		}
 	}
+	if [info exists binTraceWriter_] {
+		$binTraceWriter_ flush
+	}
 }
 
 Simulator instproc namtrace-all file   {
@@ -1392,6 +1549,30 @@ Simulator instproc trace-all file {
 	set traceAllFile_ $file
 }
 
+#
+# Write the packet traces of mobile nodes as binary records into file
+# (see trace/bintrace.h), decoded by indep-utils/bintrace-dec.
+# trace-all must still be called: movements and routing logs are kept
+# in its text trace. With threaded set, the records are written by a
+# separate thread (unless ns is configured with --disable-threads).
+#
+Simulator instproc bintrace-all { file {bufsize 4194304} {threaded 0} } {
+	$self instvar binTraceWriter_
+	if ![info exists binTraceWriter_] {
+		set binTraceWriter_ [new BinTraceWriter]
+	}
+	$binTraceWriter_ open $file $bufsize $threaded
+}
+
+Simulator instproc get-ns-bintrace {} {
+	$self instvar binTraceWriter_
+	if [info exists binTraceWriter_] {
+		return $binTraceWriter_
+	} else {
+		return ""
+	}
+}
+
 Simulator instproc get-nam-traceall {} {
 	$self instvar namtraceAllFile_
 	if [info exists namtraceAllFile_] {
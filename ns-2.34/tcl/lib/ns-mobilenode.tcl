@@ -762,7 +762,13 @@ Node/MobileNode instproc mobility-trace { ttype atype } {
 	        puts "Please use trace-all command to define it."
 		return ""
 	}
-	set T [new CMUTrace/$ttype $atype]
+	set bintrace [$ns get-ns-bintrace]
+	if { $bintrace != "" } {
+		set T [new CRBinTrace/$ttype $atype]
+		$T writer $bintrace
+	} else {
+		set T [new CMUTrace/$ttype $atype]
+	}
 	$T newtrace [Simulator set WirelessNewTrace_]
 	$T tagged [Simulator set TaggedTrace_]
 	$T target [$ns nullagent]
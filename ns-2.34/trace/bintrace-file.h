@@ -0,0 +1,74 @@
+// bintrace-file.h
+
+// Binary trace format, written by the CRBinTrace objects through a
+// BinTraceWriter (see trace/bintrace.h) and turned back into the
+// -newtrace text format by indep-utils/bintrace-dec.
+//
+// Layout (host byte order):
+//   bin_trace_header
+//   char ptype_name[number_ptypes][BIN_TRACE_PTYPE_LEN]	(packet type names)
+//   bin_trace_record[]					(until the end of the file)
+
+#ifndef NS_BIN_TRACE_FILE_H
+#define NS_BIN_TRACE_FILE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#define BIN_TRACE_MAGIC		"NSBTRACE"
+#define BIN_TRACE_MAGIC_LEN	8
+#define BIN_TRACE_VERSION	1
+// Written in the header to detect a file produced on a host with a different byte order
+#define BIN_TRACE_BYTE_ORDER	0x01020304
+#define BIN_TRACE_PTYPE_LEN	32
+#define BIN_TRACE_LEVEL_LEN	3
+#define BIN_TRACE_WHY_LEN	4
+
+// MAC header of the record
+#define BIN_TRACE_MAC_80211	0
+#define BIN_TRACE_MAC_SMAC	1
+
+// Protocol specific part of the record (ext[], ext_d)
+#define BIN_TRACE_EXT_NONE	0
+#define BIN_TRACE_EXT_ARP	1	// op (1 = REQUEST), sha, spa, tha, tpa
+#define BIN_TRACE_EXT_TCP	2	// seqno, ackno, forwards, opt forwards
+#define BIN_TRACE_EXT_CBR	3	// seqno, forwards, opt forwards
+#define BIN_TRACE_EXT_AODV_REQ	4	// type, hops, bcast id, dst, dst seqno, src, src seqno
+#define BIN_TRACE_EXT_AODV_REP	5	// type, hops, dst, dst seqno; ext_d: lifetime
+
+// flags
+#define BIN_TRACE_HAS_IP	0x01
+
+struct bin_trace_header {
+	char magic[BIN_TRACE_MAGIC_LEN];	// BIN_TRACE_MAGIC, without the trailing '\0'
+	uint32_t version;			// BIN_TRACE_VERSION
+	uint32_t byte_order;			// BIN_TRACE_BYTE_ORDER
+	uint32_t record_size;			// sizeof(bin_trace_record)
+	uint32_t number_ptypes;			// entries of the packet type name table
+};
+
+struct bin_trace_record {
+	double time;
+	double x, y, z;				// location of the node
+	double energy;				// -1 if there is no energy model
+	double mac_dur;				// SMAC duration
+	double ext_d;
+	int32_t node;				// tracing node (-Hs, -Ni)
+	int32_t next_hop;			// -Hd
+	int32_t uid;
+	int32_t ptype;				// index in the packet type name table
+	int32_t size;
+	int32_t channel;			// hdr_cmn::channel_
+	uint32_t mac[4];			// 802.11: duration, ra, ta, ether type; SMAC: -, dst, src, -
+	int32_t ip[6];				// src, sport, dst, dport, flow id, ttl
+	int32_t ext[7];
+	char op;				// s, r, f, d, x
+	char level[BIN_TRACE_LEVEL_LEN];	// AGT, RTR, IFQ, MAC, PHY (not terminated)
+	char why[BIN_TRACE_WHY_LEN];		// reason, e.g. --- or a drop reason (not terminated)
+	uint8_t mac_kind;			// BIN_TRACE_MAC_*
+	uint8_t ext_kind;			// BIN_TRACE_EXT_*
+	uint8_t flags;				// BIN_TRACE_HAS_IP
+	uint8_t reserved;			// padding, set to 0
+};
+
+#endif
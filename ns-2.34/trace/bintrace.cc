@@ -0,0 +1,536 @@
+/* -*-	Mode:C++; c-basic-offset:8; tab-width:8; indent-tabs-mode:t -*- */
+
+/*
+ * Binary packet traces for mobile nodes (see bintrace.h)
+ */
+
+#include <stdlib.h>
+#include <packet.h>
+#include <ip.h>
+#include <tcp.h>
+#include <rtp.h>
+#include <arp.h>
+#include <mac.h>
+#include <mac-802_11.h>
+#include <smac.h>
+#include <address.h>
+#include <aodv/aodv_packet.h>
+#include <cmu-trace.h>
+#include <mobilenode.h>
+#include <simulator.h>
+#include <energy-model.h>
+#include <god.h>
+#include "bintrace.h"
+
+
+/* ======================================================================
+   BinTraceWriter
+   ====================================================================== */
+
+static class BinTraceWriterClass : public TclClass {
+public:
+	BinTraceWriterClass() : TclClass("BinTraceWriter") { }
+	TclObject* create(int, const char*const*) {
+		return (new BinTraceWriter());
+	}
+} bintracewriter_class;
+
+BinTraceWriter *BinTraceWriter::writers_ = NULL;
+
+BinTraceWriter::BinTraceWriter() : fp_(NULL), buf_(NULL), size_(0), used_(0),
+				   threaded_(0)
+{
+#ifdef USE_THREADS
+	spare_ = NULL;
+	pending_ = NULL;
+	pending_len_ = 0;
+	stop_ = 0;
+#endif
+	if (writers_ == NULL)
+		atexit(sync_all);
+	next_ = writers_;
+	writers_ = this;
+}
+
+BinTraceWriter::~BinTraceWriter()
+{
+	BinTraceWriter **w;
+
+	close();
+	for (w = &writers_; *w != NULL; w = &(*w)->next_)
+		if (*w == this) {
+			*w = next_;
+			break;
+		}
+}
+
+void BinTraceWriter::sync_all()
+{
+	for (BinTraceWriter *w = writers_; w != NULL; w = w->next_)
+		w->sync();
+}
+
+/*
+ * $writer open <file> ?<buffer size>? ?<threaded>?
+ * $writer flush
+ * $writer close
+ */
+int BinTraceWriter::command(int argc, const char*const* argv)
+{
+	Tcl& tcl = Tcl::instance();
+
+	if (argc == 2) {
+		if (strcmp(argv[1], "flush") == 0) {
+			sync();
+			return (TCL_OK);
+		}
+		if (strcmp(argv[1], "close") == 0) {
+			close();
+			return (TCL_OK);
+		}
+	} else if (argc >= 3 && argc <= 5) {
+		if (strcmp(argv[1], "open") == 0) {
+			long size = (argc > 3) ? atol(argv[3]) : BIN_TRACE_BUFFER_SIZE;
+			int threaded = (argc > 4) ? atoi(argv[4]) : 0;
+			if (size < (long)sizeof(bin_trace_record)) {
+				tcl.resultf("bintrace: buffer size %s too small", argv[3]);
+				return (TCL_ERROR);
+			}
+			if (open(argv[2], (size_t)size, threaded) < 0) {
+				tcl.resultf("bintrace: can't open %s for writing", argv[2]);
+				return (TCL_ERROR);
+			}
+			return (TCL_OK);
+		}
+	}
+	return (TclObject::command(argc, argv));
+}
+
+int BinTraceWriter::open(const char *file, size_t size, int threaded)
+{
+	bin_trace_header header;
+	char name[BIN_TRACE_PTYPE_LEN];
+
+	close();
+	if ((fp_ = fopen(file, "wb")) == NULL)
+		return -1;
+
+	// records are written in whole buffers
+	setvbuf(fp_, NULL, _IONBF, 0);
+	size_ = size - size % sizeof(bin_trace_record);
+	buf_ = new char[size_];
+	used_ = 0;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BIN_TRACE_MAGIC, BIN_TRACE_MAGIC_LEN);
+	header.version = BIN_TRACE_VERSION;
+	header.byte_order = BIN_TRACE_BYTE_ORDER;
+	header.record_size = sizeof(bin_trace_record);
+	header.number_ptypes = PT_NTYPE + 1;
+	write_out((const char *)&header, sizeof(header));
+	for (int i = 0; i < (int)header.number_ptypes; i++) {
+		const char *n = packet_info.name((packet_t)i);
+		memset(name, 0, sizeof(name));
+		if (n != NULL)
+			strncpy(name, n, BIN_TRACE_PTYPE_LEN - 1);
+		write_out(name, sizeof(name));
+	}
+
+	threaded_ = 0;
+	if (threaded) {
+#ifdef USE_THREADS
+		spare_ = new char[size_];
+		pending_ = NULL;
+		stop_ = 0;
+		pthread_mutex_init(&lock_, NULL);
+		pthread_cond_init(&cond_, NULL);
+		if (pthread_create(&thread_, NULL, writer_thread, this) == 0)
+			threaded_ = 1;
+		else {
+			fprintf(stderr, "bintrace: can't create the writer thread, "
+				"writing synchronously\n");
+			delete [] spare_;
+			spare_ = NULL;
+		}
+#else
+		fprintf(stderr, "bintrace: ns built without threads "
+			"(configure --disable-threads), writing synchronously\n");
+#endif
+	}
+	return 0;
+}
+
+void BinTraceWriter::write_out(const char *buf, size_t len)
+{
+	if (len > 0 && fwrite(buf, 1, len, fp_) != len) {
+		fprintf(stderr, "bintrace: write error\n");
+		exit(1);
+	}
+}
+
+#ifdef USE_THREADS
+void *BinTraceWriter::writer_thread(void *arg)
+{
+	BinTraceWriter *w = (BinTraceWriter *)arg;
+
+	pthread_mutex_lock(&w->lock_);
+	for (;;) {
+		while (w->pending_ == NULL && !w->stop_)
+			pthread_cond_wait(&w->cond_, &w->lock_);
+		if (w->pending_ == NULL)
+			break;
+		pthread_mutex_unlock(&w->lock_);
+		w->write_out(w->pending_, w->pending_len_);
+		pthread_mutex_lock(&w->lock_);
+		w->pending_ = NULL;
+		pthread_cond_broadcast(&w->cond_);
+	}
+	pthread_mutex_unlock(&w->lock_);
+	return NULL;
+}
+#endif
+
+void BinTraceWriter::flush_buffer()
+{
+	if (fp_ == NULL || used_ == 0)
+		return;
+#ifdef USE_THREADS
+	if (threaded_) {
+		char *full = buf_;
+
+		// wait for the previous buffer, then swap them
+		pthread_mutex_lock(&lock_);
+		while (pending_ != NULL)
+			pthread_cond_wait(&cond_, &lock_);
+		pending_ = full;
+		pending_len_ = used_;
+		pthread_cond_broadcast(&cond_);
+		pthread_mutex_unlock(&lock_);
+		buf_ = spare_;
+		spare_ = full;
+		used_ = 0;
+		return;
+	}
+#endif
+	write_out(buf_, used_);
+	used_ = 0;
+}
+
+void BinTraceWriter::sync()
+{
+	if (fp_ == NULL)
+		return;
+	flush_buffer();
+#ifdef USE_THREADS
+	if (threaded_) {
+		pthread_mutex_lock(&lock_);
+		while (pending_ != NULL)
+			pthread_cond_wait(&cond_, &lock_);
+		pthread_mutex_unlock(&lock_);
+	}
+#endif
+	fflush(fp_);
+}
+
+void BinTraceWriter::close()
+{
+	if (fp_ == NULL)
+		return;
+	sync();
+#ifdef USE_THREADS
+	if (threaded_) {
+		pthread_mutex_lock(&lock_);
+		stop_ = 1;
+		pthread_cond_broadcast(&cond_);
+		pthread_mutex_unlock(&lock_);
+		pthread_join(thread_, NULL);
+		pthread_mutex_destroy(&lock_);
+		pthread_cond_destroy(&cond_);
+		delete [] spare_;
+		spare_ = NULL;
+		threaded_ = 0;
+	}
+#endif
+	fclose(fp_);
+	fp_ = NULL;
+	delete [] buf_;
+	buf_ = NULL;
+	size_ = used_ = 0;
+}
+
+
+/* ======================================================================
+   CRBinTrace
+   ====================================================================== */
+
+static class CRBinTraceClass : public TclClass {
+public:
+	CRBinTraceClass() : TclClass("CRBinTrace") { }
+	TclObject* create(int, const char*const* argv) {
+		return (new CRBinTrace(argv[4], *argv[5]));
+	}
+} crbintrace_class;
+
+CRBinTrace::CRBinTrace(const char *s, char t) : Trace(t), smac_(-1),
+						node_(0), writer_(0)
+{
+	bzero(tracename_, sizeof(tracename_));
+	strncpy(tracename_, s, BIN_TRACE_LEVEL_LEN);
+
+	if (strcmp(tracename_, "RTR") == 0 || strcmp(tracename_, "TRP") == 0)
+		tracetype_ = TR_ROUTER;
+	else if (strcmp(tracename_, "PHY") == 0)
+		tracetype_ = TR_PHY;
+	else if (strcmp(tracename_, "MAC") == 0)
+		tracetype_ = TR_MAC;
+	else if (strcmp(tracename_, "IFQ") == 0)
+		tracetype_ = TR_IFQ;
+	else if (strcmp(tracename_, "AGT") == 0)
+		tracetype_ = TR_AGENT;
+	else {
+		fprintf(stderr, "CRBinTrace Initialized with invalid type\n");
+		exit(1);
+	}
+	assert(type_ == DROP || type_ == SEND || type_ == RECV
+	       || ((type_ == EOT) && (tracetype_ == TR_MAC)));
+}
+
+int
+CRBinTrace::command(int argc, const char*const* argv)
+{
+	if (argc == 3) {
+		if (strcmp(argv[1], "node") == 0) {
+			node_ = (MobileNode*) TclObject::lookup(argv[2]);
+			if (node_ == 0)
+				return TCL_ERROR;
+			return TCL_OK;
+		}
+		if (strcmp(argv[1], "writer") == 0) {
+			writer_ = (BinTraceWriter*) TclObject::lookup(argv[2]);
+			if (writer_ == 0)
+				return TCL_ERROR;
+			return TCL_OK;
+		}
+		// the records are decoded into the -newtrace format
+		if (strcmp(argv[1], "newtrace") == 0)
+			return TCL_OK;
+	}
+	return Trace::command(argc, argv);
+}
+
+int CRBinTrace::node_energy()
+{
+	Node* thisnode = Node::get_node_by_address(src_);
+	double energy = 1;
+	if (thisnode) {
+		if (thisnode->energy_model()) {
+			energy = thisnode->energy_model()->energy();
+		}
+	}
+	if (energy > 0) return 1;
+	return 0;
+}
+
+void
+CRBinTrace::recv(Packet *p, Handler *h)
+{
+	if (!node_energy()) {
+		Packet::free(p);
+		return;
+	}
+	assert(node_ != 0);
+	/*
+	 * Agent Trace "stamp" the packet with the optimal route on
+	 * sending.
+	 */
+	if (tracetype_ == TR_AGENT && type_ == SEND) {
+		God::instance()->stampPacket(p);
+	}
+	format(p, "---");
+	if(target_ == 0)
+		Packet::free(p);
+	else
+		send(p, h);
+}
+
+void
+CRBinTrace::recv(Packet *p, const char* why)
+{
+	assert(node_ != 0 && type_ == DROP);
+	if (!node_energy()) {
+		Packet::free(p);
+		return;
+	}
+	format(p, why);
+	Packet::free(p);
+}
+
+void
+CRBinTrace::format_mac(Packet *p, bin_trace_record *r)
+{
+	struct hdr_cmn *ch = HDR_CMN(p);
+
+	if (smac_ < 0)
+		smac_ = (strcmp(Simulator::instance().macType(), "Mac/SMAC") == 0);
+
+	if (smac_) {
+		struct hdr_smac *sh = HDR_SMAC(p);
+		r->mac_kind = BIN_TRACE_MAC_SMAC;
+		r->mac_dur = sh->duration;
+		r->mac[1] = sh->dstAddr;
+		r->mac[2] = sh->srcAddr;
+		return;
+	}
+
+	struct hdr_mac802_11 *mh = HDR_MAC802_11(p);
+	// as in CMUTrace::format_mac, dh_body is not an ether type
+	// for the control and management frames
+	bool print_ether_type = true;
+	if ((ch->ptype() == PT_MAC) &&
+	    ((mh->dh_fc.fc_type == MAC_Type_Control) ||
+	     (mh->dh_fc.fc_type == MAC_Type_Management)))
+		print_ether_type = false;
+
+	r->mac_kind = BIN_TRACE_MAC_80211;
+	r->mac[0] = mh->dh_duration;
+	r->mac[1] = ETHER_ADDR(mh->dh_ra);
+	r->mac[2] = ETHER_ADDR(mh->dh_ta);
+	r->mac[3] = print_ether_type ? GET_ETHER_TYPE(mh->dh_body) : 0;
+}
+
+void
+CRBinTrace::format_ip(Packet *p, bin_trace_record *r)
+{
+	struct hdr_ip *ih = HDR_IP(p);
+
+	r->flags |= BIN_TRACE_HAS_IP;
+	r->ip[0] = Address::instance().get_nodeaddr(ih->saddr());
+	r->ip[1] = ih->sport();
+	r->ip[2] = Address::instance().get_nodeaddr(ih->daddr());
+	r->ip[3] = ih->dport();
+	r->ip[4] = ih->flowid();
+	r->ip[5] = ih->ttl_;
+}
+
+void
+CRBinTrace::format_aodv(Packet *p, bin_trace_record *r)
+{
+	struct hdr_aodv *ah = HDR_AODV(p);
+	struct hdr_aodv_request *rq = HDR_AODV_REQUEST(p);
+	struct hdr_aodv_reply *rp = HDR_AODV_REPLY(p);
+
+	switch(ah->ah_type) {
+	case AODVTYPE_RREQ:
+		r->ext_kind = BIN_TRACE_EXT_AODV_REQ;
+		r->ext[0] = rq->rq_type;
+		r->ext[1] = rq->rq_hop_count;
+		r->ext[2] = rq->rq_bcast_id;
+		r->ext[3] = rq->rq_dst;
+		r->ext[4] = rq->rq_dst_seqno;
+		r->ext[5] = rq->rq_src;
+		r->ext[6] = rq->rq_src_seqno;
+		break;
+	case AODVTYPE_RREP:
+	case AODVTYPE_HELLO:
+	case AODVTYPE_RERR:
+		r->ext_kind = BIN_TRACE_EXT_AODV_REP;
+		r->ext[0] = rp->rp_type;
+		r->ext[1] = rp->rp_hop_count;
+		r->ext[2] = rp->rp_dst;
+		r->ext[3] = rp->rp_dst_seqno;
+		r->ext_d = rp->rp_lifetime;
+		break;
+	default:
+		fprintf(stderr, "%s: invalid AODV packet type\n", __FUNCTION__);
+		abort();
+	}
+}
+
+void
+CRBinTrace::format(Packet *p, const char *why)
+{
+	struct hdr_cmn *ch = HDR_CMN(p);
+	struct hdr_ip *ih = HDR_IP(p);
+	bin_trace_record r;
+	char op = (char) type_;
+
+	if (writer_ == 0)
+		return;
+	memset(&r, 0, sizeof(r));
+
+	// same event type as the -newtrace format of CMUTrace
+	int src = Address::instance().get_nodeaddr(ih->saddr());
+	if (tracetype_ == TR_ROUTER && type_ == SEND && src_ != src)
+		op = FWRD;
+	if (op == DROP)
+		op = 'd';
+
+	r.op = op;
+	r.time = Scheduler::instance().clock();
+	r.node = src_;
+	r.next_hop = ch->next_hop_;
+	node_->getLoc(&r.x, &r.y, &r.z);
+	r.energy = -1;
+	Node* thisnode = Node::get_node_by_address(src_);
+	if (thisnode && thisnode->energy_model())
+		r.energy = thisnode->energy_model()->energy();
+	memcpy(r.level, tracename_, BIN_TRACE_LEVEL_LEN);
+	strncpy(r.why, why, BIN_TRACE_WHY_LEN);
+	r.uid = ch->uid();
+	r.ptype = ch->ptype();
+	r.size = ch->size();
+	r.channel = ch->channel_;
+
+	format_mac(p, &r);
+
+	switch(ch->ptype()) {
+	case PT_MAC:
+	case PT_SMAC:
+		break;
+	case PT_ARP: {
+		struct hdr_arp *ah = HDR_ARP(p);
+		r.ext_kind = BIN_TRACE_EXT_ARP;
+		r.ext[0] = (ah->arp_op == ARPOP_REQUEST);
+		r.ext[1] = ah->arp_sha;
+		r.ext[2] = ah->arp_spa;
+		r.ext[3] = ah->arp_tha;
+		r.ext[4] = ah->arp_tpa;
+		break;
+	}
+	default:
+		format_ip(p, &r);
+		switch(ch->ptype()) {
+		case PT_AODV:
+			format_aodv(p, &r);
+			break;
+		case PT_TCP:
+		case PT_ACK: {
+			struct hdr_tcp *th = HDR_TCP(p);
+			r.ext_kind = BIN_TRACE_EXT_TCP;
+			r.ext[0] = th->seqno_;
+			r.ext[1] = th->ackno_;
+			r.ext[2] = ch->num_forwards();
+			r.ext[3] = ch->opt_num_forwards();
+			break;
+		}
+		case PT_CBR: {
+			struct hdr_rtp *rh = HDR_RTP(p);
+			// as CMUTrace::format_rtp: a node receiving cbr
+			// data is in route for its energy model
+			if (r.ip[2] == src_ && thisnode &&
+			    thisnode->energy_model() &&
+			    thisnode->energy_model()->powersavingflag())
+				thisnode->energy_model()->set_node_state(EnergyModel::INROUTE);
+			r.ext_kind = BIN_TRACE_EXT_CBR;
+			r.ext[0] = rh->seqno_;
+			r.ext[1] = ch->num_forwards();
+			r.ext[2] = ch->opt_num_forwards();
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	writer_->write(&r);
+}
@@ -0,0 +1,102 @@
+/* -*-	Mode:C++; c-basic-offset:8; tab-width:8; indent-tabs-mode:t -*- */
+
+/*
+ * Binary packet traces for mobile nodes.
+ *
+ * CRBinTrace is created in place of CMUTrace by mobility-trace once
+ * "$ns bintrace-all" has been called. Instead of formatting a text line
+ * per event, it fills a fixed size record (trace/bintrace-file.h) which
+ * is appended to the write-behind buffer of a BinTraceWriter shared by
+ * all the trace objects. indep-utils/bintrace-dec turns the file back
+ * into the -newtrace text format.
+ */
+
+#ifndef ns_bintrace_h
+#define ns_bintrace_h
+
+#include <stdio.h>
+#include <string.h>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+#include "trace.h"
+#include "bintrace-file.h"
+
+class MobileNode;
+
+// Default size of the write-behind buffer
+#define BIN_TRACE_BUFFER_SIZE	(4 * 1024 * 1024)
+
+/* ======================================================================
+   BinTraceWriter: output file of the binary traces
+   ====================================================================== */
+class BinTraceWriter : public TclObject {
+public:
+	BinTraceWriter();
+	~BinTraceWriter();
+	int command(int argc, const char*const* argv);
+
+	inline void write(const bin_trace_record *r) {
+		if (fp_ == NULL)
+			return;
+		if (used_ + sizeof(*r) > size_)
+			flush_buffer();
+		memcpy(buf_ + used_, r, sizeof(*r));
+		used_ += sizeof(*r);
+	}
+	void sync();		// write out the buffered records
+
+private:
+	int open(const char *file, size_t size, int threaded);
+	void close();
+	void flush_buffer();	// hand the buffer to the writer thread, or write it
+	void write_out(const char *buf, size_t len);
+
+	FILE *fp_;
+	char *buf_;		// records being appended
+	size_t size_;		// size of each buffer
+	size_t used_;
+	int threaded_;
+
+#ifdef USE_THREADS
+	static void *writer_thread(void *arg);
+	char *spare_;		// second buffer
+	char *pending_;		// buffer being written by the thread, NULL if none
+	size_t pending_len_;
+	int stop_;
+	pthread_t thread_;
+	pthread_mutex_t lock_;
+	pthread_cond_t cond_;
+#endif
+
+	// All the writers, flushed at exit
+	static void sync_all();
+	static BinTraceWriter *writers_;
+	BinTraceWriter *next_;
+};
+
+/* ======================================================================
+   CRBinTrace: CMUTrace replacement writing binary records
+   ====================================================================== */
+class CRBinTrace : public Trace {
+public:
+	CRBinTrace(const char *s, char t);
+	void	recv(Packet *p, Handler *h);
+	void	recv(Packet *p, const char* why);
+
+private:
+	int	command(int argc, const char*const* argv);
+	int	node_energy();
+	void	format(Packet *p, const char *why);
+	void	format_mac(Packet *p, bin_trace_record *r);
+	void	format_ip(Packet *p, bin_trace_record *r);
+	void	format_aodv(Packet *p, bin_trace_record *r);
+
+	char	tracename_[BIN_TRACE_LEVEL_LEN + 1];
+	int	tracetype_;
+	int	smac_;		// the MAC is Mac/SMAC
+	MobileNode *node_;
+	BinTraceWriter *writer_;
+};
+
+#endif
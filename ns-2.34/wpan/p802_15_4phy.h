@@ -141,6 +141,13 @@ public:
 	void PLME_SET_request(PPIBAenum PIBAttribute,PHY_PIB *PIBAttributeValue);
 	UINT_8 measureLinkQ(Packet *p);
 	void recv(Packet *p, Handler *h);
+	// recv() computes the received power itself
+	int carrier_sense(Packet *p, double *Pr) {
+		return Phy::carrier_sense(p, Pr);
+	}
+	int sendUp_shared(Packet *p, ChannelReception *rec) {
+		return Phy::sendUp_shared(p, rec);
+	}
 	Packet* rxPacket(void) {return rxPkt;}
 	void wakeupNode(int cause); // 2.31 change: for MAC to wake up the node
 	void putNodeToSleep(); // 2.31 change: for MAC to put the node to sleep